@@ -0,0 +1,105 @@
+#pragma once
+#include <linux/types.h>
+#include <linux/io.h>
+
+/*
+ * FPGA device context.
+ *
+ * One per board bound by the cxl_dev PCI driver at module init; owns every
+ * BAR mapping the module uses so no caller ioremaps on its own path. BAR
+ * addresses and the board's bus number come from the PCI core. "BAR_1"
+ * below is the function CSR BAR, "BAR_0" the pattern window; which PCI
+ * BARs those are is configurable. All CSRs in BAR_1 are 64 bits wide and
+ * addressed by byte offset. Several offsets are shared between functions
+ * and mean different things depending on CXL_REG_FUNC_TYPE; the aliases
+ * below name each use.
+ */
+
+// BAR_1 CSR offsets
+#define CXL_REG_FUNC_TYPE          0x000
+#define CXL_REG_PAGE_ADDR0         0x008
+#define CXL_REG_PAGE_ADDR1         0x010
+#define CXL_REG_TEST_CASE          0x010   /* cache read/write micro-ops */
+#define CXL_REG_L2_DELAY           0x018   /* cycles of the last L2 run */
+#define CXL_REG_REQUESTER_ID       0x018   /* set_cxl */
+#define CXL_REG_ADDR_HANDSHAKE     0x018
+#define CXL_REG_L2_TEST_CASE       0x020
+#define CXL_REG_BLOCK_INDEX        0x020   /* set_cxl */
+#define CXL_REG_DATA_HANDSHAKE     0x020
+#define CXL_REG_L2_RESP            0x028   /* bit 0 = done, [63:1] = last L2 result */
+#define CXL_REG_RESP_HANDSHAKE     0x028
+#define CXL_REG_READ_DATA(n)       (0x030 + 8 * (n))   /* n = 0..7 */
+#define CXL_REG_L2_NUM_REQ         0x060
+#define CXL_REG_L2_ADDR_RANGE      0x068   /* dimension */
+#define CXL_REG_L2_START           0x070
+#define CXL_REG_L2_DIST_START      0x070   /* single-shot L2 */
+#define CXL_REG_WRITE_DATA(n)      (0x070 + 8 * (n))   /* n = 0..7 */
+#define CXL_REG_TX_HEADER_LOW      0x0b0
+#define CXL_REG_TX_HEADER_HIGH     0x0b8
+#define CXL_REG_TX_START           0x0c0
+#define CXL_REG_TX_PAYLOAD         0x0c8
+#define CXL_REG_SQ_ADDR            0x0d0
+#define CXL_REG_CQ_ADDR            0x0d8
+#define CXL_REG_BAR_ADDR           0x0e0
+#define CXL_REG_SQ_TAIL            0x0e8
+#define CXL_REG_CQ_HEAD            0x0f0
+#define CXL_REG_CSR_INIT           0x100
+#define CXL_REG_HOST_BUFFER        0x108
+#define CXL_REG_QUEUE_INDEX        0x110
+#define CXL_REG_M5_INTERVAL        0x118
+#define CXL_REG_DELAY_CNT          0x118
+#define CXL_REG_M5_RST             0x118
+#define CXL_REG_M5_QUERY_EN        0x120
+#define CXL_REG_L2_DIST_ADDR       0x128   /* L2_CAP_DIST_WB bitstreams: distance buffer, 0 = off */
+#define CXL_REG_L2_SG_ADDR         0x130   /* L2_CAP_SG bitstreams: descriptor table, 0 = off */
+#define CXL_REG_M5_HOT_PAGE(n)     (0x140 + 8 * (n))   /* n = 0..4 */
+
+#define CXL_CSR_SIZE               0x1000
+#define CXL_NVME_BAR_SIZE          (16 * 1024)
+
+// SSD (NVMe) BAR offsets read by check_db
+#define NVME_REG_ACQ               0x28
+#define NVME_REG_DOORBELL(n)       (0x1000 + 8 * (n))
+
+#define CXL_MAX_DEVS               8
+
+struct pci_dev;
+
+struct cxl_dev {
+    struct pci_dev *pdev;
+    u32           index;
+    u8            bus;      /* requester ID the board uses towards the SSD */
+    phys_addr_t   csr_pa;
+    phys_addr_t   bar0_pa;
+    phys_addr_t   nvme_pa;
+    void __iomem *csr;      /* BAR_1: function CSRs */
+    void __iomem *bar0;     /* BAR_0: 512B pattern window */
+    void __iomem *nvme;     /* SSD BAR: admin regs + doorbells (shared, may be NULL) */
+};
+
+/* Which boards to bind and where their registers live (module parameters) */
+struct cxl_dev_cfg {
+    u16 vendor;
+    u16 device;
+    int csr_bar;            /* PCI BAR index of BAR_1 */
+    int win_bar;            /* PCI BAR index of BAR_0 */
+    u64 nvme_pa;            /* SSD BAR the boards ring doorbells in; 0 = none */
+};
+
+/* Register the PCI driver; -ENODEV if no board matched */
+int  cxl_dev_init(const struct cxl_dev_cfg *cfg);
+void cxl_dev_exit(void);
+u32  cxl_dev_count(void);
+struct cxl_dev *cxl_dev_get_nth(u32 i);
+/* First board: the single-board cxl_set test paths */
+struct cxl_dev *cxl_dev_get(void);
+
+static inline u64 cxl_rd(struct cxl_dev *d, u32 off)
+{
+    return readq(d->csr + off);
+}
+
+static inline void cxl_wr(struct cxl_dev *d, u32 off, u64 val)
+{
+    writeq(val, d->csr + off);
+}
@@ -16,6 +16,7 @@ struct arona_dax_state
 
 	// Cold items
 	char *devname;
+	struct file *bdev_file;
 	struct block_device *bdev;
 	struct dax_device *daxdev;
 	u64 offset;
@@ -35,6 +36,12 @@ void write_512B_to_phys_buffer(phys_addr_t buffer_phys_addr);
 void test_fio(unsigned long long cq_addresses, unsigned long long sq_addresses, unsigned long long buffer_addresses, unsigned long long tail_head);
 
 //PMEM function
+/*
+ * Map a whole fsdax pmem namespace (e.g. /dev/pmem0) read-only through
+ * dax_direct_access(), 1 << align_order pages per call. The mapping must come
+ * back virtually and physically contiguous: va and pfn then cover size bytes.
+ * Returns the state or ERR_PTR(-errno).
+ */
 struct arona_dax_state *arona_dax_start(const char *dev, ulong align_order);
 void arona_dax_stop(struct arona_dax_state *state);
 void test_multiple_write(uint64_t *ptr, int iter, int test_case);
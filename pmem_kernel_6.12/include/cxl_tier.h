@@ -0,0 +1,43 @@
+#pragma once
+#include <linux/types.h>
+
+/*
+ * CXL -> DRAM page tiering driven by the FPGA's m5 hot-page tracker.
+ *
+ * A kthread opens one tracker window of interval_us at a time on board 0
+ * (CXL_REG_M5_INTERVAL counts clk_mhz cycles). At the end of each window it
+ * reads the five CXL_REG_M5_HOT_PAGE slots and resets the tracker. Every
+ * reported page scores a hit in a fixed-size hotness table keyed by PFN.
+ * Heat halves every CXL_TIER_DECAY_WINDOWS windows. Pages on cxl_nid that
+ * reach promote_heat are migrated to dram_nid. At most max_promoted pages
+ * are kept there; past that budget the coldest promoted pages are demoted
+ * back to cxl_nid first.
+ *
+ * Hot-page slots hold device addresses: cxl_base is added back, as
+ * l2_device_pa() took it off. Only movable order-0 LRU pages can be
+ * migrated. Kernel allocations such as the batch buffers are counted as
+ * unmovable and stay where they are.
+ *
+ * migrate_pages(), isolate_folio_to_list() and putback_movable_pages() are
+ * not exported by mainline. Without CXL_TIER_MIGRATE (make
+ * L2_TIER_MIGRATE=1, for kernels that export them) pages are tracked and
+ * counted as candidates, but never moved.
+ *
+ * Counters are in /sys/kernel/debug/l2_engine/counters (m5_hits,
+ * tier_candidates, tier_promoted, tier_demoted, tier_unmovable).
+ */
+#define CXL_TIER_DECAY_WINDOWS  16
+
+struct cxl_tier_cfg {
+    u32 interval_us;    /* tracker window; 0 = no sampler */
+    u32 clk_mhz;
+    int cxl_nid;
+    u64 cxl_base;
+    int dram_nid;
+    u32 table;          /* hotness table entries, rounded up to a power of two */
+    u32 promote_heat;
+    u32 max_promoted;   /* pages */
+};
+
+int  cxl_tier_start(const struct cxl_tier_cfg *cfg);
+void cxl_tier_stop(void);
@@ -0,0 +1,10 @@
+#pragma once
+
+struct l2_stream_cfg;
+
+/*
+ * /dev/l2_engine (see l2_ioctl.h). defaults fills a stream config from the
+ * module parameters; L2_IOC_LOAD overrides the dataset fields on top of it.
+ */
+int  l2_cdev_init(void (*defaults)(struct l2_stream_cfg *cfg));
+void l2_cdev_exit(void);
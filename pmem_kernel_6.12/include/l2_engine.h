@@ -0,0 +1,196 @@
+#pragma once
+#include <linux/types.h>
+
+#include "l2_meta.h"
+#include "l2_sg.h"
+
+/*
+ * L2 engine backend interface.
+ *
+ * Callers drive the distance engine through these ops instead of touching
+ * BAR_1 directly, so the streaming path runs unchanged against the FPGA or
+ * against a CPU model of it.
+ */
+
+#define L2_TEST_CASE_STREAM 100ull
+#define L2_RESP_DONE        0x1ull
+
+#define L2_HIST_BUCKETS 32
+
+/* Engines a run can shard the base set over (one per FPGA board) */
+#define L2_MAX_ENGINES  8
+
+/* Largest query block one launch compares against (4 MiB of 512B queries) */
+#define L2_MAX_QUERY_BLOCK 8192
+
+/* Bitstream capabilities (l2_engine_cfg.caps) */
+#define L2_CAP_DIST_WB      (1u << 0)   /* per-vector distances written to CXL_REG_L2_DIST_ADDR */
+#define L2_CAP_SG           (1u << 1)   /* base vectors gathered via CXL_REG_L2_SG_ADDR */
+
+struct l2_engine;
+struct l2_topk;
+
+struct l2_engine_ops {
+    const char *name;
+
+    /* Batch programming. va is only used by backends that compute on the CPU. */
+    void (*set_base)(struct l2_engine *eng, phys_addr_t pa, const void *va);
+    void (*set_query)(struct l2_engine *eng, phys_addr_t pa, const void *va);
+    void (*set_num_req)(struct l2_engine *eng, u64 num_vecs);
+    void (*set_dim)(struct l2_engine *eng, u32 dim);
+    /* Optional: element type other than Q16.16; <0 if unsupported */
+    int  (*set_elem)(struct l2_engine *eng, enum l2_elem elem);
+
+    void (*start)(struct l2_engine *eng);
+    void (*stop)(struct l2_engine *eng);
+    u64  (*read_resp)(struct l2_engine *eng);
+    u64  (*read_delay)(struct l2_engine *eng);
+
+    /*
+     * Optional native multi-query: compare every base vector against nq
+     * queries placed stride bytes apart from the query address. Backends
+     * without it get one launch per query over the same resident batch.
+     */
+    void (*set_num_query)(struct l2_engine *eng, u32 nq, u32 stride);
+    u64  (*read_query_resp)(struct l2_engine *eng, u32 q);
+
+    /*
+     * Optional per-vector distance writeback: the next launch stores one
+     * u64 distance per base vector (query-major for multi-query) at pa.
+     * pa == 0 turns it off. -EOPNOTSUPP makes the core compute the
+     * distances on the host from the batch's va instead.
+     */
+    int  (*set_dist_out)(struct l2_engine *eng, phys_addr_t pa, u64 *va);
+
+    /*
+     * Optional native top-k: fold the next launch's distances straight
+     * into tk[0..nq) with ids id_base + vector index. tk == NULL turns it
+     * off. Without it the core merges from the distance buffer.
+     */
+    int  (*set_topk)(struct l2_engine *eng, struct l2_topk *tk, u32 nq, u64 id_base);
+
+    /*
+     * Optional scatter-gather base: the next launch walks sg's descriptor
+     * table instead of the base address. sg == NULL turns it off. Without
+     * it the core launches once per chunk.
+     */
+    int  (*set_sg)(struct l2_engine *eng, const struct l2_sg_table *sg);
+
+    /* Optional: block until the completion interrupt fires; 0 if it did */
+    int  (*wait_irq)(struct l2_engine *eng, u64 timeout_ns);
+
+    void (*release)(struct l2_engine *eng);
+};
+
+struct l2_engine_cfg {
+    const char *name;       /* "fpga", "sw" or "cpu" */
+    u32         clk_mhz;    /* engine clock for cycle <-> ns conversions */
+    u32         spin_us;    /* busy-poll window around the expected finish */
+    u32         timeout_ms; /* give up on a batch after this long */
+    bool        use_irq;    /* wait on the FPGA's MSI instead of polling */
+    u32         caps;       /* L2_CAP_* the loaded bitstream supports */
+    u32         verify;     /* vectors per batch re-checked on the CPU (0 = off) */
+    int         nid;        /* cpu backend: run workers on the CPUs nearest this node */
+    u32         threads;    /* cpu backend: worker count (0 = every CPU there, 1 = inline) */
+    u32         count;      /* sw/cpu: model instances (fpga: one per bound board) */
+};
+
+/* Per-batch completion accounting: host wall-clock vs device cycles */
+struct l2_wait_stats {
+    u64 batches;
+    u64 wall_ns;        /* start -> done as observed by the host */
+    u64 dev_ns;         /* DELAY converted at clk_mhz */
+    u64 spins;          /* RESP reads inside the busy-poll window */
+    u64 sleeps;         /* hrtimer sleeps (pre-sleep and backoff) */
+    u64 irqs;           /* batches completed by interrupt */
+    u64 verified;       /* distances re-checked on the CPU */
+    u64 mismatches;     /* ... that disagreed with the engine */
+    u64 hist_wall[L2_HIST_BUCKETS];   /* log2(wall ns) */
+    u64 hist_tax[L2_HIST_BUCKETS];    /* log2(wall ns - device ns) */
+};
+
+struct l2_engine {
+    const struct l2_engine_ops *ops;
+    void *priv;
+    struct l2_engine_cfg cfg;
+    u32 index;              /* fpga: the cxl_dev board it drives */
+
+    u64 est_cpv_x1000;      /* running estimate of DELAY per vector, x1000 */
+    struct l2_wait_stats stats;
+};
+
+/* One batch as the engine sees it */
+struct l2_job {
+    phys_addr_t base_pa;    /* device address of the base vectors (DPA on CXL) */
+    const void *base_va;
+    phys_addr_t query_pa;
+    const void *query_va;
+    u64         num_vecs;
+    u32         dim;
+    enum l2_elem elem;
+
+    u32         num_queries;    /* 0 or 1 = single query */
+    u32         query_stride;   /* bytes between consecutive queries */
+    u64        *last_l2;        /* optional out: RESP[63:1] per query */
+
+    u64        *dist;           /* optional out: dist[q * num_vecs + v] */
+    phys_addr_t dist_pa;        /* device address of dist */
+
+    struct l2_topk *topk;       /* optional: per-query running top-k */
+    u64         id_base;        /* id of this batch's first vector */
+
+    const struct l2_sg_table *sg;   /* optional: base is this chunk list, base_pa/va unused */
+};
+
+/*
+ * Select the active backend by cfg->name and create its engines: one per
+ * FPGA board bound by cxl_dev, or cfg->count CPU models. cfg->clk_mhz is
+ * also the clock the software model reports cycles at.
+ */
+int  l2_engine_init(const struct l2_engine_cfg *cfg);
+void l2_engine_exit(void);
+u32  l2_engine_count(void);
+struct l2_engine *l2_engine_get_nth(u32 i);
+/* Engine 0: resident sets, ioctl searches and the cxl_set test paths */
+struct l2_engine *l2_engine_get(void);
+
+/*
+ * Program one job, start it and poll RESP until done.
+ * Returns 0 with *cycles (DELAY) and *resp filled, or -ETIMEDOUT.
+ * For multi-query jobs *cycles is the total over all queries and *resp is
+ * the last query's RESP.
+ */
+int l2_engine_run(struct l2_engine *eng, const struct l2_job *job,
+                  u64 *cycles, u64 *resp);
+
+void l2_engine_reset_stats(struct l2_engine *eng);
+void l2_engine_dump_stats(struct l2_engine *eng);
+
+/*
+ * Squared L2 as computed by the engine. fp16 elements are widened to
+ * Q16.16 first, so their distances are on the same scale as Q16.16 ones.
+ */
+u64 l2_dist_q16(const s32 *v, const s32 *q, u32 dim);
+u64 l2_dist(const void *v, const void *q, u32 dim, enum l2_elem elem);
+
+/*
+ * PQ8 (asymmetric) distance. A PQ job's query is a lookup table of dim x
+ * 256 u64 partial distances, one row per sub-quantizer (l2_pq_build_lut()),
+ * so l2_dist() on PQ8 codes sums lut[i * 256 + code[i]]. No FPGA support;
+ * the sw and cpu backends only.
+ */
+u64 l2_dist_pq(const u8 *code, const u64 *lut, u32 m);
+
+/* Vectorised Q16.16 kernels (AVX2/AVX-512 on x86-64, scalar elsewhere) */
+typedef u64 (*l2_dist_q16_fn)(const s32 *v, const s32 *q, u32 dim);
+typedef u64 (*l2_dist_pq_fn)(const u8 *code, const u64 *lut, u32 m);
+
+l2_dist_q16_fn l2_simd_select(const char **name, bool *fpu);
+l2_dist_pq_fn  l2_simd_select_pq(const char **name, bool *fpu);
+void l2_simd_begin(void);
+void l2_simd_end(void);
+
+// Backends
+int l2_engine_mmio_create(struct l2_engine *eng);
+int l2_engine_sw_create(struct l2_engine *eng);
+int l2_engine_cpu_create(struct l2_engine *eng);
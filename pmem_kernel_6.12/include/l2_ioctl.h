@@ -0,0 +1,153 @@
+#pragma once
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * /dev/l2_engine: query submission against the resident dataset.
+ *
+ * Shared with userspace, so only fixed-width __u types here.
+ *
+ *   1. L2_IOC_INFO   -> dataset handle and vector layout (-ENOENT if no
+ *                       dataset is resident; L2_IOC_LOAD loads one).
+ *   2. L2_IOC_SETUP  -> size this fd's buffers for max_queries x max_k.
+ *   3. mmap() offset L2_MMAP_QUERY  -> query buffer (read/write)
+ *      mmap() offset L2_MMAP_RESULT -> result buffer (read only)
+ *   4. write nq query vectors (vec_bytes apart) into the query buffer and
+ *      issue L2_IOC_SEARCH. Query q's k nearest neighbours are then at
+ *      result[q * max_k ...], ascending by distance; unused slots have
+ *      id = L2_RESULT_NONE.
+ *
+ * Vector data never passes through copy_{to,from}_user: the engine reads
+ * the mapped query pages and the top-k is built in the mapped results.
+ *
+ * For high rates, L2_IOC_RING_SETUP adds an NVMe-style submission and
+ * completion queue pair (mapped at L2_MMAP_RING) served by a kernel
+ * worker, so searches need no syscall each; see struct l2_ring_hdr.
+ */
+
+#define L2_IOC_MAGIC    'L'
+
+struct l2_ioc_info {
+    __u64 handle;       /* changes whenever a new dataset is loaded */
+    __u64 vectors;
+    __u32 dim;
+    __u32 elem;         /* enum l2_elem of the queries (codebook's for PQ sets) */
+    __u32 vec_bytes;    /* of one query */
+    __u32 max_query_block;
+    char  engine[16];
+};
+
+struct l2_ioc_load {
+    __u64 path;         /* user pointer to a NUL-terminated path */
+    __u64 batch_vecs;   /* 0 = module default */
+    __u32 direct;       /* read with O_DIRECT */
+    __u32 rsvd;
+};
+
+struct l2_ioc_setup {
+    __u32 max_queries;
+    __u32 max_k;
+
+    // Out: mmap() lengths
+    __u64 query_bytes;
+    __u64 result_bytes;
+};
+
+struct l2_ioc_search {
+    __u64 handle;       /* from L2_IOC_INFO; -ESTALE once reloaded */
+    __u32 nq;
+    __u32 k;            /* 1..max_k */
+
+    // Out
+    __u64 cycles;       /* engine DELAY over the whole search */
+    __u64 wall_ns;
+};
+
+/* Same layout as struct l2_topk_ent */
+struct l2_ioc_result {
+    __u64 id;
+    __u64 dist;
+};
+
+#define L2_RESULT_NONE  (~0ull)
+
+/*
+ * Submission/completion rings.
+ *
+ * The mapping is a header page, then sq_entries SQEs at sq_off and
+ * cq_entries CQEs at cq_off. As on NVMe, indices wrap at the entry count:
+ *
+ *  - userspace fills SQE [sq_tail], then advances sq_tail (release);
+ *  - the worker posts one CQE per SQE with the phase bit flipped on each
+ *    pass over the CQ (first pass: phase 1), so a CQE is new when its
+ *    phase matches the one expected at cq_head;
+ *  - userspace advances cq_head once it has consumed CQEs. The worker never
+ *    overwrites an unconsumed CQE.
+ *
+ * The worker busy-polls sq_tail for a short while after going idle, then
+ * sets L2_RING_NEED_WAKEUP and sleeps: after advancing sq_tail, check the
+ * flag and issue L2_IOC_RING_ENTER only if it is set. Completions signal
+ * the eventfd given at setup (if any) and make the fd poll()-readable.
+ *
+ * An SQE searches queries [qidx, qidx + nq) of the query buffer; query i's
+ * results land at result[i * max_k ...], as for L2_IOC_SEARCH.
+ */
+struct l2_ring_hdr {
+    // Written by userspace
+    __u32 sq_tail;
+    __u32 cq_head;
+    __u32 rsvd0[14];
+
+    // Written by the driver
+    __u32 sq_head;      /* next SQE the worker reads */
+    __u32 flags;
+    __u32 sq_entries;
+    __u32 cq_entries;
+    __u32 sq_off;       /* byte offsets into the ring mapping */
+    __u32 cq_off;
+    __u32 rsvd1[10];
+};
+
+#define L2_RING_NEED_WAKEUP (1u << 0)
+
+struct l2_sqe {
+    __u64 user_data;    /* echoed in the CQE */
+    __u64 handle;
+    __u32 qidx;
+    __u32 nq;
+    __u32 k;
+    __u32 rsvd;
+};
+
+struct l2_cqe {
+    __u64 user_data;
+    __u64 cycles;
+    __u64 wall_ns;
+    __s32 status;       /* 0 or -errno */
+    __u16 sq_head;      /* worker's SQ head after this SQE */
+    __u16 flags;        /* bit 0: phase */
+};
+
+#define L2_CQE_PHASE    (1u << 0)
+
+struct l2_ioc_ring {
+    __u32 sq_entries;   /* 2..4096 */
+    __u32 cq_entries;   /* 2..4096 */
+    __s32 eventfd;      /* -1 = none */
+    __u32 rsvd;
+
+    // Out: mmap() length
+    __u64 ring_bytes;
+};
+
+/* mmap() offsets */
+#define L2_MMAP_QUERY   0x00000000ull
+#define L2_MMAP_RESULT  0x40000000ull
+#define L2_MMAP_RING    0x80000000ull
+
+#define L2_IOC_INFO     _IOR(L2_IOC_MAGIC, 1, struct l2_ioc_info)
+#define L2_IOC_LOAD     _IOW(L2_IOC_MAGIC, 2, struct l2_ioc_load)
+#define L2_IOC_SETUP    _IOWR(L2_IOC_MAGIC, 3, struct l2_ioc_setup)
+#define L2_IOC_SEARCH   _IOWR(L2_IOC_MAGIC, 4, struct l2_ioc_search)
+#define L2_IOC_RING_SETUP _IOWR(L2_IOC_MAGIC, 5, struct l2_ioc_ring)
+#define L2_IOC_RING_ENTER _IO(L2_IOC_MAGIC, 6)
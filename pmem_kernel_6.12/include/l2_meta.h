@@ -0,0 +1,65 @@
+#pragma once
+#include <linux/types.h>
+
+/*
+ * Vector file layout.
+ *
+ * scripts/fvecs_to_bin.py writes a .meta sidecar next to every .bin
+ * ("key=value" lines). The fields used here are vectors, dimension, bytes
+ * and fixed_format, which names the element type. Everything that
+ * sizes batches, query blocks or strides takes vec_bytes from here.
+ *
+ * Product-quantized sets (fixed_format=pq8, from tools/vecconv -p) store
+ * pq_m one-byte codes per vector plus a codebook (see l2_pq.h); their
+ * queries stay full vectors of pq_elem, so query_bytes != vec_bytes.
+ */
+enum l2_elem {
+    L2_ELEM_Q16  = 0,   /* signed int32, Q16.16 fixed point (the FPGA's format) */
+    L2_ELEM_INT8 = 1,   /* signed int8 */
+    L2_ELEM_FP16 = 2,   /* IEEE half */
+    L2_ELEM_PQ8  = 3,   /* one u8 PQ code per sub-quantizer */
+};
+
+struct l2_vec_layout {
+    u64          vectors;   /* 0 if unknown (no .meta) */
+    u32          dim;       /* of the original vectors, also for PQ */
+    enum l2_elem elem;
+    u32          elem_bytes;
+    u32          vec_bytes;
+
+    // Queries (== elem/vec_bytes unless PQ)
+    enum l2_elem query_elem;
+    u32          query_bytes;
+    u32          pq_m;      /* sub-quantizers; 0 = not PQ */
+};
+
+/* Components per stored vector: codes for PQ, elements otherwise */
+static inline u32 l2_layout_width(const struct l2_vec_layout *lay)
+{
+    return lay->pq_m ? lay->pq_m : lay->dim;
+}
+
+static inline u32 l2_elem_size(enum l2_elem elem)
+{
+    switch (elem) {
+    case L2_ELEM_INT8:
+    case L2_ELEM_PQ8:
+        return 1;
+    case L2_ELEM_FP16:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+const char *l2_elem_name(enum l2_elem elem);
+/* bin_path with its extension replaced by suffix (".meta", ".pq"); kfree() it */
+char *l2_sidecar_path(const char *bin_path, const char *suffix);
+int  l2_elem_parse(const char *s, enum l2_elem *elem);
+
+/*
+ * Fill *lay from the .meta next to bin_path. Non-zero dim and a non-empty
+ * elem override the file; without a .meta they default to 128 and Q16.16.
+ */
+int  l2_layout_resolve(const char *bin_path, u32 dim, const char *elem,
+                       struct l2_vec_layout *lay);
@@ -0,0 +1,82 @@
+#pragma once
+#include <linux/types.h>
+#include <linux/atomic.h>
+
+/*
+ * Peer-to-peer NVMe ingest over one I/O queue pair.
+ *
+ * Base-vector blocks are fetched with NVMe READ commands whose PRPs point
+ * at the batch buffers themselves, so the SSD writes them straight into
+ * CXL memory: no page cache, no copy through host DRAM. The CPU only
+ * builds commands, rings the SQ tail doorbell and reaps completions.
+ *
+ * "ssd": a queue pair created on the SSD for the module alone (qid, SQ and
+ *        CQ at sq_pa/cq_pa, unused so far: tail, head and phase at reset).
+ *        Its doorbells are in the SSD BAR mapped by cxl_dev. The base set
+ *        lies on namespace nsid as raw blocks from slba on.
+ * "emu": the same queue pair in host memory, serviced by a kthread that
+ *        plays the controller against a local file (LBA 0 = byte 0), so
+ *        the path can be tested without an SSD or FPGA.
+ *
+ * Commands move at most max_xfer bytes; the controller memory page size is
+ * 4 KiB (CC.MPS = 0).
+ */
+#define L2_NVME_PAGE        4096
+#define L2_NVME_MAX_XFER    (2u << 20)  /* one PRP list page per command */
+#define L2_NVME_MAX_DEPTH   1024
+
+struct l2_nvme_cfg {
+    const char *mode;       /* "ssd" | "emu" */
+    const char *file;       /* emu: backing file */
+    u16         qid;
+    u32         depth;      /* SQ and CQ entries */
+    u32         nsid;
+    u32         lba_shift;  /* 9 = 512B blocks, 12 = 4KiB */
+    u64         slba;       /* first block of the base set */
+    u32         max_xfer;   /* bytes per command (MDTS), 0 = L2_NVME_MAX_XFER */
+    u64         sq_pa;      /* ssd: the queue pair's rings */
+    u64         cq_pa;
+};
+
+struct l2_nvme_q;
+
+int  l2_nvme_init(const struct l2_nvme_cfg *cfg);
+void l2_nvme_exit(void);
+/* NULL unless l2_nvme_init() set a queue pair up */
+struct l2_nvme_q *l2_nvme_get(void);
+u32  l2_nvme_block_size(const struct l2_nvme_q *q);
+
+/* Reads of one batch, waited for together */
+struct l2_nvme_io {
+    atomic_t pending;   /* commands not completed yet */
+    int      status;    /* first error */
+};
+
+static inline void l2_nvme_io_init(struct l2_nvme_io *io)
+{
+    atomic_set(&io->pending, 0);
+    io->status = 0;
+}
+
+/*
+ * Queue reads of len bytes at byte pos of the base set into the physically
+ * contiguous buffer at CPU physical address pa. pos, pa and len must be
+ * multiples of the block size; pa is also page aligned. Blocks only while
+ * the queue is full.
+ */
+int l2_nvme_read(struct l2_nvme_q *q, struct l2_nvme_io *io, u64 pos, phys_addr_t pa,
+                 size_t len);
+
+/*
+ * Poll until every read of io has completed; 0 or the first error.
+ * -ETIMEDOUT leaves the queue pair dead: l2_nvme_read() fails from then on
+ * and the timed-out READs may still write their buffers. Do not free those;
+ * hand them to l2_nvme_park() instead.
+ */
+int l2_nvme_wait(struct l2_nvme_q *q, struct l2_nvme_io *io);
+
+/*
+ * Call release(arg) once no READ that timed out can land any more: when the
+ * last of them completes, or when the queue pair is torn down.
+ */
+void l2_nvme_park(struct l2_nvme_q *q, void (*release)(void *arg), void *arg);
@@ -0,0 +1,21 @@
+#pragma once
+#include <linux/types.h>
+
+/*
+ * Worker kthread pool.
+ *
+ * One kthread per CPU of the node nearest to a (possibly CPU-less) memory
+ * node, each bound to its CPU. l2_pool_run() hands fn(arg, idx, nr) to
+ * every worker and returns once all of them have finished; callers split
+ * the work by idx and keep per-worker state indexed by it, so workers
+ * never share anything writable.
+ */
+struct l2_pool;
+
+typedef void (*l2_pool_fn)(void *arg, u32 idx, u32 nr);
+
+struct l2_pool *l2_pool_create(int near_nid, u32 max_workers);
+void l2_pool_destroy(struct l2_pool *pool);
+u32  l2_pool_size(const struct l2_pool *pool);
+int  l2_pool_node(const struct l2_pool *pool);
+void l2_pool_run(struct l2_pool *pool, l2_pool_fn fn, void *arg);
@@ -0,0 +1,54 @@
+#pragma once
+#include <linux/types.h>
+
+#include "l2_meta.h"
+
+struct file;
+struct l2_topk;
+
+/*
+ * Product quantization (PQ8).
+ *
+ * A vector of dim components is split into m sub-vectors of dim / m
+ * components; each is replaced by the index of its nearest centroid in that
+ * sub-space's 256-entry codebook, so the base file holds m bytes per vector.
+ * The codebook sits next to the codes as "<stem>.pq": m x 256 centroids of
+ * dim / m elements, in the element type the queries use (tools/vecconv -p).
+ *
+ * Queries stay full vectors. Per query, l2_pq_build_lut() precomputes the
+ * squared distance from each query sub-vector to all 256 centroids; a scan
+ * then only sums m table entries per vector (l2_dist_pq()). Distances are
+ * on the same scale as exact l2_dist() ones, so candidates can be re-ranked
+ * against full-precision vectors with l2_pq_rerank().
+ */
+#define L2_PQ_KSUB      256
+
+/* Query block cap: lookup tables of one block stay below this */
+#define L2_PQ_LUT_MAX   (64u << 20)
+
+struct l2_pq {
+    u32          m;
+    u32          dsub;      /* components per sub-vector */
+    enum l2_elem elem;      /* of the centroids and the queries */
+    u32          sub_bytes;
+    void        *codebook;  /* m x L2_PQ_KSUB x sub_bytes */
+};
+
+int  l2_pq_load(struct l2_pq *pq, const char *bin_path, const struct l2_vec_layout *lay);
+void l2_pq_free(struct l2_pq *pq);
+
+/* One query's table: m rows of L2_PQ_KSUB u64 */
+static inline size_t l2_pq_lut_bytes(const struct l2_pq *pq)
+{
+    return (size_t)pq->m * L2_PQ_KSUB * sizeof(u64);
+}
+
+void l2_pq_build_lut(const struct l2_pq *pq, const void *query, u64 *lut);
+
+/*
+ * Replace the distances in tk with exact ones against the full-precision
+ * vectors in full (lay's query layout, vector id at id * query_bytes),
+ * sort, and keep the best k. scratch holds one vector.
+ */
+int l2_pq_rerank(struct file *full, const struct l2_vec_layout *lay, const void *query,
+                 struct l2_topk *tk, u32 k, void *scratch);
@@ -0,0 +1,84 @@
+#pragma once
+#include <linux/types.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+
+struct file;
+struct page;
+struct workqueue_struct;
+
+/*
+ * Sequential dataset reader.
+ *
+ * Opens the base file once per run and hands out consecutive chunks of it.
+ * In buffered mode it keeps a WILLNEED readahead window ra_bytes ahead of
+ * the consumer; with direct set it bypasses the page cache (O_DIRECT), in
+ * which case every read offset and length is a multiple of align.
+ */
+struct l2_reader {
+    struct file *f;
+    const char  *path;
+    loff_t       start;      /* where a rewind goes back to: a shard's first byte */
+    loff_t       pos;        /* next byte handed to the consumer */
+    loff_t       size;       /* file size at open */
+    loff_t       ra_pos;     /* readahead issued up to here */
+    size_t       ra_bytes;
+    u32          align;
+    bool         direct;
+    u64          bytes_read;
+
+    // Asynchronous reads, see l2_reader_aio()
+    u32          aio_qd;     /* requests in flight; 0 = synchronous kernel_read */
+    size_t       aio_bytes;  /* per request */
+    u32          aio_cpus;   /* CPUs requests are submitted from; 0 = the caller's */
+    u32          aio_next;
+    atomic_t     aio_inflight;
+    wait_queue_head_t aio_wq;
+    struct workqueue_struct *aio_wq_submit;
+};
+
+#define L2_READER_ALIGN 4096
+
+int  l2_reader_open(struct l2_reader *r, const char *path, bool direct, size_t ra_bytes);
+void l2_reader_close(struct l2_reader *r);
+void l2_reader_rewind(struct l2_reader *r);
+
+/*
+ * Read the next `want` bytes into dst, whose capacity is `cap` bytes.
+ * Only the part of dst past the data actually read is zeroed.
+ * Returns the number of payload bytes read (< want only at EOF) or <0.
+ */
+long l2_reader_read(struct l2_reader *r, void *dst, size_t want, size_t cap);
+
+/*
+ * Asynchronous reads: up to qd kiocb reads of `bytes` each in flight at
+ * once, so the device sees a deep queue instead of one request at a time.
+ * With O_DIRECT they complete straight into the destination pages. With
+ * cpus > 1 submissions rotate over that many CPUs (and so over the
+ * device's hardware queues) through a workqueue.
+ */
+int l2_reader_aio(struct l2_reader *r, u32 qd, size_t bytes, u32 cpus);
+
+/* Reads of one batch, waited for together */
+struct l2_reader_batch {
+    atomic_t pending;
+    int      status;
+};
+
+static inline void l2_reader_batch_init(struct l2_reader_batch *b)
+{
+    atomic_set(&b->pending, 0);
+    b->status = 0;
+}
+
+/*
+ * Queue the next `want` bytes into the physically contiguous pages at
+ * pages (capacity cap). Same alignment rules as l2_reader_read(); unlike
+ * it, nothing is zeroed. Blocks only while qd requests are in flight.
+ * Returns the number of payload bytes queued or <0.
+ */
+long l2_reader_submit(struct l2_reader *r, struct l2_reader_batch *b, struct page *pages,
+                      size_t want, size_t cap);
+
+/* Wait for every read of b; 0 or the first error (a short read is -EIO) */
+int l2_reader_wait(struct l2_reader *r, struct l2_reader_batch *b);
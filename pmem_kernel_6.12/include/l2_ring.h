@@ -0,0 +1,29 @@
+#pragma once
+#include <linux/types.h>
+#include <linux/poll.h>
+
+struct file;
+struct vm_area_struct;
+struct l2_sqe;
+struct l2_cqe;
+
+/*
+ * Shared-memory SQ/CQ pair (layout in l2_ioctl.h) with a kernel worker.
+ *
+ * The worker consumes SQEs in order and hands each to fn, which fills the
+ * CQE's result fields; the ring code owns the indices, phase bits and
+ * wakeups. fn runs in the worker's context and may sleep.
+ */
+struct l2_ring;
+
+typedef void (*l2_ring_fn)(void *arg, const struct l2_sqe *sqe, struct l2_cqe *cqe);
+
+struct l2_ring *l2_ring_create(u32 sq_entries, u32 cq_entries, int eventfd,
+                               l2_ring_fn fn, void *arg);
+void   l2_ring_destroy(struct l2_ring *ring);
+size_t l2_ring_bytes(const struct l2_ring *ring);
+
+/* Wake an idle worker (L2_IOC_RING_ENTER) */
+void     l2_ring_kick(struct l2_ring *ring);
+__poll_t l2_ring_poll(struct l2_ring *ring, struct file *file, poll_table *wait);
+int      l2_ring_mmap(struct l2_ring *ring, struct vm_area_struct *vma);
@@ -0,0 +1,90 @@
+#pragma once
+#include <linux/types.h>
+
+struct page;
+
+/*
+ * Scatter-gather batches.
+ *
+ * A batch buffer is built from physically contiguous chunks of at most
+ * MAX_PAGE_ORDER, falling back to smaller orders on a fragmented node, so
+ * its size is no longer capped by the buddy allocator. Every chunk holds
+ * whole vectors (a multiple of unit_vecs).
+ *
+ * The engine sees the chunk list as a chained descriptor table in
+ * device memory: 16-byte descriptors packed into pages. The last slot of
+ * a full page has L2_SG_CHAIN set and points at the next page. The
+ * descriptor for the batch's final chunk carries L2_SG_LAST.
+ */
+struct l2_sg_desc {
+    __le64 addr;        /* device address of the chunk (or next table page) */
+    __le32 nvecs;
+    __le32 flags;
+};
+
+#define L2_SG_LAST      (1u << 0)
+#define L2_SG_CHAIN     (1u << 1)
+
+struct l2_sg_chunk {
+    struct page *pages;     /* NULL: wrapped, not ours */
+    unsigned int order;
+    void        *va;
+    phys_addr_t  dev_pa;
+    u64          cap;       /* vectors the chunk can hold */
+    u64          nvecs;     /* vectors in the current batch */
+};
+
+struct l2_sg_table {
+    struct l2_sg_chunk *chunks;
+    u32          nchunks;
+    u32          used;      /* chunks holding data in the current batch */
+    u64          cap;       /* total vectors */
+    u32          vec_bytes;
+
+    // Descriptor pages, chained in order
+    struct page **desc;
+    u32          ndesc;
+    phys_addr_t  desc_pa;   /* device address of the first page */
+};
+
+// Device address of a CXL-node buffer as seen by the FPGA
+phys_addr_t l2_device_pa(phys_addr_t cpu_pa, int nid, u64 cxl_base);
+
+#define L2_MAX_NODES    8
+
+// A CXL node and the CPU physical address its device window starts at
+struct l2_node {
+    int nid;
+    u64 cxl_base;       /* 0 = no DPA translation */
+};
+
+/*
+ * Parse "nid[@cxl_base],..." into at most max nodes, e.g.
+ * "1@0x8080000000,2@0x10080000000". An empty list gives just *def.
+ * Returns the number of nodes or -errno.
+ */
+int l2_nodes_parse(const char *s, const struct l2_node *def, struct l2_node *nodes, u32 max);
+
+/*
+ * Index of the node whose CXL window holds [pa, pa + bytes), by the range's
+ * target node or else by the window bounds; -1 if it lies in no window.
+ */
+int l2_nodes_find(const struct l2_node *nodes, u32 n, phys_addr_t pa, u64 bytes);
+
+int  l2_sg_alloc(struct l2_sg_table *t, u64 vecs, u32 vec_bytes, u32 unit_vecs,
+                 int nid, u64 cxl_base);
+/*
+ * A one-chunk table over vecs vectors of memory the caller already owns and
+ * keeps mapped (a DAX namespace), at CPU address va and device address
+ * dev_pa. Only the descriptors are allocated, on nid; l2_sg_free() leaves
+ * the memory alone.
+ */
+int  l2_sg_wrap(struct l2_sg_table *t, void *va, phys_addr_t dev_pa, u64 vecs, u32 vec_bytes,
+                int nid, u64 cxl_base);
+void l2_sg_free(struct l2_sg_table *t);
+
+/* Lay out a batch of nvecs across the chunks and rewrite the descriptors */
+void l2_sg_fill(struct l2_sg_table *t, u64 nvecs);
+
+/* CPU address of vector v of the current batch */
+const void *l2_sg_vec(const struct l2_sg_table *t, u64 v);
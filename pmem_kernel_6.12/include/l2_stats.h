@@ -0,0 +1,97 @@
+#pragma once
+#include <linux/types.h>
+
+/*
+ * Lock-free per-CPU accounting for the streaming path, read back through
+ * debugfs (/sys/kernel/debug/l2_engine/): a log2(ns) histogram per phase
+ * (see l2_trace.h for what each covers) and running byte/vector counters.
+ */
+enum l2_phase {
+    L2_PH_READ,
+    L2_PH_PREP,
+    L2_PH_STALL,
+    L2_PH_CSR,
+    L2_PH_WAIT,
+    L2_PH_READBACK,
+    L2_PH_BATCH,
+    L2_PH_NR,
+};
+
+enum l2_ctr {
+    L2_CTR_BYTES_READ,
+    L2_CTR_BATCHES,
+    L2_CTR_VECS,
+    L2_CTR_PAIRS,       /* vector x query comparisons */
+    L2_CTR_CYCLES,      /* engine DELAY */
+    L2_CTR_DEV_NS,      /* DELAY at clk_mhz */
+    L2_CTR_WALL_NS,     /* host time over the same batches */
+    L2_CTR_M5_HITS,     /* hot-page slots reported by the m5 tracker, see cxl_tier.h */
+    L2_CTR_TIER_CANDIDATES,
+    L2_CTR_TIER_PROMOTED,
+    L2_CTR_TIER_DEMOTED,
+    L2_CTR_TIER_UNMOVABLE,
+    L2_CTR_NR,
+};
+
+void l2_stats_phase(enum l2_phase ph, u64 ns);
+void l2_stats_add(enum l2_ctr c, u64 v);
+
+/*
+ * Last streaming run, for scripts and dashboards instead of the kernel log:
+ *
+ *   state        idle | running | done | failed
+ *   run.json     run state plus the totals below and derived rates
+ *   batches.csv  one row per batch (capped at L2_RUN_MAX_BATCHES)
+ *
+ * A run is everything between l2_stats_run_begin() and l2_stats_run_end();
+ * callers serialise runs. At insmod the single-shot run and the resident
+ * load are recorded as runs too, so a failed one reads as failed, not
+ * idle. Batches outside a run (ioctl searches) are not recorded.
+ */
+#define L2_RUN_MAX_BATCHES  65536
+
+enum l2_run_state {
+    L2_RUN_IDLE,
+    L2_RUN_RUNNING,
+    L2_RUN_DONE,
+    L2_RUN_FAILED,
+};
+
+struct l2_run_totals {
+    char engine[16];
+    char elem[8];
+    u32  dim;
+    u32  vec_bytes;
+    u32  clk_mhz;
+    u32  queries;
+    u32  depth;
+    u32  nodes;         /* CXL nodes the batch buffers are spread over */
+    u32  engines;       /* engines (boards) the base set was sharded over */
+    bool direct;
+    bool p2p;           /* base set read by NVMe P2P into the batch buffers */
+    bool dax;           /* batches mapped from a pmem namespace, never read */
+    u32  aio_qd;        /* asynchronous base-file reads in flight, 0 = synchronous */
+    bool resident;
+    u64  batch_vecs;
+    u64  scans;
+    u64  vecs;          /* summed over scans */
+    u64  pairs;
+    u64  bytes_read;    /* from the base file; 0 when resident */
+    u64  cycles;
+    u64  wall_ns;
+    u64  read_ns;
+    u64  compute_ns;
+    u64  io_stall_ns;
+    u64  load_stall_ns;
+    u64  verified;
+    u64  mismatches;
+};
+
+void l2_stats_run_begin(void);
+void l2_stats_run_batch(u64 scan, u64 pass, u64 vecs, u32 nq, u64 cycles,
+                        u64 dev_ns, u64 wall_ns);
+void l2_stats_run_totals(const struct l2_run_totals *t);
+void l2_stats_run_end(int rc);
+
+int  l2_stats_init(void);
+void l2_stats_exit(void);
@@ -1,12 +1,89 @@
 #pragma once
 #include <linux/types.h>
 
+#include "l2_meta.h"
+
+struct l2_topk;
+
+#define L2_MAX_DEPTH 8
+
+struct l2_stream_cfg {
+    const char *base_path;
+    const char *query_path;
+    u64         total_vecs; /* 0 = every vector in the file */
+    u32         dim;        /* 0 = from the .meta sidecar */
+    const char *elem;       /* "q16" | "int8" | "fp16"; NULL/"" = from .meta */
+    u64         batch_vecs; /* 0 = as many as fit in batch_kb */
+    u32         batch_kb;
+    u32         clk_mhz;
+    int         cxl_nid;
+    u64         cxl_base;
+    const char *cxl_nodes;  /* "nid[@base],..." to interleave over; NULL/"" = cxl_nid */
+    u32         depth;      /* batch buffers in flight (1 = serial) */
+    bool        direct;     /* read the base file with O_DIRECT */
+    u32         readahead_kb;
+    u32         aio_qd;     /* asynchronous reads in flight (0 = one kernel_read at a time) */
+    u32         aio_kb;     /* per asynchronous read */
+    u32         aio_cpus;   /* CPUs submitting them (0/1 = the loader) */
+    bool        p2p;        /* ingest through the l2_nvme queue pair, not the page cache */
+    bool        dax;        /* base_path is an fsdax pmem namespace: batches point into it */
+    u32         num_queries;    /* queries to serve from query_path */
+    u32         query_first;    /* index of the first one */
+    u32         query_block;    /* queries compared per base scan (0 = all) */
+    u32         topk;           /* nearest neighbours kept per query (0 = off) */
+    const char *rerank_path;    /* PQ: full-precision base set for re-ranking */
+    u32         rerank;         /* PQ: candidates re-ranked per query (<= topk: off) */
+    bool        resident;       /* serve from the resident dataset, not base_path */
+};
+
 /**
- * Stream SIFT1M base vectors in batches and measure total cycles.
+ * Stream base vectors in batches and measure total cycles. Dimension and
+ * element type come from the files' .meta sidecars (see l2_meta.h).
+ * A loader thread fills up to cfg->depth batch buffers on the CXL node
+ * while the engine works on the oldest one. Queries are served in blocks of
+ * cfg->query_block: each base batch is read once per block and compared
+ * against every query in it. With cfg->topk set, every batch's per-vector
+ * distances are merged into a per-query top-k that is written out as a
+ * binary results file (see l2_topk.h).
  * Returns 0 on success, <0 on error.
  */
-int run_l2_streaming_from_file(const char *base_path,
-                               const char *query_path,
-                               u64 total_vecs, u32 dim,
-                               u64 batch_vecs, u32 clk_mhz,
-                               int cxl_nid, u64 cxl_base);
+int run_l2_streaming_from_file(const struct l2_stream_cfg *cfg);
+
+/*
+ * Resident mode: load cfg->base_path into batch buffers on the CXL node(s) once
+ * (replacing any earlier resident set) and keep it until dropped. Runs with
+ * cfg->resident set then scan it without reading the base file; only the
+ * query and batch-independent fields of their cfg apply. With cfg->dax the
+ * batches are windows onto the namespace's DAX mapping and nothing is copied.
+ */
+int  l2_stream_load_resident(const struct l2_stream_cfg *cfg);
+void l2_stream_drop_resident(void);
+
+struct l2_resident_info {
+    u64 handle;         /* changes with every load; l2_search.handle must match */
+    u64 vectors;
+    struct l2_vec_layout lay;
+};
+
+int l2_stream_resident_info(struct l2_resident_info *info);
+
+/*
+ * Search the resident set for nq queries laid out back to back (lay.query_bytes
+ * apart) at query_va/query_pa, which must stay physically contiguous. On a
+ * PQ set the distances are the PQ estimates; nothing is re-ranked.
+ * Each tk[q] is reset, filled and sorted in place, so callers can point
+ * its entries at memory they hand on without copying.
+ */
+struct l2_search {
+    u64          handle;
+    void        *query_va;
+    phys_addr_t  query_pa;
+    u32          nq;
+    struct l2_topk *tk;
+
+    // Out
+    u64          cycles;
+    u64          wall_ns;
+};
+
+int l2_stream_search(struct l2_search *req);
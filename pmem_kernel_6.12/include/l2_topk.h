@@ -0,0 +1,55 @@
+#pragma once
+#include <linux/types.h>
+
+struct file;
+
+/*
+ * Bounded top-k of (vector id, distance) pairs.
+ *
+ * Kept as a max-heap on distance so the current worst candidate sits at e[0]
+ * and each batch's distances are merged in O(log k) per accepted vector.
+ * Equal distances keep the lower id. l2_topk_sort() turns the heap into
+ * ascending order for output; push again only after l2_topk_reset().
+ */
+struct l2_topk_ent {
+    u64 id;
+    u64 dist;
+};
+
+struct l2_topk {
+    u32 k;
+    u32 n;
+    struct l2_topk_ent *e;
+};
+
+/*
+ * Binary results file: one header, then per query a u32 query id, a u32
+ * count n (<= k) and n l2_topk_ent records sorted by ascending distance.
+ * All fields little-endian.
+ */
+#define L2_TOPK_MAGIC   0x4b54324cu     /* "L2TK" */
+#define L2_TOPK_VERSION 2              /* 2: u64 ids (1 had u32 id, u32 rsvd) */
+
+struct l2_topk_file_hdr {
+    u32 magic;
+    u32 version;
+    u32 k;
+    u32 num_queries;
+    u32 dim;
+    u32 rsvd;
+    u64 total_vecs;
+};
+
+int  l2_topk_init(struct l2_topk *t, u32 k);
+void l2_topk_free(struct l2_topk *t);
+void l2_topk_reset(struct l2_topk *t);
+
+void l2_topk_push(struct l2_topk *t, u64 id, u64 dist);
+/* Merge nvecs distances of one batch; ids are id_base + index in the batch */
+void l2_topk_merge(struct l2_topk *t, const u64 *dist, u64 nvecs, u64 id_base);
+/* Fold a partial top-k (e.g. one worker's) into t */
+void l2_topk_merge_heap(struct l2_topk *t, const struct l2_topk *part);
+void l2_topk_sort(struct l2_topk *t);
+
+int  l2_topk_write_hdr(struct file *f, loff_t *pos, const struct l2_topk_file_hdr *hdr);
+int  l2_topk_write(struct file *f, loff_t *pos, u32 qid, const struct l2_topk *t);
@@ -0,0 +1,130 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM l2
+
+#if !defined(_L2_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _L2_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * Streaming-path phases, in the order a batch goes through them:
+ *
+ *   l2_read      loader: base file -> batch buffer
+ *   l2_prep      loader: scatter-gather descriptors for the batch
+ *   l2_stall     engine side: waiting for the loader to fill the slot
+ *   l2_csr       engine: job registers programmed
+ *   l2_wait      engine: START to RESP done
+ *   l2_readback  engine: DELAY/RESP reads, verify, host distances, top-k
+ *   l2_batch     one batch end to end, with device cycles vs host time
+ *
+ * Enable with: echo 1 > /sys/kernel/tracing/events/l2/enable
+ */
+TRACE_EVENT(l2_read,
+    TP_PROTO(u64 pass, u64 bytes, u64 ns),
+    TP_ARGS(pass, bytes, ns),
+    TP_STRUCT__entry(
+        __field(u64, pass)
+        __field(u64, bytes)
+        __field(u64, ns)
+    ),
+    TP_fast_assign(
+        __entry->pass  = pass;
+        __entry->bytes = bytes;
+        __entry->ns    = ns;
+    ),
+    TP_printk("pass=%llu bytes=%llu ns=%llu", __entry->pass, __entry->bytes, __entry->ns)
+);
+
+TRACE_EVENT(l2_prep,
+    TP_PROTO(u64 pass, u32 chunks, u64 ns),
+    TP_ARGS(pass, chunks, ns),
+    TP_STRUCT__entry(
+        __field(u64, pass)
+        __field(u32, chunks)
+        __field(u64, ns)
+    ),
+    TP_fast_assign(
+        __entry->pass   = pass;
+        __entry->chunks = chunks;
+        __entry->ns     = ns;
+    ),
+    TP_printk("pass=%llu chunks=%u ns=%llu", __entry->pass, __entry->chunks, __entry->ns)
+);
+
+TRACE_EVENT(l2_stall,
+    TP_PROTO(u64 pass, u64 ns),
+    TP_ARGS(pass, ns),
+    TP_STRUCT__entry(
+        __field(u64, pass)
+        __field(u64, ns)
+    ),
+    TP_fast_assign(
+        __entry->pass = pass;
+        __entry->ns   = ns;
+    ),
+    TP_printk("pass=%llu ns=%llu", __entry->pass, __entry->ns)
+);
+
+DECLARE_EVENT_CLASS(l2_engine_phase,
+    TP_PROTO(u64 vecs, u32 nq, u64 ns),
+    TP_ARGS(vecs, nq, ns),
+    TP_STRUCT__entry(
+        __field(u64, vecs)
+        __field(u32, nq)
+        __field(u64, ns)
+    ),
+    TP_fast_assign(
+        __entry->vecs = vecs;
+        __entry->nq   = nq;
+        __entry->ns   = ns;
+    ),
+    TP_printk("vecs=%llu nq=%u ns=%llu", __entry->vecs, __entry->nq, __entry->ns)
+);
+
+DEFINE_EVENT(l2_engine_phase, l2_csr,
+    TP_PROTO(u64 vecs, u32 nq, u64 ns),
+    TP_ARGS(vecs, nq, ns)
+);
+
+DEFINE_EVENT(l2_engine_phase, l2_wait,
+    TP_PROTO(u64 vecs, u32 nq, u64 ns),
+    TP_ARGS(vecs, nq, ns)
+);
+
+DEFINE_EVENT(l2_engine_phase, l2_readback,
+    TP_PROTO(u64 vecs, u32 nq, u64 ns),
+    TP_ARGS(vecs, nq, ns)
+);
+
+TRACE_EVENT(l2_batch,
+    TP_PROTO(u64 pass, u64 vecs, u32 nq, u64 cycles, u64 dev_ns, u64 wall_ns),
+    TP_ARGS(pass, vecs, nq, cycles, dev_ns, wall_ns),
+    TP_STRUCT__entry(
+        __field(u64, pass)
+        __field(u64, vecs)
+        __field(u32, nq)
+        __field(u64, cycles)
+        __field(u64, dev_ns)
+        __field(u64, wall_ns)
+    ),
+    TP_fast_assign(
+        __entry->pass    = pass;
+        __entry->vecs    = vecs;
+        __entry->nq      = nq;
+        __entry->cycles  = cycles;
+        __entry->dev_ns  = dev_ns;
+        __entry->wall_ns = wall_ns;
+    ),
+    TP_printk("pass=%llu vecs=%llu nq=%u cycles=%llu dev_ns=%llu wall_ns=%llu",
+              __entry->pass, __entry->vecs, __entry->nq, __entry->cycles,
+              __entry->dev_ns, __entry->wall_ns)
+);
+
+#endif /* _L2_TRACE_H */
+
+// Out-of-tree: define_trace.h finds this file through -I$(src)/include
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE l2_trace
+#include <trace/define_trace.h>
@@ -1,17 +1,18 @@
 #ifndef NVME_H
 #define NVME_H
 
+// SSD BAR the FPGA rings NVMe doorbells in (cxl_dev nvme_bar default)
 //#define PCI_BAR_ADDRESS 0xfad10000
 //#define PCI_BAR_ADDRESS 0xfab10000
 #define PCI_BAR_ADDRESS 0x95100000
 #define PCI_BAR_SIZE 0x10000
 
-#define FPGA_BUS_ID 0x43
-#define FPGA_BAR_0_ADDRESS 0x20beffc00000
-#define FPGA_BAR_1_ADDRESS 0x20beffa00000
+// Boards are bound by PCI ID; BARs and bus numbers come from the PCI core
+#define FPGA_PCI_VENDOR_ID 0x8086
+#define FPGA_PCI_DEVICE_ID 0x0ddb
 
-// #define FPGA_BUS_ID 0xab
-// #define FPGA_BAR_0_ADDRESS 0x227effc00000
-// #define FPGA_BAR_1_ADDRESS 0x227effa00000
+// 64-bit BARs: BAR_1 (CSRs) and BAR_0 (pattern window) as PCI BAR indices
+#define FPGA_CSR_BAR 2
+#define FPGA_WIN_BAR 0
 
 #endif // NVME_H
\ No newline at end of file
@@ -1,4 +1,6 @@
 #!/usr/bin/env python3
+# Reference converter, one vector at a time. For large sets (SIFT1B, Deep1B)
+# and .bvecs/.ivecs input use tools/vecconv, which writes the same .meta.
 import os
 import struct
 from pathlib import Path
@@ -13,13 +15,18 @@ import numpy as np
 BASE_FVECS = "/fast-lab-share/benchmarks/VectorDB/ANN/sift1m/base.fvecs"
 QUERY_FVECS = "/fast-lab-share/benchmarks/VectorDB/ANN/sift1m/query.fvecs"
 
-# Output .bin paths (FIXED-POINT int32, Q16.16)
+# Output .bin paths (element type below; Q16.16 is the FPGA's native format)
 BASE_BIN_OUT = "/home/lifan3/cxl_dist_cal/data/base.bin"
 QUERY_BIN_OUT = "/home/lifan3/cxl_dist_cal/data/query.bin"
 
-# Expected vector dimension for SIFT1M
+# Expected vector dimension (SIFT1M: 128, GIST1M: 960, Deep1B: 96)
 EXPECTED_DIM = 128
 
+# Element type: "q16" (int32 Q16.16), "int8" (round(x * INT8_SCALE), clipped)
+# or "fp16" (IEEE half). Narrower types fit more vectors per CXL batch.
+ELEM_TYPE = "q16"
+INT8_SCALE = 0.5        # SIFT components are 0..255 -> 0..127
+
 LIMIT_BASE = None   # e.g., 10000 converts only 10k base vectors
 LIMIT_QUERY = None
 
@@ -67,14 +74,23 @@ def convert_fvecs_to_fixed_bin(in_path, out_path, expected_dim, limit=None):
             if CLIP_ABS is not None:
                 floats = np.clip(floats, -CLIP_ABS, CLIP_ABS)
 
-            # Convert to fixed-point Q16.16 (int32)
-            fixed = np.round(floats * FIXED_SCALE).astype("<i4")  # little-endian int32
+            # Convert to the output element type
+            if ELEM_TYPE == "int8":
+                fixed = np.clip(np.round(floats * INT8_SCALE), -128, 127).astype("i1")
+            elif ELEM_TYPE == "fp16":
+                fixed = floats.astype("<f2")
+            else:
+                fixed = np.round(floats * FIXED_SCALE).astype("<i4")  # Q16.16
 
-            # Track dynamic range
+            # Track dynamic range: an integer for q16/int8, a float only for fp16
             if fixed.size > 0:
-                max_abs_fixed = max(max_abs_fixed, int(np.max(np.abs(fixed))))
+                if ELEM_TYPE == "fp16":
+                    peak = float(np.max(np.abs(fixed.astype("f8"))))
+                else:
+                    peak = int(np.max(np.abs(fixed.astype("i8"))))  # i8: |-128| fits
+                max_abs_fixed = max(max_abs_fixed, peak)
 
-            # Write as raw int32; still dim * 4 bytes per vector
+            # Write raw elements; dim * elem_bytes per vector
             out_bytes = fixed.tobytes()
             f_out.write(out_bytes)
 
@@ -95,9 +111,15 @@ def convert_fvecs_to_fixed_bin(in_path, out_path, expected_dim, limit=None):
         meta.write(f"dimension={expected_dim}\n")
         meta.write(f"bytes={total_bytes}\n")
         meta.write(f"size_MB={total_bytes / (1024**2):.2f}\n")
-        meta.write(f"fixed_scale={FIXED_SCALE}\n")
-        meta.write("fixed_format=Q16.16 (signed int32)\n")
-        meta.write(f"max_abs_fixed={max_abs_fixed}\n")
+        if ELEM_TYPE == "int8":
+            meta.write(f"fixed_scale={INT8_SCALE}\n")
+            meta.write("fixed_format=int8 (signed int8)\n")
+        elif ELEM_TYPE == "fp16":
+            meta.write("fixed_format=fp16 (IEEE half)\n")
+        else:
+            meta.write(f"fixed_scale={FIXED_SCALE}\n")
+            meta.write("fixed_format=Q16.16 (signed int32)\n")
+        meta.write(f"max_abs_fixed={max_abs_fixed!r}\n")  # int, or a round-trip exact float
         if CLIP_ABS is not None:
             meta.write(f"clip_abs={CLIP_ABS}\n")
 
@@ -110,10 +132,10 @@ def convert_fvecs_to_fixed_bin(in_path, out_path, expected_dim, limit=None):
 
 
 def main():
-    print("Converting base.fvecs → base.bin (fixed-point Q16.16) ...")
+    print(f"Converting base.fvecs → base.bin ({ELEM_TYPE}) ...")
     convert_fvecs_to_fixed_bin(BASE_FVECS, BASE_BIN_OUT, EXPECTED_DIM, LIMIT_BASE)
 
-    print("\nConverting query.fvecs → query.bin (fixed-point Q16.16) ...")
+    print(f"\nConverting query.fvecs → query.bin ({ELEM_TYPE}) ...")
     convert_fvecs_to_fixed_bin(QUERY_FVECS, QUERY_BIN_OUT, EXPECTED_DIM, LIMIT_QUERY)
 
 
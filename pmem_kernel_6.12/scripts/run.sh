@@ -8,6 +8,7 @@ CXL_SET="${CXL_SET:-5}"
 TIMEOUT_SEC="${TIMEOUT_SEC:-120}"     # adjust if 1M vectors take longer
 LOG_DIR="${LOG_DIR:-./out}"
 LOG_FILE="${LOG_FILE:-${LOG_DIR}/last_run.log}"
+DEBUGFS="${DEBUGFS:-/sys/kernel/debug}"
 
 usage() {
   cat <<EOF
@@ -15,6 +16,11 @@ Usage: $0 [--ko PATH] [--cxl_set N] [--timeout SEC] [--logdir DIR]
 
 Env overrides:
   MOD=./nvme_test.ko  CXL_SET=5  TIMEOUT_SEC=120  LOG_DIR=./out
+  DEBUGFS=/sys/kernel/debug
+
+Results are read from \${DEBUGFS}/l2_engine/ and copied to LOG_DIR:
+  last_run.json      run state and totals
+  last_batches.csv   per-batch series
 
 Examples:
   sudo $0
@@ -45,6 +51,11 @@ mkdir -p "$LOG_DIR"
 
 MOD_NAME="nvme_test"
 START_EPOCH="$(date +%s)"
+STATS_DIR="${DEBUGFS}/l2_engine"
+
+if ! mountpoint -q "$DEBUGFS"; then
+  mount -t debugfs none "$DEBUGFS"
+fi
 
 # Clean previous instance
 if lsmod | awk '{print $1}' | grep -q "^${MOD_NAME}$"; then
@@ -73,28 +84,42 @@ trap cleanup EXIT INT TERM
 echo "[run] Inserting ${MOD} (cxl_set=${CXL_SET})..."
 insmod "$MOD" "cxl_set=${CXL_SET}"
 
-# Wait for success/failure or timeout
-echo "[run] Waiting up to ${TIMEOUT_SEC}s for result markers..."
-SUCCESS_PAT='L2 stream result:|Wrote L2 results to'
-FAIL_PAT='failed rc=|timeout|Failed to write|error|ERROR|Failed to open'
-
+# cxl_set runs happen inside insmod; poll the state file in case one is still going
+echo "[run] Waiting up to ${TIMEOUT_SEC}s for ${STATS_DIR}/state..."
+STATE=""
 deadline=$((SECONDS + TIMEOUT_SEC))
 while (( SECONDS < deadline )); do
-  if grep -E -q "${SUCCESS_PAT}" "$LOG_FILE"; then
-    echo "[run] Success marker detected."
-    break
-  fi
-  if grep -E -iq "${FAIL_PAT}" "$LOG_FILE"; then
-    echo "[run] Failure marker detected (see ${LOG_FILE})."
-    break
-  fi
+  STATE="$(cat "${STATS_DIR}/state" 2>/dev/null || true)"
+  [[ "$STATE" == "running" ]] || break
   sleep 1
 done
 
-if (( SECONDS >= deadline )); then
-  echo "[run] Timeout after ${TIMEOUT_SEC}s (see ${LOG_FILE})."
+RC=0
+case "$STATE" in
+  done)
+    echo "[run] Run finished.";;
+  failed)
+    echo "[run] Run failed (see ${LOG_FILE})."; RC=1;;
+  idle)
+    # cxl_set 4-6 always record a run: idle means it never started
+    if [[ "$CXL_SET" =~ ^[456]$ ]]; then
+      echo "[run] No run recorded for cxl_set=${CXL_SET} (see ${LOG_FILE})."; RC=1
+    else
+      echo "[run] No streaming run recorded for cxl_set=${CXL_SET}."
+    fi;;
+  running)
+    echo "[run] Timeout after ${TIMEOUT_SEC}s (see ${LOG_FILE})."; RC=1;;
+  *)
+    echo "[run] ${STATS_DIR}/state not readable." >&2; RC=1;;
+esac
+
+if [[ -r "${STATS_DIR}/run.json" ]]; then
+  cat "${STATS_DIR}/run.json" > "${LOG_DIR}/last_run.json"
+  cat "${STATS_DIR}/batches.csv" > "${LOG_DIR}/last_batches.csv"
+  echo "[run] Results: ${LOG_DIR}/last_run.json ${LOG_DIR}/last_batches.csv"
 fi
 
 # Module is auto-removed by trap; give it a moment to flush logs
 sleep 1
 echo "[run] Done. Log: ${LOG_FILE}"
+exit "$RC"
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+"""Parameter sweep for the L2 streaming benchmark (cxl_set=5).
+
+Every point of the cross product of the lists below is run --repeat times,
+one insmod/rmmod per run, and the run's totals are read back from
+debugfs (l2_engine/run.json). Two CSVs are written:
+
+  <out>/sweep_runs.csv  one row per run
+  <out>/sweep.csv       one row per point: mean/p50/p99 of GB/s and
+                        cycles per vector over the repeats
+
+The default backends (sw, cpu) need no FPGA. Dimension and element type
+come from each dataset's .meta sidecar, so they are swept by passing one
+--dataset per converted file (see fvecs_to_bin.py).
+
+Example:
+  sudo ./sweep.py --ko ../nvme_test.ko \\
+      --dataset q16=/data/base_q16.bin,/data/query_q16.bin \\
+      --dataset int8=/data/base_i8.bin,/data/query_i8.bin \\
+      --batch-vecs 4096,16384,65536 --nid 0,1 --depth 1,2 --repeat 5
+"""
+import argparse
+import csv
+import itertools
+import json
+import os
+import statistics
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+MOD_NAME = "nvme_test"
+
+# Per-run columns copied from run.json
+RUN_KEYS = [
+    "engine", "engines", "elem", "dim", "vec_bytes", "batch_vecs", "depth", "nodes", "vecs",
+    "bytes", "cycles_total", "cycles_per_vec", "dev_ns", "wall_ns",
+    "io_stall_ns", "gbps_dev", "gbps_wall", "mismatches",
+]
+
+# Summarised over the repeats of a point
+STAT_KEYS = ["gbps_wall", "gbps_dev", "cycles_per_vec"]
+
+
+def int_list(s):
+    return [int(x) for x in s.split(",") if x]
+
+
+def str_list(s):
+    return [x for x in s.split(",") if x]
+
+
+def parse_dataset(s):
+    name, _, paths = s.partition("=")
+    base, _, query = paths.partition(",")
+    if not name or not base:
+        raise argparse.ArgumentTypeError(f"expected NAME=BASE[,QUERY], got {s!r}")
+    return name, base, query or None
+
+
+def percentile(xs, p):
+    """Nearest-rank percentile; with few repeats p99 is simply the max."""
+    xs = sorted(xs)
+    k = max(0, min(len(xs) - 1, -(-len(xs) * p // 100) - 1))
+    return xs[int(k)]
+
+
+def module_loaded():
+    out = subprocess.run(["lsmod"], capture_output=True, text=True).stdout
+    return any(line.split()[0] == MOD_NAME for line in out.splitlines()[1:] if line)
+
+
+def run_point(args, params):
+    """insmod with params, read run.json, rmmod. Returns the parsed totals."""
+    if module_loaded():
+        subprocess.run(["rmmod", MOD_NAME], check=False)
+
+    argv = ["insmod", args.ko, "cxl_set=5"] + [f"{k}={v}" for k, v in params.items()]
+    t0 = time.monotonic()
+    subprocess.run(argv, check=True, timeout=args.timeout)
+    try:
+        # The run happens inside insmod, but a slow one may still be finishing
+        state_path = Path(args.debugfs, "l2_engine", "state")
+        while state_path.read_text().strip() == "running":
+            if time.monotonic() - t0 > args.timeout:
+                raise TimeoutError(f"run still going after {args.timeout}s")
+            time.sleep(0.2)
+        return json.loads(Path(args.debugfs, "l2_engine", "run.json").read_text())
+    finally:
+        subprocess.run(["rmmod", MOD_NAME], check=False)
+
+
+def main():
+    ap = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--ko", default="./nvme_test.ko", help="module to load")
+    ap.add_argument("--dataset", action="append", type=parse_dataset, required=True,
+                    metavar="NAME=BASE[,QUERY]", help="base (and query) file; repeatable")
+    ap.add_argument("--engine", type=str_list, default=["sw", "cpu"],
+                    help="backends: fpga,sw,cpu (default: sw,cpu)")
+    ap.add_argument("--batch-vecs", type=int_list, default=[0],
+                    help="batch_vecs values (0 = fill batch_kb)")
+    ap.add_argument("--nid", type=int_list, default=[1],
+                    help="cxl_nid values, e.g. 0,1 for DRAM vs CXL node; "
+                         "interleave with --param cxl_nodes=1@BASE,2@BASE")
+    ap.add_argument("--depth", type=int_list, default=[2], help="pipeline_depth values")
+    ap.add_argument("--clk", type=int_list, default=[400], help="axi_clk_mhz values")
+    ap.add_argument("--repeat", type=int, default=3, help="runs per point")
+    ap.add_argument("--param", action="append", default=[], metavar="KEY=VALUE",
+                    help="extra module parameter passed to every run; repeatable")
+    ap.add_argument("--timeout", type=int, default=600, help="seconds per run")
+    ap.add_argument("--debugfs", default="/sys/kernel/debug")
+    ap.add_argument("--out", default="./out", help="CSV output directory")
+    args = ap.parse_args()
+
+    if os.geteuid() != 0:
+        sys.exit("Please run as root (sudo).")
+    if not Path(args.ko).is_file():
+        sys.exit(f"Module not found: {args.ko}")
+    if not os.path.ismount(args.debugfs):
+        subprocess.run(["mount", "-t", "debugfs", "none", args.debugfs], check=True)
+
+    extra = dict(p.split("=", 1) for p in args.param)
+    axes = ["dataset", "engine", "batch_vecs", "cxl_nid", "pipeline_depth", "axi_clk_mhz"]
+    points = list(itertools.product(args.dataset, args.engine, args.batch_vecs,
+                                    args.nid, args.depth, args.clk))
+
+    os.makedirs(args.out, exist_ok=True)
+    runs_path = Path(args.out, "sweep_runs.csv")
+    sum_path = Path(args.out, "sweep.csv")
+
+    with open(runs_path, "w", newline="") as f_runs, open(sum_path, "w", newline="") as f_sum:
+        runs = csv.writer(f_runs)
+        summ = csv.writer(f_sum)
+        runs.writerow(axes + ["repeat", "rc"] + RUN_KEYS)
+        summ.writerow(axes + ["runs", "failed"] +
+                      [f"{k}_{s}" for k in STAT_KEYS for s in ("mean", "p50", "p99")])
+
+        for i, (ds, engine, bv, nid, depth, clk) in enumerate(points, 1):
+            name, base, query = ds
+            params = dict(extra, engine=engine, batch_vecs=bv, cxl_nid=nid,
+                          pipeline_depth=depth, axi_clk_mhz=clk, base_path=base)
+            if query:
+                params["query_path"] = query
+            label = [name, engine, bv, nid, depth, clk]
+            print(f"[sweep] {i}/{len(points)} " +
+                  " ".join(f"{a}={v}" for a, v in zip(axes, label)), flush=True)
+
+            ok = []
+            failed = 0
+            for r in range(args.repeat):
+                try:
+                    res = run_point(args, params)
+                    rc = 0 if res.get("state") == "done" else (res.get("rc") or -1)
+                except (subprocess.SubprocessError, OSError, ValueError, TimeoutError) as e:
+                    print(f"[sweep]   repeat {r}: {e}", file=sys.stderr)
+                    res, rc = {}, -1
+                if rc == 0:
+                    ok.append(res)
+                else:
+                    failed += 1
+                runs.writerow(label + [r, rc] + [res.get(k, "") for k in RUN_KEYS])
+                f_runs.flush()
+
+            row = label + [len(ok), failed]
+            for k in STAT_KEYS:
+                xs = [float(res[k]) for res in ok if k in res]
+                row += ([f"{statistics.mean(xs):.3f}", f"{percentile(xs, 50):.3f}",
+                         f"{percentile(xs, 99):.3f}"] if xs else ["", "", ""])
+            summ.writerow(row)
+            f_sum.flush()
+
+    print(f"[sweep] Done. Per-run: {runs_path}  Summary: {sum_path}")
+
+
+if __name__ == "__main__":
+    main()
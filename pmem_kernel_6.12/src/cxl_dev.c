@@ -0,0 +1,179 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/io.h>
+#include <linux/pci.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "cxl_dev.h"
+#include "nvme.h"
+
+static struct cxl_dev cxl_devs[CXL_MAX_DEVS];
+static u32 cxl_ndevs;
+static struct cxl_dev_cfg cxl_cfg;
+static void __iomem *cxl_nvme;
+static bool cxl_dev_ready;
+
+// IDs are module parameters: filled in by cxl_dev_init(), so no MODULE_DEVICE_TABLE
+static struct pci_device_id cxl_dev_ids[] = {
+    { PCI_DEVICE(FPGA_PCI_VENDOR_ID, FPGA_PCI_DEVICE_ID) },
+    { 0, }
+};
+
+static int cxl_dev_probe(struct pci_dev *pdev, const struct pci_device_id *id)
+{
+    struct cxl_dev *d;
+    int rc;
+
+    if (cxl_ndevs == CXL_MAX_DEVS) {
+        dev_warn(&pdev->dev, "cxl_dev: more than %u boards, not binding\n", CXL_MAX_DEVS);
+        return -ENOSPC;
+    }
+    d = &cxl_devs[cxl_ndevs];
+
+    rc = pci_enable_device_mem(pdev);
+    if (rc)
+        return rc;
+    rc = pci_request_region(pdev, cxl_cfg.csr_bar, "cxl_dev");
+    if (rc)
+        goto err_disable;
+    rc = pci_request_region(pdev, cxl_cfg.win_bar, "cxl_dev");
+    if (rc)
+        goto err_csr;
+
+    d->csr  = pci_iomap(pdev, cxl_cfg.csr_bar, CXL_CSR_SIZE);
+    d->bar0 = pci_iomap(pdev, cxl_cfg.win_bar, PCI_BAR_SIZE);
+    if (!d->csr || !d->bar0) {
+        dev_err(&pdev->dev, "cxl_dev: failed to map BAR%d/BAR%d\n",
+                cxl_cfg.csr_bar, cxl_cfg.win_bar);
+        rc = -ENOMEM;
+        goto err_unmap;
+    }
+    pci_set_master(pdev);
+
+    d->pdev    = pdev;
+    d->index   = cxl_ndevs;
+    d->bus     = pdev->bus->number;
+    d->csr_pa  = pci_resource_start(pdev, cxl_cfg.csr_bar);
+    d->bar0_pa = pci_resource_start(pdev, cxl_cfg.win_bar);
+    d->nvme_pa = cxl_cfg.nvme_pa;
+    d->nvme    = cxl_nvme;
+    pci_set_drvdata(pdev, d);
+    cxl_ndevs++;
+
+    dev_info(&pdev->dev, "cxl_dev %u: BAR_1=0x%llx BAR_0=0x%llx requester=0x%02x\n",
+             d->index, (unsigned long long)d->csr_pa, (unsigned long long)d->bar0_pa, d->bus);
+    return 0;
+
+err_unmap:
+    if (d->bar0)
+        pci_iounmap(pdev, d->bar0);
+    if (d->csr)
+        pci_iounmap(pdev, d->csr);
+    memset(d, 0, sizeof(*d));
+    pci_release_region(pdev, cxl_cfg.win_bar);
+err_csr:
+    pci_release_region(pdev, cxl_cfg.csr_bar);
+err_disable:
+    pci_disable_device(pdev);
+    return rc;
+}
+
+static void cxl_dev_remove(struct pci_dev *pdev)
+{
+    struct cxl_dev *d = pci_get_drvdata(pdev);
+
+    pci_clear_master(pdev);
+    pci_iounmap(pdev, d->bar0);
+    pci_iounmap(pdev, d->csr);
+    pci_release_region(pdev, cxl_cfg.win_bar);
+    pci_release_region(pdev, cxl_cfg.csr_bar);
+    pci_disable_device(pdev);
+    memset(d, 0, sizeof(*d));
+}
+
+static struct pci_driver cxl_dev_driver = {
+    .name     = "cxl_l2",
+    .id_table = cxl_dev_ids,
+    .probe    = cxl_dev_probe,
+    .remove   = cxl_dev_remove,
+    // Engines hold on to their board until module exit: no manual unbind
+    .driver.suppress_bind_attrs = true,
+};
+
+int cxl_dev_init(const struct cxl_dev_cfg *cfg)
+{
+    int rc;
+
+    if (cxl_dev_ready)
+        return 0;
+    if (cfg->csr_bar < 0 || cfg->csr_bar >= PCI_STD_NUM_BARS ||
+        cfg->win_bar < 0 || cfg->win_bar >= PCI_STD_NUM_BARS || cfg->csr_bar == cfg->win_bar) {
+        pr_err("cxl_dev: bad BAR indices csr=%d window=%d\n", cfg->csr_bar, cfg->win_bar);
+        return -EINVAL;
+    }
+    cxl_cfg = *cfg;
+    cxl_dev_ids[0].vendor = cfg->vendor;
+    cxl_dev_ids[0].device = cfg->device;
+
+    // The SSD is not ours to probe; every board shares one mapping of its BAR
+    if (cfg->nvme_pa) {
+        cxl_nvme = ioremap_uc(cfg->nvme_pa, CXL_NVME_BAR_SIZE);
+        if (!cxl_nvme) {
+            pr_err("cxl_dev: failed to map NVMe BAR 0x%llx\n", (unsigned long long)cfg->nvme_pa);
+            return -ENOMEM;
+        }
+    }
+
+    rc = pci_register_driver(&cxl_dev_driver);
+    if (rc)
+        goto err_nvme;
+    if (!cxl_ndevs) {
+        pr_err("cxl_dev: no FPGA %04x:%04x found\n", cfg->vendor, cfg->device);
+        pci_unregister_driver(&cxl_dev_driver);
+        rc = -ENODEV;
+        goto err_nvme;
+    }
+
+    cxl_dev_ready = true;
+    pr_info("cxl_dev: %u board(s) bound, NVMe=0x%llx\n", cxl_ndevs,
+            (unsigned long long)cfg->nvme_pa);
+    return 0;
+
+err_nvme:
+    if (cxl_nvme)
+        iounmap(cxl_nvme);
+    cxl_nvme = NULL;
+    return rc;
+}
+
+void cxl_dev_exit(void)
+{
+    if (!cxl_dev_ready)
+        return;
+
+    pci_unregister_driver(&cxl_dev_driver);
+    if (cxl_nvme)
+        iounmap(cxl_nvme);
+    cxl_nvme  = NULL;
+    cxl_ndevs = 0;
+    cxl_dev_ready = false;
+}
+
+u32 cxl_dev_count(void)
+{
+    return cxl_dev_ready ? cxl_ndevs : 0;
+}
+EXPORT_SYMBOL(cxl_dev_count);
+
+struct cxl_dev *cxl_dev_get_nth(u32 i)
+{
+    return i < cxl_dev_count() && cxl_devs[i].pdev ? &cxl_devs[i] : NULL;
+}
+EXPORT_SYMBOL(cxl_dev_get_nth);
+
+struct cxl_dev *cxl_dev_get(void)
+{
+    return cxl_dev_get_nth(0);
+}
+EXPORT_SYMBOL(cxl_dev_get);
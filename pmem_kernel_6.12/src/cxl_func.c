@@ -20,6 +20,8 @@
 #include <linux/string.h>
 
 #include "cxl_func.h"
+#include "cxl_dev.h"
+#include "l2_engine.h"
 #include "nvme.h"
 
 void alloc_and_get_phys(struct page **out_page, phys_addr_t *out_phys)
@@ -39,10 +41,12 @@ void alloc_and_get_phys(struct page **out_page, phys_addr_t *out_phys)
     *out_phys = virt_to_phys(addr);
 }
 
+/* Cached BAR_1 mapping owned by the device context (NULL if not mapped) */
 void *get_virt_addr(void)
 {
-    void *virt_addr = ioremap(FPGA_BAR_1_ADDRESS, 0x1000);
-    return (unsigned long long *)virt_addr;
+    struct cxl_dev *d = cxl_dev_get();
+
+    return d ? (void __force *)d->csr : NULL;
 }
 
 static long write_text_to_file(const char *path, const char *buf, size_t len)
@@ -93,30 +97,30 @@ long read_file_into_buffer(const char *path, void *buffer, size_t buffer_size)
 
 void check_db(void __iomem *mapped_base_nvme, unsigned long long *sq_tail)
 {
-    void *target_address;
-    void *acq_address;
+    struct cxl_dev *d = cxl_dev_get();
     unsigned int value;
     int i;
 
-    mapped_base_nvme = ioremap_uc(PCI_BAR_ADDRESS, 16 * 1024);
-    if (!mapped_base_nvme) {
-        pr_err("Failed to map PCI BAR memory region.\n");
+    if (!d) {
+        pr_err("check_db: device context not initialised\n");
         return;
     }
-
-    acq_address = (void *)mapped_base_nvme + 0x28;
-    target_address = (void *)mapped_base_nvme + 4096;
+    if (!d->nvme) {
+        pr_err("check_db: no NVMe BAR mapped (nvme_bar=0)\n");
+        return;
+    }
+    mapped_base_nvme = d->nvme;
 
     for (i = 0; i < 2; i++) {
-        value = ioread32(acq_address + 4 * i);
+        value = ioread32(mapped_base_nvme + NVME_REG_ACQ + 4 * i);
         pr_info("Read acq value %d: 0x%x\n", i, value);
     }
 
     for (i = 1; i < 17; i++) {
-        value = ioread32(target_address + 8 * i);
+        value = ioread32(mapped_base_nvme + NVME_REG_DOORBELL(i));
         pr_info("Read value %d: 0x%x\n", i, value);
         sq_tail[i - 1] = (unsigned long long)value;
-        value = ioread32(target_address + 8 * i + 4);
+        value = ioread32(mapped_base_nvme + NVME_REG_DOORBELL(i) + 4);
         pr_info("Read value: 0x%x\n", value);
     }
 }
@@ -149,70 +153,60 @@ void set_cxl(unsigned long long *cq_addresses, unsigned long long *sq_addresses,
              unsigned long long *buffer_addresses, unsigned long long *sq_tail,
              unsigned long long block_offset)
 {
-    unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_requester_id = cxl_func_type + 3;
-    volatile unsigned long long *cxl_block_index  = cxl_func_type + 4;
-    volatile unsigned long long *cxl_sq_addr      = cxl_func_type + 26;
-    volatile unsigned long long *cxl_cq_addr      = cxl_func_type + 27;
-    volatile unsigned long long *cxl_bar_addr     = cxl_func_type + 28;
-    volatile unsigned long long *cxl_sq_tail      = cxl_func_type + 29;
-    volatile unsigned long long *cxl_cq_head      = cxl_func_type + 30;
-    volatile unsigned long long *cxl_csr_init     = cxl_func_type + 32;
-    volatile unsigned long long *cxl_host_buffer  = cxl_func_type + 33;
-    volatile unsigned long long *cxl_queue_index  = cxl_func_type + 34;
-    volatile unsigned long long *cxl_m5_interval  = cxl_func_type + 35;
-    volatile unsigned long long *cxl_m5_query_en  = cxl_func_type + 36;
+    struct cxl_dev *d = cxl_dev_get();
     int i;
 
+    if (!d) {
+        pr_err("set_cxl: device context not initialised\n");
+        return;
+    }
+
     for (i = 0; i < 16; i++) {
-        *cxl_queue_index = i;
-        *cxl_sq_addr     = sq_addresses[i];
-        *cxl_cq_addr     = cq_addresses[i];
-        *cxl_cq_head     = sq_tail[i];
-        *cxl_sq_tail     = sq_tail[i];
-        *cxl_host_buffer = buffer_addresses[i];
+        cxl_wr(d, CXL_REG_QUEUE_INDEX, i);
+        cxl_wr(d, CXL_REG_SQ_ADDR,     sq_addresses[i]);
+        cxl_wr(d, CXL_REG_CQ_ADDR,     cq_addresses[i]);
+        cxl_wr(d, CXL_REG_CQ_HEAD,     sq_tail[i]);
+        cxl_wr(d, CXL_REG_SQ_TAIL,     sq_tail[i]);
+        cxl_wr(d, CXL_REG_HOST_BUFFER, buffer_addresses[i]);
 
         pr_info("qidx=0x%llx sq=0x%llx cq=0x%llx tail=0x%llx head=0x%llx buf=0x%llx\n",
-                *cxl_queue_index, *cxl_sq_addr, *cxl_cq_addr, *cxl_sq_tail, *cxl_cq_head, *cxl_host_buffer);
+                cxl_rd(d, CXL_REG_QUEUE_INDEX), cxl_rd(d, CXL_REG_SQ_ADDR),
+                cxl_rd(d, CXL_REG_CQ_ADDR), cxl_rd(d, CXL_REG_SQ_TAIL),
+                cxl_rd(d, CXL_REG_CQ_HEAD), cxl_rd(d, CXL_REG_HOST_BUFFER));
     }
 
-    *cxl_m5_query_en = 0;
-    *cxl_bar_addr    = PCI_BAR_ADDRESS;
-    *cxl_requester_id = FPGA_BUS_ID;
-    *cxl_block_index  = block_offset * 256ull * 1024ull * 1024ull;
-    *cxl_m5_interval  = 0;
+    cxl_wr(d, CXL_REG_M5_QUERY_EN,  0);
+    cxl_wr(d, CXL_REG_BAR_ADDR,     d->nvme_pa);
+    cxl_wr(d, CXL_REG_REQUESTER_ID, d->bus);
+    cxl_wr(d, CXL_REG_BLOCK_INDEX,  block_offset * 256ull * 1024ull * 1024ull);
+    cxl_wr(d, CXL_REG_M5_INTERVAL,  0);
 
-    *cxl_func_type = 3;
-    *cxl_csr_init  = 1;
+    cxl_wr(d, CXL_REG_FUNC_TYPE, 3);
+    cxl_wr(d, CXL_REG_CSR_INIT,  1);
 }
 
 void set_delay(unsigned long long delay_cnt)
 {
-    unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_delay_cnt = cxl_func_type + 35;
-    *cxl_delay_cnt = delay_cnt;
+    struct cxl_dev *d = cxl_dev_get();
+
+    if (d)
+        cxl_wr(d, CXL_REG_DELAY_CNT, delay_cnt);
 }
 
 void read_m5(void)
 {
-    unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_m5_rst        = cxl_func_type + 35;
-    volatile unsigned long long *cxl_m5_query_en   = cxl_func_type + 36;
-    volatile unsigned long long *cxl_m5_hot_page_0 = cxl_func_type + 40;
-    volatile unsigned long long *cxl_m5_hot_page_1 = cxl_func_type + 41;
-    volatile unsigned long long *cxl_m5_hot_page_2 = cxl_func_type + 42;
-    volatile unsigned long long *cxl_m5_hot_page_3 = cxl_func_type + 43;
-    volatile unsigned long long *cxl_m5_hot_page_4 = cxl_func_type + 44;
-
-    *cxl_m5_query_en = 1;
+    struct cxl_dev *d = cxl_dev_get();
+    int i;
+
+    if (!d)
+        return;
+
+    cxl_wr(d, CXL_REG_M5_QUERY_EN, 1);
     usleep_range(500, 600);
-    pr_info("m5_hot_page_0: 0x%llx\n", *cxl_m5_hot_page_0);
-    pr_info("m5_hot_page_1: 0x%llx\n", *cxl_m5_hot_page_1);
-    pr_info("m5_hot_page_2: 0x%llx\n", *cxl_m5_hot_page_2);
-    pr_info("m5_hot_page_3: 0x%llx\n", *cxl_m5_hot_page_3);
-    pr_info("m5_hot_page_4: 0x%llx\n", *cxl_m5_hot_page_4);
+    for (i = 0; i < 5; i++)
+        pr_info("m5_hot_page_%d: 0x%llx\n", i, cxl_rd(d, CXL_REG_M5_HOT_PAGE(i)));
     usleep_range(500, 600);
-    *cxl_m5_rst = 1;
+    cxl_wr(d, CXL_REG_M5_RST, 1);
 }
 
 void test_multiple_write(uint64_t *ptr, int iter, int test_case)
@@ -261,38 +255,31 @@ void test_multiple_read(uint64_t *ptr, int iter, int test_case)
 
 int launch_cxl_cache_write(unsigned long long page_address, unsigned long long buffer_address, unsigned long long iter)
 {
-    volatile unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_page_addr_0 = cxl_func_type + 1;
-    volatile unsigned long long *cxl_test_case   = cxl_func_type + 2;
-    volatile unsigned long long *cxl_write_data_0 = cxl_func_type + 14;
-    volatile unsigned long long *cxl_write_data_1 = cxl_func_type + 15;
-    volatile unsigned long long *cxl_write_data_2 = cxl_func_type + 16;
-    volatile unsigned long long *cxl_write_data_3 = cxl_func_type + 17;
-    volatile unsigned long long *cxl_write_data_4 = cxl_func_type + 18;
-    volatile unsigned long long *cxl_write_data_5 = cxl_func_type + 19;
-    volatile unsigned long long *cxl_write_data_6 = cxl_func_type + 20;
-    volatile unsigned long long *cxl_write_data_7 = cxl_func_type + 21;
-
-    if (iter == 0) *cxl_write_data_0 = 0x0000000110050002;
-    else          *cxl_write_data_0 = 0x0000000110050001;
-
-    *cxl_write_data_1 = 0x0;
-    *cxl_write_data_2 = 0x0;
-    *cxl_write_data_3 = 0x78787;
-    *cxl_write_data_4 = 0x0;
-    *cxl_write_data_5 = 0x4008;
-    *cxl_write_data_6 = 0x0;
-    *cxl_write_data_7 = 0x0;
+    struct cxl_dev *d = cxl_dev_get();
+
+    if (!d)
+        return -ENODEV;
+
+    if (iter == 0) cxl_wr(d, CXL_REG_WRITE_DATA(0), 0x0000000110050002);
+    else           cxl_wr(d, CXL_REG_WRITE_DATA(0), 0x0000000110050001);
+
+    cxl_wr(d, CXL_REG_WRITE_DATA(1), 0x0);
+    cxl_wr(d, CXL_REG_WRITE_DATA(2), 0x0);
+    cxl_wr(d, CXL_REG_WRITE_DATA(3), 0x78787);
+    cxl_wr(d, CXL_REG_WRITE_DATA(4), 0x0);
+    cxl_wr(d, CXL_REG_WRITE_DATA(5), 0x4008);
+    cxl_wr(d, CXL_REG_WRITE_DATA(6), 0x0);
+    cxl_wr(d, CXL_REG_WRITE_DATA(7), 0x0);
     asm volatile("mfence");
 
-    *cxl_test_case  = 13;
-    *cxl_page_addr_0 = 0x4080000000ull;
+    cxl_wr(d, CXL_REG_TEST_CASE,  13);
+    cxl_wr(d, CXL_REG_PAGE_ADDR0, 0x4080000000ull);
     asm volatile("mfence");
 
-    *cxl_func_type = 1;
+    cxl_wr(d, CXL_REG_FUNC_TYPE, 1);
     asm volatile("mfence");
     usleep_range(500, 600);
-    *cxl_func_type = 2;
+    cxl_wr(d, CXL_REG_FUNC_TYPE, 2);
     asm volatile("mfence");
     usleep_range(500, 600);
     return 0;
@@ -300,57 +287,41 @@ int launch_cxl_cache_write(unsigned long long page_address, unsigned long long b
 
 int launch_cxl_cache_read(unsigned long long page_address)
 {
-    volatile unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_page_addr_0 = cxl_func_type + 1;
-    volatile unsigned long long *cxl_test_case   = cxl_func_type + 2;
-    volatile unsigned long long *cxl_addr_handshake __maybe_unused     = cxl_func_type + 3;
-    volatile unsigned long long *cxl_data_handshake __maybe_unused     = cxl_func_type + 4;
-    volatile unsigned long long *cxl_response_handshake __maybe_unused = cxl_func_type + 5;
-    volatile unsigned long long *cxl_read_data_0 = cxl_func_type + 6;
-    volatile unsigned long long *cxl_read_data_1 = cxl_func_type + 7;
-    volatile unsigned long long *cxl_read_data_2 = cxl_func_type + 8;
-    volatile unsigned long long *cxl_read_data_3 = cxl_func_type + 9;
-    volatile unsigned long long *cxl_read_data_4 = cxl_func_type + 10;
-    volatile unsigned long long *cxl_read_data_5 = cxl_func_type + 11;
-    volatile unsigned long long *cxl_read_data_6 = cxl_func_type + 12;
-    volatile unsigned long long *cxl_read_data_7 = cxl_func_type + 13;
+    struct cxl_dev *d = cxl_dev_get();
+    int i;
+
+    if (!d)
+        return -ENODEV;
 
     pr_info("page_addr: 0x%llx\n", page_address);
-    *cxl_test_case  = 4;
-    *cxl_page_addr_0 = 0x4080000000ull;
+    cxl_wr(d, CXL_REG_TEST_CASE,  4);
+    cxl_wr(d, CXL_REG_PAGE_ADDR0, 0x4080000000ull);
     asm volatile("mfence");
 
-    *cxl_func_type = 1;
+    cxl_wr(d, CXL_REG_FUNC_TYPE, 1);
     asm volatile("mfence");
     usleep_range(500, 600);
 
-    pr_info("testcase: 0x%llx\n", *cxl_test_case);
-    pr_info("read_data_0: 0x%llx\n", *cxl_read_data_0);
-    pr_info("read_data_1: 0x%llx\n", *cxl_read_data_1);
-    pr_info("read_data_2: 0x%llx\n", *cxl_read_data_2);
-    pr_info("read_data_3: 0x%llx\n", *cxl_read_data_3);
-    pr_info("read_data_4: 0x%llx\n", *cxl_read_data_4);
-    pr_info("read_data_5: 0x%llx\n", *cxl_read_data_5);
-    pr_info("read_data_6: 0x%llx\n", *cxl_read_data_6);
-    pr_info("read_data_7: 0x%llx\n", *cxl_read_data_7);
-
-    *cxl_func_type = 2;
+    pr_info("testcase: 0x%llx\n", cxl_rd(d, CXL_REG_TEST_CASE));
+    for (i = 0; i < 8; i++)
+        pr_info("read_data_%d: 0x%llx\n", i, cxl_rd(d, CXL_REG_READ_DATA(i)));
+
+    cxl_wr(d, CXL_REG_FUNC_TYPE, 2);
     return 0;
 }
 
 int launch_cxl_io(unsigned long long head_low, unsigned long long head_high, unsigned long long payload)
 {
-    volatile unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_tx_header_low  = cxl_func_type + 22;
-    volatile unsigned long long *cxl_tx_header_high = cxl_func_type + 23;
-    volatile unsigned long long *cxl_tx_start       = cxl_func_type + 24;
-    volatile unsigned long long *cxl_tx_payload     = cxl_func_type + 25;
-
-    *cxl_tx_header_low  = head_low;
-    *cxl_tx_header_high = head_high;
-    *cxl_tx_payload     = payload;
+    struct cxl_dev *d = cxl_dev_get();
+
+    if (!d)
+        return -ENODEV;
+
+    cxl_wr(d, CXL_REG_TX_HEADER_LOW,  head_low);
+    cxl_wr(d, CXL_REG_TX_HEADER_HIGH, head_high);
+    cxl_wr(d, CXL_REG_TX_PAYLOAD,     payload);
     asm volatile("mfence");
-    *cxl_tx_start = 1;
+    cxl_wr(d, CXL_REG_TX_START, 1);
     asm volatile("mfence");
     usleep_range(500, 600);
     return 0;
@@ -358,34 +329,33 @@ int launch_cxl_io(unsigned long long head_low, unsigned long long head_high, uns
 
 void access_pcie_bar(void)
 {
-    void __iomem *bar;
+    struct cxl_dev *d = cxl_dev_get();
     u32 val;
 
-    bar = ioremap(FPGA_BAR_0_ADDRESS, PCI_BAR_SIZE);
-    if (!bar) {
-        pr_err("Failed to ioremap PCIe BAR 0x%llx\n", (unsigned long long)FPGA_BAR_0_ADDRESS);
+    if (!d) {
+        pr_err("BAR_0 not mapped: no FPGA bound\n");
         return;
     }
 
-    writel(0x12345678, bar + 0x8);
+    writel(0x12345678, d->bar0 + 0x8);
     pr_info("Wrote 0x12345678 to BAR[0x8]\n");
 
-    val = readl(bar + 0x8);
+    val = readl(d->bar0 + 0x8);
     pr_info("Read from BAR[0x8]: 0x%x\n", val);
-    iounmap(bar);
 }
 
 void write_pattern_512B_to_pcie_bar(size_t bar_offset)
 {
+    struct cxl_dev *d = cxl_dev_get();
     void __iomem *bar;
     u8 pattern_buf[512];
     int i, j;
 
-    bar = ioremap(FPGA_BAR_0_ADDRESS, PCI_BAR_SIZE);
-    if (!bar) {
-        pr_err("Failed to ioremap PCIe BAR 0x%llx\n", (unsigned long long)FPGA_BAR_0_ADDRESS);
+    if (!d) {
+        pr_err("BAR_0 not mapped: no FPGA bound\n");
         return;
     }
+    bar = d->bar0;
 
     for (i = 511; i >= 0; i--)
         pattern_buf[i] = (u8)(i ^ 0xAA);
@@ -401,21 +371,21 @@ void write_pattern_512B_to_pcie_bar(size_t bar_offset)
             offset += snprintf(line + offset, sizeof(line) - offset, " %02X", pattern_buf[i + j]);
         pr_info("%s\n", line);
     }
-    iounmap(bar);
 }
 
 void verify_pattern_512B_from_pcie_bar(size_t bar_offset)
 {
+    struct cxl_dev *d = cxl_dev_get();
     void __iomem *bar;
     u8 expected __maybe_unused, read_val __maybe_unused;
     int i, j, error_count = 0;
     u8 read_buf[512];
 
-    bar = ioremap(FPGA_BAR_0_ADDRESS, PCI_BAR_SIZE);
-    if (!bar) {
-        pr_err("Failed to ioremap PCIe BAR 0x%llx\n", (unsigned long long)FPGA_BAR_0_ADDRESS);
+    if (!d) {
+        pr_err("BAR_0 not mapped: no FPGA bound\n");
         return;
     }
+    bar = d->bar0;
 
     memcpy_fromio(read_buf, bar + bar_offset, 512);
     pr_info("Verifying and printing 512B from BAR\n");
@@ -434,7 +404,6 @@ void verify_pattern_512B_from_pcie_bar(size_t bar_offset)
     else
         pr_err("Verification failed: %d mismatches\n", error_count);
 
-    iounmap(bar);
 }
 
 void read_512B_from_phys_buffer(phys_addr_t buffer_phys_addr)
@@ -495,104 +464,85 @@ void write_512B_to_phys_buffer(phys_addr_t buffer_phys_addr)
 void test_fio(unsigned long long cq_addresses, unsigned long long sq_addresses,
               unsigned long long buffer_addresses, unsigned long long tail_head)
 {
-    unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_sq_addr     = cxl_func_type + 26;
-    volatile unsigned long long *cxl_cq_addr     = cxl_func_type + 27;
-    volatile unsigned long long *cxl_bar_addr __maybe_unused    = cxl_func_type + 28;
-    volatile unsigned long long *cxl_sq_tail     = cxl_func_type + 29;
-    volatile unsigned long long *cxl_cq_head     = cxl_func_type + 30;
-    volatile unsigned long long *cxl_csr_init __maybe_unused   = cxl_func_type + 32;
-    volatile unsigned long long *cxl_host_buffer = cxl_func_type + 33;
-    volatile unsigned long long *cxl_queue_index = cxl_func_type + 34;
-
-    *cxl_queue_index = 9;
-    *cxl_cq_addr     = cq_addresses;
-    *cxl_cq_head     = tail_head;
-    *cxl_sq_tail     = 128 * tail_head;
-    *cxl_host_buffer = buffer_addresses;
-    *cxl_sq_addr     = *cxl_sq_addr + 1;
+    struct cxl_dev *d = cxl_dev_get();
+
+    if (!d)
+        return;
+
+    cxl_wr(d, CXL_REG_QUEUE_INDEX, 9);
+    cxl_wr(d, CXL_REG_CQ_ADDR,     cq_addresses);
+    cxl_wr(d, CXL_REG_CQ_HEAD,     tail_head);
+    cxl_wr(d, CXL_REG_SQ_TAIL,     128 * tail_head);
+    cxl_wr(d, CXL_REG_HOST_BUFFER, buffer_addresses);
+    cxl_wr(d, CXL_REG_SQ_ADDR,     cxl_rd(d, CXL_REG_SQ_ADDR) + 1);
 
     pr_info("qidx=0x%llx sq=0x%llx cq=0x%llx tail=0x%llx head=0x%llx buf=0x%llx\n",
-            *cxl_queue_index, *cxl_sq_addr, *cxl_cq_addr, *cxl_sq_tail, *cxl_cq_head, *cxl_host_buffer);
+            cxl_rd(d, CXL_REG_QUEUE_INDEX), cxl_rd(d, CXL_REG_SQ_ADDR),
+            cxl_rd(d, CXL_REG_CQ_ADDR), cxl_rd(d, CXL_REG_SQ_TAIL),
+            cxl_rd(d, CXL_REG_CQ_HEAD), cxl_rd(d, CXL_REG_HOST_BUFFER));
 }
 
 void set_loopback(unsigned long long addr, unsigned long long test_case, unsigned long long delay_cnt)
 {
-    unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_m5_interval = cxl_func_type + 35;
-    volatile unsigned long long *cxl_m5_query_en __maybe_unused = cxl_func_type + 36;
+    struct cxl_dev *d = cxl_dev_get();
 
-    *cxl_m5_interval = 2000;
+    if (d)
+        cxl_wr(d, CXL_REG_M5_INTERVAL, 2000);
 }
 
 /* L2 (single shot); streaming lives in l2_stream.c */
 int launch_l2_dist_cal(phys_addr_t base_addr, phys_addr_t query_addr)
 {
-    volatile unsigned long long *cxl_func_type = get_virt_addr();
-    volatile unsigned long long *cxl_page_addr_0   = cxl_func_type + 1;
-    volatile unsigned long long *cxl_page_addr_1   = cxl_func_type + 2;
-    volatile unsigned long long *cxl_l2_dist_start = cxl_func_type + 14;
+    struct cxl_dev *d = cxl_dev_get();
+
+    if (!d)
+        return -ENODEV;
 
     pr_info("L2 dist: base=0x%llx query=0x%llx\n",
             (unsigned long long)base_addr, (unsigned long long)query_addr);
 
-    *cxl_page_addr_0 = base_addr;
-    *cxl_page_addr_1 = query_addr;
+    cxl_wr(d, CXL_REG_PAGE_ADDR0, base_addr);
+    cxl_wr(d, CXL_REG_PAGE_ADDR1, query_addr);
     asm volatile("mfence");
 
-    *cxl_l2_dist_start = 1;
+    cxl_wr(d, CXL_REG_L2_DIST_START, 1);
     asm volatile("mfence");
     return 0;
 }
 
 int run_l2_and_dump(phys_addr_t base_addr, phys_addr_t query_addr, u64 num_vecs, u32 dim, u32 clk_mhz)
 {
-    volatile unsigned long long *csr = get_virt_addr();
+    struct l2_engine *eng = l2_engine_get();
     char outbuf[256];
     long wret;
-    u64 cycles;
+    u64 cycles, resp;
+    int rc;
     const char *out_path = "/home/lifan3/cxl_dist_cal/data/l2_result.txt";
 
-    if (!csr) {
-        pr_err("CSR ioremap failed\n");
+    if (!eng) {
+        pr_err("L2 engine not initialised\n");
         return -ENODEV;
     }
 
-    volatile unsigned long long *REG_PAGE_ADDR0  = csr + (0x0008 >> 3);
-    volatile unsigned long long *REG_PAGE_ADDR1  = csr + (0x0010 >> 3);
-    volatile unsigned long long *REG_DELAY       = csr + (0x0018 >> 3);
-    volatile unsigned long long *REG_TEST_CASE   = csr + (0x0020 >> 3);
-    volatile unsigned long long *REG_RESP        = csr + (0x0028 >> 3);
-    volatile unsigned long long *REG_NUM_REQ     = csr + (0x0060 >> 3);
-    volatile unsigned long long *REG_ADDR_RANGE  = csr + (0x0068 >> 3);
-    volatile unsigned long long *REG_L2_START    = csr + (0x0070 >> 3);
-
-    *REG_PAGE_ADDR0 = base_addr;
-    *REG_PAGE_ADDR1 = query_addr;
-    *REG_NUM_REQ    = num_vecs;
-    *REG_ADDR_RANGE = dim;
-    *REG_TEST_CASE  = 100ull;
-    asm volatile("mfence");
-
-    *REG_L2_START   = 1ull;
-    asm volatile("mfence");
-
     {
-        int tries = 0, max_tries = 1000000;
-        while (tries++ < max_tries) {
-            if ((*REG_RESP) & 0x1ull) break;
-            usleep_range(500, 600);
-        }
-        if (tries >= max_tries) {
+        struct l2_job job = {
+            .base_pa  = base_addr,
+            .base_va  = phys_to_virt(base_addr),
+            .query_pa = query_addr,
+            .query_va = phys_to_virt(query_addr),
+            .num_vecs = num_vecs,
+            .dim      = dim,
+        };
+
+        rc = l2_engine_run(eng, &job, &cycles, &resp);
+        if (rc) {
             pr_err("L2 calc timeout\n");
-            return -ETIMEDOUT;
+            return rc;
         }
     }
 
-    cycles = *REG_DELAY;
-
     {
-        u64 total_bytes = num_vecs * 512ull;
+        u64 total_bytes = num_vecs * dim * sizeof(s32);
         u64 time_ns = 0;
         u64 gbps_x1000 = 0;
         if (clk_mhz > 0 && cycles > 0) {
@@ -618,3 +568,92 @@ int run_l2_and_dump(phys_addr_t base_addr, phys_addr_t query_addr, u64 num_vecs,
         pr_info("Wrote L2 results to %s\n", out_path);
     return 0;
 }
+
+/* PMEM: a DAX namespace mapped whole, so the engine reads it in place */
+struct arona_dax_state *arona_dax_start(const char *dev, ulong align_order)
+{
+    struct arona_dax_state *st;
+    long chunk = 1L << align_order;
+    pgoff_t pgoff;
+    long pages;
+    int id, rc;
+
+    st = kzalloc(sizeof(*st), GFP_KERNEL);
+    if (!st)
+        return ERR_PTR(-ENOMEM);
+    st->devname = kstrdup(dev, GFP_KERNEL);
+    if (!st->devname) {
+        rc = -ENOMEM;
+        goto err;
+    }
+
+    st->bdev_file = bdev_file_open_by_path(dev, BLK_OPEN_READ, st, NULL);
+    if (IS_ERR(st->bdev_file)) {
+        rc = PTR_ERR(st->bdev_file);
+        st->bdev_file = NULL;
+        pr_err("arona_dax: cannot open %s (%d)\n", dev, rc);
+        goto err;
+    }
+    st->bdev = file_bdev(st->bdev_file);
+
+    // Only fsdax namespaces register a dax_device for their gendisk
+    st->daxdev = fs_dax_get_by_bdev(st->bdev, &st->offset, st, NULL);
+    if (!st->daxdev) {
+        pr_err("arona_dax: %s is not a DAX capable pmem device\n", dev);
+        rc = -EOPNOTSUPP;
+        goto err;
+    }
+
+    pages = bdev_nr_bytes(st->bdev) >> PAGE_SHIFT;
+    rc = -EINVAL;
+    id = dax_read_lock();
+    for (pgoff = 0; pgoff < pages; ) {
+        void *kaddr;
+        pfn_t pfn;
+        long n;
+
+        n = dax_direct_access(st->daxdev, (st->offset >> PAGE_SHIFT) + pgoff,
+                              min(chunk, pages - (long)pgoff), DAX_ACCESS, &kaddr, &pfn);
+        if (n <= 0) {
+            rc = n ? (int)n : -EIO;
+            break;
+        }
+        if (pgoff == 0) {
+            st->va  = kaddr;
+            st->pfn = pfn_t_to_pfn(pfn);
+        } else if (kaddr != st->va + (pgoff << PAGE_SHIFT) ||
+                   pfn_t_to_pfn(pfn) != st->pfn + pgoff) {
+            // The engine gets one base address: a split namespace is of no use
+            pr_err("arona_dax: %s is not contiguous at page %lu\n", dev, pgoff);
+            rc = -EINVAL;
+            break;
+        }
+        pgoff += n;
+        rc = 0;
+    }
+    dax_read_unlock(id);
+    if (rc)
+        goto err;
+
+    st->pgcnt = pages;
+    st->size  = (ulong)pages << PAGE_SHIFT;
+    pr_info("arona_dax: %s mapped, %lu MiB at va %px pa %llx\n", dev, st->size >> 20,
+            st->va, (unsigned long long)PFN_PHYS(st->pfn));
+    return st;
+
+err:
+    arona_dax_stop(st);
+    return ERR_PTR(rc);
+}
+
+void arona_dax_stop(struct arona_dax_state *state)
+{
+    if (!state)
+        return;
+    if (state->daxdev)
+        fs_put_dax(state->daxdev, state);
+    if (state->bdev_file)
+        fput(state->bdev_file);
+    kfree(state->devname);
+    kfree(state);
+}
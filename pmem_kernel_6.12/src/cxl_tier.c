@@ -0,0 +1,347 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/migrate.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/err.h>
+
+#include "cxl_dev.h"
+#include "cxl_tier.h"
+#include "l2_stats.h"
+
+#define CXL_M5_SLOTS        5
+#define CXL_TIER_PROBE      8       /* hotness table slots searched per PFN */
+#define CXL_TIER_HEAT_MAX   0xffff
+
+// Hotness table slot; pfn 0 = free
+struct cxl_tier_ent {
+    u64 pfn;
+    u32 heat;
+    u32 stuck;      /* promotion failed: not a candidate again until it cools off */
+};
+
+// A promoted page, by its DRAM PFN
+struct cxl_tier_hot {
+    u64 pfn;
+    u32 heat;       /* carried over from the table, decays like it */
+    u32 since;      /* window it was promoted in */
+};
+
+struct cxl_tier {
+    struct cxl_tier_cfg  cfg;
+    struct cxl_dev      *dev;
+    struct task_struct  *task;
+    u32                  window;
+
+    struct cxl_tier_ent *table;
+    u32                  bits;
+
+    struct cxl_tier_hot *dram;
+    u32                  ndram;
+
+    // Entries that crossed promote_heat in the current window
+    struct cxl_tier_ent *cand[CXL_M5_SLOTS];
+    u32                  ncand;
+};
+
+static struct cxl_tier *cxl_tier;
+
+// ---------- Migration ----------
+#ifdef CXL_TIER_MIGRATE
+// Where each source page of one migrate_pages() call went (0 = nowhere)
+struct cxl_tier_move {
+    int nid;
+    u32 n;
+    u64 src[CXL_M5_SLOTS];
+    u64 dst[CXL_M5_SLOTS];
+};
+
+static struct folio *cxl_tier_alloc(struct folio *src, unsigned long private)
+{
+    struct cxl_tier_move *mv = (struct cxl_tier_move *)private;
+    struct folio *dst;
+    u32 i;
+
+    dst = __folio_alloc_node(GFP_HIGHUSER_MOVABLE | __GFP_THISNODE | __GFP_NOWARN, 0, mv->nid);
+    for (i = 0; dst && i < mv->n; i++) {
+        if (mv->src[i] == folio_pfn(src))
+            mv->dst[i] = folio_pfn(dst);
+    }
+    return dst;
+}
+
+// The copy to dst did not happen after all
+static void cxl_tier_free(struct folio *dst, unsigned long private)
+{
+    struct cxl_tier_move *mv = (struct cxl_tier_move *)private;
+    u32 i;
+
+    for (i = 0; i < mv->n; i++) {
+        if (mv->dst[i] == folio_pfn(dst))
+            mv->dst[i] = 0;
+    }
+    folio_put(dst);
+}
+
+// Migrate the order-0 LRU pages among mv->src that sit on from_nid to mv->nid
+static void cxl_tier_move(struct cxl_tier_move *mv, int from_nid, int reason)
+{
+    LIST_HEAD(folios);
+    unsigned int done = 0;
+    u32 i;
+
+    for (i = 0; i < mv->n; i++) {
+        struct page *page = pfn_to_online_page(mv->src[i]);
+        struct folio *folio;
+        bool ok;
+
+        mv->dst[i] = 0;
+        if (!mv->src[i] || !page)
+            continue;
+        folio = page_folio(page);
+        if (!folio_try_get(folio))
+            continue;
+        ok = folio_nid(folio) == from_nid && !folio_test_large(folio) &&
+             folio_test_lru(folio) && isolate_folio_to_list(folio, &folios);
+        folio_put(folio);
+        if (!ok)
+            l2_stats_add(L2_CTR_TIER_UNMOVABLE, 1);
+    }
+    if (list_empty(&folios))
+        return;
+
+    if (migrate_pages(&folios, cxl_tier_alloc, cxl_tier_free, (unsigned long)mv,
+                      MIGRATE_ASYNC, reason, &done))
+        putback_movable_pages(&folios);
+}
+#endif
+
+// Move up to n of the coldest promoted pages back to the CXL node
+static void cxl_tier_demote(struct cxl_tier *t, u32 n)
+{
+#ifdef CXL_TIER_MIGRATE
+    struct cxl_tier_move mv = { .nid = t->cfg.cxl_nid };
+    u32 i, k, moved = 0;
+
+    for (k = 0; k < n && t->ndram; k++) {
+        struct cxl_tier_hot *cold = &t->dram[0];
+
+        for (i = 1; i < t->ndram; i++) {
+            struct cxl_tier_hot *h = &t->dram[i];
+
+            if (h->heat < cold->heat || (h->heat == cold->heat && h->since < cold->since))
+                cold = h;
+        }
+        mv.src[mv.n++] = cold->pfn;
+        // Tracked or not after this, it no longer counts against the budget
+        *cold = t->dram[--t->ndram];
+    }
+    cxl_tier_move(&mv, t->cfg.dram_nid, MR_DEMOTION);
+    for (i = 0; i < mv.n; i++)
+        moved += !!mv.dst[i];
+    l2_stats_add(L2_CTR_TIER_DEMOTED, moved);
+#endif
+}
+
+static void cxl_tier_promote(struct cxl_tier *t)
+{
+    u32 i;
+#ifdef CXL_TIER_MIGRATE
+    struct cxl_tier_move mv = { .nid = t->cfg.dram_nid, .n = t->ncand };
+
+    // Room first: the budget holds the hottest pages seen
+    if (t->ndram + t->ncand > t->cfg.max_promoted)
+        cxl_tier_demote(t, t->ndram + t->ncand - t->cfg.max_promoted);
+
+    // A later hit in the same window may have reclaimed a candidate's slot
+    for (i = 0; i < t->ncand; i++)
+        mv.src[i] = t->cand[i]->heat >= t->cfg.promote_heat ? t->cand[i]->pfn : 0;
+    cxl_tier_move(&mv, t->cfg.cxl_nid, MR_NUMA_MISPLACED);
+
+    for (i = 0; i < t->ncand; i++) {
+        struct cxl_tier_ent *e = t->cand[i];
+
+        if (!mv.dst[i] || t->ndram == t->cfg.max_promoted) {
+            if (mv.src[i])
+                e->stuck = 1;
+            continue;
+        }
+        t->dram[t->ndram++] = (struct cxl_tier_hot) {
+            .pfn = mv.dst[i], .heat = e->heat, .since = t->window,
+        };
+        // The CXL page is gone; its PFN may come back as someone else's
+        e->pfn  = 0;
+        e->heat = 0;
+        l2_stats_add(L2_CTR_TIER_PROMOTED, 1);
+    }
+#else
+    for (i = 0; i < t->ncand; i++)
+        t->cand[i]->stuck = 1;
+#endif
+}
+
+// ---------- Hotness table ----------
+// The slot tracking pfn, or the coldest one in its probe window, reclaimed for it
+static struct cxl_tier_ent *cxl_tier_slot(struct cxl_tier *t, u64 pfn)
+{
+    u32 h = hash_64(pfn, t->bits), mask = (1u << t->bits) - 1, i;
+    struct cxl_tier_ent *victim = NULL;
+
+    for (i = 0; i < CXL_TIER_PROBE; i++) {
+        struct cxl_tier_ent *e = &t->table[(h + i) & mask];
+
+        if (e->pfn == pfn)
+            return e;
+        if (!victim || e->heat < victim->heat)
+            victim = e;
+    }
+    *victim = (struct cxl_tier_ent) { .pfn = pfn };
+    return victim;
+}
+
+static void cxl_tier_hit(struct cxl_tier *t, u64 dev_addr)
+{
+    u64 pfn = PHYS_PFN(dev_addr + t->cfg.cxl_base);
+    struct page *page = pfn_to_online_page(pfn);
+    struct cxl_tier_ent *e;
+    u32 i;
+
+    l2_stats_add(L2_CTR_M5_HITS, 1);
+    // Only CXL-resident pages are worth tracking
+    if (!page || page_to_nid(page) != t->cfg.cxl_nid)
+        return;
+
+    e = cxl_tier_slot(t, pfn);
+    e->heat = min_t(u32, e->heat + 1, CXL_TIER_HEAT_MAX);
+    if (e->heat < t->cfg.promote_heat || e->stuck)
+        return;
+
+    for (i = 0; i < t->ncand; i++) {
+        if (t->cand[i] == e)
+            return;
+    }
+    t->cand[t->ncand++] = e;
+    l2_stats_add(L2_CTR_TIER_CANDIDATES, 1);
+}
+
+static void cxl_tier_decay(struct cxl_tier *t)
+{
+    u32 i;
+
+    for (i = 0; i < (1u << t->bits); i++) {
+        struct cxl_tier_ent *e = &t->table[i];
+
+        e->heat >>= 1;
+        if (!e->heat)
+            *e = (struct cxl_tier_ent) { 0 };
+    }
+    for (i = 0; i < t->ndram; i++)
+        t->dram[i].heat >>= 1;
+}
+
+// ---------- Sampler ----------
+static int cxl_tier_fn(void *arg)
+{
+    struct cxl_tier *t = arg;
+    struct cxl_dev *d = t->dev;
+    u64 cycles = (u64)t->cfg.interval_us * t->cfg.clk_mhz;
+    u32 i;
+
+    while (!kthread_should_stop()) {
+        // CXL_REG_M5_INTERVAL doubles as the reset: re-arm every window
+        cxl_wr(d, CXL_REG_M5_INTERVAL, cycles);
+        cxl_wr(d, CXL_REG_M5_QUERY_EN, 1);
+        usleep_range(t->cfg.interval_us, t->cfg.interval_us + t->cfg.interval_us / 8 + 1);
+
+        t->ncand = 0;
+        for (i = 0; i < CXL_M5_SLOTS; i++) {
+            u64 v = cxl_rd(d, CXL_REG_M5_HOT_PAGE(i));
+
+            if (v)
+                cxl_tier_hit(t, v);
+        }
+        cxl_wr(d, CXL_REG_M5_QUERY_EN, 0);
+        cxl_wr(d, CXL_REG_M5_RST, 1);
+
+        if (t->ncand)
+            cxl_tier_promote(t);
+        if (!(++t->window % CXL_TIER_DECAY_WINDOWS))
+            cxl_tier_decay(t);
+        cond_resched();
+    }
+    return 0;
+}
+
+static void cxl_tier_free_all(struct cxl_tier *t)
+{
+    vfree(t->table);
+    vfree(t->dram);
+    kfree(t);
+}
+
+int cxl_tier_start(const struct cxl_tier_cfg *cfg)
+{
+    struct cxl_dev *d = cxl_dev_get();
+    struct cxl_tier *t;
+
+    if (!cfg->interval_us)
+        return 0;
+    if (!d) {
+        pr_err("cxl_tier: the m5 tracker needs an FPGA board (engine=fpga)\n");
+        return -ENODEV;
+    }
+    if (!cfg->clk_mhz || !cfg->promote_heat || !cfg->max_promoted ||
+        cfg->cxl_nid == cfg->dram_nid) {
+        pr_err("cxl_tier: bad config (clk %u MHz, heat %u, budget %u, nodes %d -> %d)\n",
+               cfg->clk_mhz, cfg->promote_heat, cfg->max_promoted, cfg->cxl_nid, cfg->dram_nid);
+        return -EINVAL;
+    }
+
+    t = kzalloc(sizeof(*t), GFP_KERNEL);
+    if (!t)
+        return -ENOMEM;
+    t->cfg  = *cfg;
+    t->dev  = d;
+    t->bits = ilog2(roundup_pow_of_two(max_t(u32, cfg->table, CXL_TIER_PROBE)));
+    t->table = vzalloc(array_size(1u << t->bits, sizeof(*t->table)));
+    t->dram  = vzalloc(array_size(cfg->max_promoted, sizeof(*t->dram)));
+    if (!t->table || !t->dram) {
+        cxl_tier_free_all(t);
+        return -ENOMEM;
+    }
+
+    t->task = kthread_run(cxl_tier_fn, t, "cxl_tier");
+    if (IS_ERR(t->task)) {
+        int rc = PTR_ERR(t->task);
+
+        cxl_tier_free_all(t);
+        return rc;
+    }
+    cxl_tier = t;
+
+#ifdef CXL_TIER_MIGRATE
+    pr_info("cxl_tier: sampling every %u us, promoting node %d -> %d at heat %u, budget %u pages\n",
+            cfg->interval_us, cfg->cxl_nid, cfg->dram_nid, cfg->promote_heat, cfg->max_promoted);
+#else
+    pr_info("cxl_tier: sampling every %u us; built without CXL_TIER_MIGRATE, hot pages are counted, not moved\n",
+            cfg->interval_us);
+#endif
+    return 0;
+}
+EXPORT_SYMBOL(cxl_tier_start);
+
+void cxl_tier_stop(void)
+{
+    if (!cxl_tier)
+        return;
+    kthread_stop(cxl_tier->task);
+    cxl_wr(cxl_tier->dev, CXL_REG_M5_QUERY_EN, 0);
+    cxl_tier_free_all(cxl_tier);
+    cxl_tier = NULL;
+}
+EXPORT_SYMBOL(cxl_tier_stop);
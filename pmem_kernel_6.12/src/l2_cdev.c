@@ -0,0 +1,406 @@
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/string.h>
+#include <linux/capability.h>
+#include <linux/poll.h>
+#include <linux/types.h>
+
+#include "l2_cdev.h"
+#include "l2_engine.h"
+#include "l2_ioctl.h"
+#include "l2_ring.h"
+#include "l2_stream.h"
+#include "l2_topk.h"
+
+static void (*l2_cdev_defaults)(struct l2_stream_cfg *cfg);
+
+// Per-open buffers, sized once by L2_IOC_SETUP
+struct l2_cdev_ctx {
+    struct mutex lock;
+    u32          max_queries;
+    u32          max_k;
+    u32          vec_bytes;
+
+    // Queries: physically contiguous, the engine reads them in place
+    struct page *qpages;
+    size_t       qbytes;
+
+    // Results: each query's top-k heap lives in its slice of this
+    struct l2_ioc_result *res;
+    size_t       rbytes;
+    struct l2_topk *tk;
+
+    // Optional SQ/CQ pair (L2_IOC_RING_SETUP)
+    struct l2_ring *ring;
+};
+
+static int l2_cdev_open(struct inode *inode, struct file *file)
+{
+    struct l2_cdev_ctx *ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+
+    if (!ctx)
+        return -ENOMEM;
+    mutex_init(&ctx->lock);
+    file->private_data = ctx;
+    return 0;
+}
+
+static int l2_cdev_release(struct inode *inode, struct file *file)
+{
+    struct l2_cdev_ctx *ctx = file->private_data;
+
+    // Stop the ring worker before the buffers it searches into go away
+    l2_ring_destroy(ctx->ring);
+    if (ctx->qpages)
+        __free_pages(ctx->qpages, get_order(ctx->qbytes));
+    vfree(ctx->res);
+    kfree(ctx->tk);
+    kfree(ctx);
+    return 0;
+}
+
+static long l2_ioc_info(void __user *argp)
+{
+    struct l2_engine *eng = l2_engine_get();
+    struct l2_resident_info ri;
+    struct l2_ioc_info info = { 0 };
+    int rc;
+
+    rc = l2_stream_resident_info(&ri);
+    if (rc)
+        return rc;
+
+    info.handle    = ri.handle;
+    info.vectors   = ri.vectors;
+    info.dim       = ri.lay.dim;
+    info.elem      = ri.lay.query_elem;
+    info.vec_bytes = ri.lay.query_bytes;
+    info.max_query_block = L2_MAX_QUERY_BLOCK;
+    if (eng)
+        strscpy(info.engine, eng->ops->name, sizeof(info.engine));
+
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+}
+
+static long l2_ioc_load(void __user *argp)
+{
+    struct l2_stream_cfg cfg;
+    struct l2_ioc_load req;
+    char *path, *elem, *nodes, *rerank;
+    int rc;
+
+    if (!capable(CAP_SYS_ADMIN))
+        return -EPERM;
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+
+    path = strndup_user(u64_to_user_ptr(req.path), PATH_MAX);
+    if (IS_ERR(path))
+        return PTR_ERR(path);
+
+    /*
+     * The charp parameters can be rewritten through sysfs meanwhile, which
+     * frees the old strings: copy them under the parameter lock.
+     */
+    kernel_param_lock(THIS_MODULE);
+    l2_cdev_defaults(&cfg);
+    elem   = kstrdup(cfg.elem, GFP_KERNEL);
+    nodes  = kstrdup(cfg.cxl_nodes, GFP_KERNEL);
+    rerank = kstrdup(cfg.rerank_path, GFP_KERNEL);
+    kernel_param_unlock(THIS_MODULE);
+    if ((cfg.elem && !elem) || (cfg.cxl_nodes && !nodes) || (cfg.rerank_path && !rerank)) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    cfg.elem        = elem;
+    cfg.cxl_nodes   = nodes;
+    cfg.rerank_path = rerank;
+
+    // No query file: queries come through the mmap'd buffer
+    cfg.base_path  = path;
+    cfg.query_path = NULL;
+    cfg.total_vecs = 0;
+    cfg.direct     = req.direct;
+    if (req.batch_vecs)
+        cfg.batch_vecs = req.batch_vecs;
+
+    rc = l2_stream_load_resident(&cfg);
+out:
+    kfree(rerank);
+    kfree(nodes);
+    kfree(elem);
+    kfree(path);
+    return rc;
+}
+
+static long l2_ioc_setup(struct l2_cdev_ctx *ctx, void __user *argp)
+{
+    struct l2_resident_info ri;
+    struct l2_ioc_setup req;
+    int rc;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if (ctx->qpages)
+        return -EBUSY;
+    if (!req.max_queries || !req.max_k || req.max_queries > L2_MAX_QUERY_BLOCK)
+        return -EINVAL;
+
+    rc = l2_stream_resident_info(&ri);
+    if (rc)
+        return rc;
+
+    ctx->qbytes = PAGE_ALIGN((size_t)req.max_queries * ri.lay.query_bytes);
+    if (get_order(ctx->qbytes) > MAX_PAGE_ORDER)
+        return -E2BIG;
+    ctx->rbytes = PAGE_ALIGN((size_t)req.max_queries * req.max_k * sizeof(*ctx->res));
+
+    ctx->tk  = kcalloc(req.max_queries, sizeof(*ctx->tk), GFP_KERNEL);
+    ctx->res = vmalloc_user(ctx->rbytes);
+    ctx->qpages = alloc_pages(GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN, get_order(ctx->qbytes));
+    if (!ctx->tk || !ctx->res || !ctx->qpages) {
+        if (ctx->qpages)
+            __free_pages(ctx->qpages, get_order(ctx->qbytes));
+        vfree(ctx->res);
+        kfree(ctx->tk);
+        ctx->qpages = NULL;
+        ctx->res    = NULL;
+        ctx->tk     = NULL;
+        return -ENOMEM;
+    }
+    ctx->max_queries = req.max_queries;
+    ctx->max_k       = req.max_k;
+    ctx->vec_bytes   = ri.lay.query_bytes;
+
+    req.query_bytes  = ctx->qbytes;
+    req.result_bytes = ctx->rbytes;
+    return copy_to_user(argp, &req, sizeof(req)) ? -EFAULT : 0;
+}
+
+// Search queries [qidx, qidx + nq) of the query buffer; called with ctx->lock held
+static int l2_cdev_search(struct l2_cdev_ctx *ctx, u64 handle, u32 qidx, u32 nq, u32 k,
+                          u64 *cycles, u64 *wall_ns)
+{
+    struct l2_resident_info ri;
+    struct l2_search s;
+    u32 q, i;
+    int rc;
+
+    if (!ctx->qpages)
+        return -ENXIO;
+    if (!nq || qidx >= ctx->max_queries || nq > ctx->max_queries - qidx ||
+        !k || k > ctx->max_k)
+        return -EINVAL;
+
+    // The query buffer was sized for the layout at setup time
+    rc = l2_stream_resident_info(&ri);
+    if (rc)
+        return rc;
+    if (ri.handle != handle)
+        return -ESTALE;
+    if (ri.lay.query_bytes != ctx->vec_bytes)
+        return -EINVAL;
+
+    for (q = qidx; q < qidx + nq; q++) {
+        ctx->tk[q].k = k;
+        ctx->tk[q].n = 0;
+        ctx->tk[q].e = (struct l2_topk_ent *)&ctx->res[(size_t)q * ctx->max_k];
+    }
+
+    s = (struct l2_search) {
+        .handle   = handle,
+        .query_va = page_address(ctx->qpages) + (size_t)qidx * ctx->vec_bytes,
+        .query_pa = page_to_phys(ctx->qpages) + (phys_addr_t)qidx * ctx->vec_bytes,
+        .nq       = nq,
+        .tk       = ctx->tk + qidx,
+    };
+    rc = l2_stream_search(&s);
+    if (rc)
+        return rc;
+
+    // Pad each query's slice past its hits
+    for (q = qidx; q < qidx + nq; q++) {
+        struct l2_ioc_result *r = &ctx->res[(size_t)q * ctx->max_k];
+
+        for (i = ctx->tk[q].n; i < ctx->max_k; i++) {
+            r[i].id   = L2_RESULT_NONE;
+            r[i].dist = U64_MAX;
+        }
+    }
+
+    *cycles  = s.cycles;
+    *wall_ns = s.wall_ns;
+    return 0;
+}
+
+static long l2_ioc_search(struct l2_cdev_ctx *ctx, void __user *argp)
+{
+    struct l2_ioc_search req;
+    int rc;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+
+    rc = l2_cdev_search(ctx, req.handle, 0, req.nq, req.k, &req.cycles, &req.wall_ns);
+    if (rc)
+        return rc;
+    return copy_to_user(argp, &req, sizeof(req)) ? -EFAULT : 0;
+}
+
+// Ring worker: one SQE, serialised against ioctls on the same fd
+static void l2_cdev_ring_fn(void *arg, const struct l2_sqe *sqe, struct l2_cqe *cqe)
+{
+    struct l2_cdev_ctx *ctx = arg;
+
+    mutex_lock(&ctx->lock);
+    cqe->status = l2_cdev_search(ctx, sqe->handle, sqe->qidx, sqe->nq, sqe->k,
+                                 &cqe->cycles, &cqe->wall_ns);
+    mutex_unlock(&ctx->lock);
+}
+
+static long l2_ioc_ring_setup(struct l2_cdev_ctx *ctx, void __user *argp)
+{
+    struct l2_ioc_ring req;
+    struct l2_ring *ring;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if (!ctx->qpages)
+        return -ENXIO;
+    if (ctx->ring)
+        return -EBUSY;
+
+    ring = l2_ring_create(req.sq_entries, req.cq_entries, req.eventfd, l2_cdev_ring_fn, ctx);
+    if (IS_ERR(ring))
+        return PTR_ERR(ring);
+
+    req.ring_bytes = l2_ring_bytes(ring);
+    if (copy_to_user(argp, &req, sizeof(req))) {
+        l2_ring_destroy(ring);
+        return -EFAULT;
+    }
+    ctx->ring = ring;
+    return 0;
+}
+
+static long l2_cdev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct l2_cdev_ctx *ctx = file->private_data;
+    void __user *argp = (void __user *)arg;
+    long rc;
+
+    BUILD_BUG_ON(sizeof(struct l2_ioc_result) != sizeof(struct l2_topk_ent));
+
+    switch (cmd) {
+    case L2_IOC_INFO:
+        return l2_ioc_info(argp);
+    case L2_IOC_LOAD:
+        return l2_ioc_load(argp);
+    case L2_IOC_RING_ENTER: {
+        struct l2_ring *ring = READ_ONCE(ctx->ring);
+
+        if (!ring)
+            return -ENXIO;
+        l2_ring_kick(ring);
+        return 0;
+    }
+    case L2_IOC_SETUP:
+    case L2_IOC_SEARCH:
+    case L2_IOC_RING_SETUP:
+        break;
+    default:
+        return -ENOTTY;
+    }
+
+    mutex_lock(&ctx->lock);
+    if (cmd == L2_IOC_SETUP)
+        rc = l2_ioc_setup(ctx, argp);
+    else if (cmd == L2_IOC_SEARCH)
+        rc = l2_ioc_search(ctx, argp);
+    else
+        rc = l2_ioc_ring_setup(ctx, argp);
+    mutex_unlock(&ctx->lock);
+    return rc;
+}
+
+static int l2_cdev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct l2_cdev_ctx *ctx = file->private_data;
+    u64 off = (u64)vma->vm_pgoff << PAGE_SHIFT;
+    size_t len = vma->vm_end - vma->vm_start;
+    int rc = -EINVAL;
+
+    mutex_lock(&ctx->lock);
+    if (!ctx->qpages) {
+        rc = -ENXIO;
+    } else if (off == L2_MMAP_QUERY && len <= ctx->qbytes) {
+        rc = remap_pfn_range(vma, vma->vm_start, page_to_pfn(ctx->qpages), len,
+                             vma->vm_page_prot);
+    } else if (off == L2_MMAP_RESULT && len <= ctx->rbytes) {
+        // Results are only written by the driver
+        if (vma->vm_flags & VM_WRITE) {
+            rc = -EPERM;
+        } else {
+            vm_flags_clear(vma, VM_MAYWRITE);
+            rc = remap_vmalloc_range(vma, ctx->res, 0);
+        }
+    } else if (off == L2_MMAP_RING && ctx->ring) {
+        rc = l2_ring_mmap(ctx->ring, vma);
+    }
+    mutex_unlock(&ctx->lock);
+    return rc;
+}
+
+static __poll_t l2_cdev_poll(struct file *file, poll_table *wait)
+{
+    struct l2_cdev_ctx *ctx = file->private_data;
+    struct l2_ring *ring = READ_ONCE(ctx->ring);
+
+    return ring ? l2_ring_poll(ring, file, wait) : EPOLLERR;
+}
+
+static const struct file_operations l2_cdev_fops = {
+    .owner          = THIS_MODULE,
+    .open           = l2_cdev_open,
+    .release        = l2_cdev_release,
+    .unlocked_ioctl = l2_cdev_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .mmap           = l2_cdev_mmap,
+    .poll           = l2_cdev_poll,
+};
+
+static struct miscdevice l2_cdev_misc = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name  = "l2_engine",
+    .fops  = &l2_cdev_fops,
+    .mode  = 0600,
+};
+
+int l2_cdev_init(void (*defaults)(struct l2_stream_cfg *cfg))
+{
+    int rc;
+
+    rc = misc_register(&l2_cdev_misc);
+    if (rc) {
+        pr_err("l2_cdev: misc_register failed (%d)\n", rc);
+        return rc;
+    }
+    l2_cdev_defaults = defaults;
+    pr_info("l2_cdev: /dev/%s ready\n", l2_cdev_misc.name);
+    return 0;
+}
+
+void l2_cdev_exit(void)
+{
+    if (l2_cdev_defaults)
+        misc_deregister(&l2_cdev_misc);
+    l2_cdev_defaults = NULL;
+}
@@ -0,0 +1,642 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/delay.h>
+#include <linux/io.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
+#include <linux/pci.h>
+#include <linux/interrupt.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <asm/barrier.h>
+
+#include "cxl_dev.h"
+#include "l2_engine.h"
+#include "l2_stats.h"
+#include "l2_topk.h"
+#include "l2_trace.h"
+
+// Backoff sleeps once the busy-poll window has passed
+#define L2_POLL_SLEEP_MIN_US  2
+#define L2_POLL_SLEEP_MAX_US  500
+
+static struct l2_engine l2_engs[L2_MAX_ENGINES];
+static u32 l2_neng;
+
+// ---------- FPGA backend (BAR_1 CSRs) ----------
+struct l2_mmio {
+    struct cxl_dev   *dev;
+
+    // Optional MSI completion path
+    struct pci_dev   *pdev;
+    int               irq;
+    struct completion done;
+};
+
+static inline struct cxl_dev *l2_mmio_dev(struct l2_engine *eng)
+{
+    struct l2_mmio *m = eng->priv;
+
+    return m->dev;
+}
+
+static void l2_mmio_set_base(struct l2_engine *eng, phys_addr_t pa, const void *va)
+{
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_PAGE_ADDR0, pa);
+}
+
+static void l2_mmio_set_query(struct l2_engine *eng, phys_addr_t pa, const void *va)
+{
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_PAGE_ADDR1, pa);
+}
+
+static void l2_mmio_set_num_req(struct l2_engine *eng, u64 num_vecs)
+{
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_L2_NUM_REQ, num_vecs);
+}
+
+static void l2_mmio_set_dim(struct l2_engine *eng, u32 dim)
+{
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_L2_ADDR_RANGE, dim);
+}
+
+static void l2_mmio_start(struct l2_engine *eng)
+{
+    struct l2_mmio *m = eng->priv;
+
+    if (m->irq > 0)
+        reinit_completion(&m->done);
+    mb();
+    cxl_wr(m->dev, CXL_REG_L2_TEST_CASE, L2_TEST_CASE_STREAM);
+    mb();
+    cxl_wr(m->dev, CXL_REG_L2_START, 0ull);
+    mb();
+    cxl_wr(m->dev, CXL_REG_L2_START, 1ull);
+    mb();
+}
+
+static void l2_mmio_stop(struct l2_engine *eng)
+{
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_L2_START, 0ull);
+    mb();
+}
+
+static int l2_mmio_set_dist_out(struct l2_engine *eng, phys_addr_t pa, u64 *va)
+{
+    if (!(eng->cfg.caps & L2_CAP_DIST_WB))
+        return pa ? -EOPNOTSUPP : 0;
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_L2_DIST_ADDR, pa);
+    return 0;
+}
+
+static int l2_mmio_set_sg(struct l2_engine *eng, const struct l2_sg_table *sg)
+{
+    if (!(eng->cfg.caps & L2_CAP_SG))
+        return sg ? -EOPNOTSUPP : 0;
+    cxl_wr(l2_mmio_dev(eng), CXL_REG_L2_SG_ADDR, sg ? sg->desc_pa : 0);
+    return 0;
+}
+
+static u64 l2_mmio_read_resp(struct l2_engine *eng)
+{
+    return cxl_rd(l2_mmio_dev(eng), CXL_REG_L2_RESP);
+}
+
+static u64 l2_mmio_read_delay(struct l2_engine *eng)
+{
+    return cxl_rd(l2_mmio_dev(eng), CXL_REG_L2_DELAY);
+}
+
+static irqreturn_t l2_mmio_irq(int irq, void *data)
+{
+    struct l2_mmio *m = data;
+
+    complete(&m->done);
+    return IRQ_HANDLED;
+}
+
+static int l2_mmio_wait_irq(struct l2_engine *eng, u64 timeout_ns)
+{
+    struct l2_mmio *m = eng->priv;
+    unsigned long tmo = nsecs_to_jiffies(timeout_ns) + 1;
+
+    if (m->irq <= 0)
+        return -EOPNOTSUPP;
+    return wait_for_completion_timeout(&m->done, tmo) ? 0 : -ETIMEDOUT;
+}
+
+/*
+ * Hook the engine's done MSI on the board the PCI driver bound; if it has
+ * no MSI capability or the vector cannot be requested we keep polling.
+ */
+static void l2_mmio_setup_irq(struct l2_mmio *m)
+{
+    int rc;
+
+    init_completion(&m->done);
+    m->pdev = m->dev->pdev;
+
+    rc = pci_alloc_irq_vectors(m->pdev, 1, 1, PCI_IRQ_MSI);
+    if (rc < 0) {
+        pr_warn("l2_engine: %s: MSI allocation failed (%d), polling for completion\n",
+                pci_name(m->pdev), rc);
+        return;
+    }
+
+    rc = request_irq(pci_irq_vector(m->pdev, 0), l2_mmio_irq, 0, "l2_engine", m);
+    if (rc) {
+        pr_warn("l2_engine: %s: request_irq failed (%d), polling for completion\n",
+                pci_name(m->pdev), rc);
+        pci_free_irq_vectors(m->pdev);
+        return;
+    }
+
+    m->irq = pci_irq_vector(m->pdev, 0);
+    pr_info("l2_engine: %s: completion via MSI irq %d\n", pci_name(m->pdev), m->irq);
+}
+
+static void l2_mmio_release(struct l2_engine *eng)
+{
+    struct l2_mmio *m = eng->priv;
+
+    if (m->irq > 0) {
+        free_irq(m->irq, m);
+        pci_free_irq_vectors(m->pdev);
+    }
+    kfree(m);
+}
+
+static const struct l2_engine_ops l2_mmio_ops = {
+    .name        = "fpga",
+    .set_base    = l2_mmio_set_base,
+    .set_query   = l2_mmio_set_query,
+    .set_num_req = l2_mmio_set_num_req,
+    .set_dim     = l2_mmio_set_dim,
+    .start       = l2_mmio_start,
+    .stop        = l2_mmio_stop,
+    .read_resp   = l2_mmio_read_resp,
+    .read_delay  = l2_mmio_read_delay,
+    .set_dist_out = l2_mmio_set_dist_out,
+    .set_sg      = l2_mmio_set_sg,
+    .wait_irq    = l2_mmio_wait_irq,
+    .release     = l2_mmio_release,
+};
+
+int l2_engine_mmio_create(struct l2_engine *eng)
+{
+    struct l2_mmio *m = kzalloc(sizeof(*m), GFP_KERNEL);
+
+    if (!m)
+        return -ENOMEM;
+
+    // BAR_1 is mapped once per board by the PCI driver at module init
+    m->dev = cxl_dev_get_nth(eng->index);
+    if (!m->dev) {
+        pr_err("l2_engine: no FPGA bound for engine %u\n", eng->index);
+        kfree(m);
+        return -ENODEV;
+    }
+
+    if (eng->cfg.use_irq)
+        l2_mmio_setup_irq(m);
+
+    eng->ops  = &l2_mmio_ops;
+    eng->priv = m;
+    return 0;
+}
+
+// ---------- Completion wait ----------
+static u64 l2_cycles_to_ns(const struct l2_engine *eng, u64 cycles)
+{
+    return eng->cfg.clk_mhz ? div_u64(cycles * 1000ull, eng->cfg.clk_mhz) : 0;
+}
+
+// Expected batch time from the previous batches' DELAY per vector
+static u64 l2_engine_expect_ns(const struct l2_engine *eng, u64 num_vecs)
+{
+    return l2_cycles_to_ns(eng, div_u64(eng->est_cpv_x1000 * num_vecs, 1000));
+}
+
+static inline bool l2_done(struct l2_engine *eng, u64 *resp)
+{
+    *resp = eng->ops->read_resp(eng);
+    return *resp & L2_RESP_DONE;
+}
+
+/*
+ * Hybrid wait: sleep through the bulk of a batch we expect to be long,
+ * busy-poll RESP for spin_us around the expected finish, then back off
+ * with growing hrtimer sleeps (usleep_range) until timeout_ms.
+ */
+static int l2_engine_wait(struct l2_engine *eng, u64 num_vecs, u64 *resp)
+{
+    u64 expect_ns = l2_engine_expect_ns(eng, num_vecs);
+    u64 spin_ns   = (u64)eng->cfg.spin_us * NSEC_PER_USEC;
+    ktime_t deadline = ktime_add_ns(ktime_get(), (u64)eng->cfg.timeout_ms * NSEC_PER_MSEC);
+    unsigned long sleep_us = L2_POLL_SLEEP_MIN_US;
+    ktime_t spin_end;
+
+    if (eng->cfg.use_irq && eng->ops->wait_irq &&
+        !eng->ops->wait_irq(eng, expect_ns * 2 + NSEC_PER_MSEC)) {
+        eng->stats.irqs++;
+        if (l2_done(eng, resp))
+            return 0;
+    }
+
+    if (expect_ns > 2 * spin_ns) {
+        unsigned long us = div_u64(expect_ns - spin_ns, NSEC_PER_USEC);
+
+        usleep_range(us, us + us / 16 + 1);
+        eng->stats.sleeps++;
+    }
+
+    spin_end = ktime_add_ns(ktime_get(), spin_ns);
+    do {
+        eng->stats.spins++;
+        if (l2_done(eng, resp))
+            return 0;
+        cpu_relax();
+    } while (ktime_before(ktime_get(), spin_end));
+
+    for (;;) {
+        if (l2_done(eng, resp))
+            return 0;
+        if (ktime_after(ktime_get(), deadline))
+            return -ETIMEDOUT;
+
+        usleep_range(sleep_us, sleep_us + sleep_us / 4 + 1);
+        eng->stats.sleeps++;
+        sleep_us = min_t(unsigned long, sleep_us * 2, L2_POLL_SLEEP_MAX_US);
+    }
+}
+
+static void l2_engine_account(struct l2_engine *eng, u64 num_vecs, u64 cycles, u64 wall_ns)
+{
+    struct l2_wait_stats *st = &eng->stats;
+    u64 dev_ns = l2_cycles_to_ns(eng, cycles);
+    u64 tax_ns = wall_ns > dev_ns ? wall_ns - dev_ns : 0;
+
+    st->batches++;
+    st->wall_ns += wall_ns;
+    st->dev_ns  += dev_ns;
+    st->hist_wall[wall_ns ? min(ilog2(wall_ns), L2_HIST_BUCKETS - 1) : 0]++;
+    st->hist_tax[tax_ns ? min(ilog2(tax_ns), L2_HIST_BUCKETS - 1) : 0]++;
+
+    // Running DELAY-per-vector estimate (EWMA, 1/4 weight on the new batch)
+    if (num_vecs) {
+        u64 cpv = div64_u64(cycles * 1000ull, num_vecs);
+
+        eng->est_cpv_x1000 = eng->est_cpv_x1000 ?
+            (eng->est_cpv_x1000 * 3 + cpv) / 4 : cpv;
+    }
+}
+
+void l2_engine_reset_stats(struct l2_engine *eng)
+{
+    memset(&eng->stats, 0, sizeof(eng->stats));
+}
+EXPORT_SYMBOL(l2_engine_reset_stats);
+
+void l2_engine_dump_stats(struct l2_engine *eng)
+{
+    const struct l2_wait_stats *st = &eng->stats;
+    int b;
+
+    if (!st->batches)
+        return;
+
+    pr_info("l2_engine: batches=%llu wall_ns=%llu dev_ns=%llu poll_tax_ns=%llu spins=%llu sleeps=%llu irqs=%llu\n",
+            st->batches, st->wall_ns, st->dev_ns,
+            st->wall_ns > st->dev_ns ? st->wall_ns - st->dev_ns : 0,
+            st->spins, st->sleeps, st->irqs);
+    if (st->verified)
+        pr_info("l2_engine: verify checked=%llu mismatches=%llu\n", st->verified, st->mismatches);
+    for (b = 0; b < L2_HIST_BUCKETS; b++) {
+        if (!st->hist_wall[b] && !st->hist_tax[b])
+            continue;
+        pr_info("l2_engine: [%2d] ns>=%-12llu wall=%-8llu tax=%llu\n",
+                b, 1ull << b, st->hist_wall[b], st->hist_tax[b]);
+    }
+}
+EXPORT_SYMBOL(l2_engine_dump_stats);
+
+// ---------- Common driver ----------
+static const void *l2_job_vec(const struct l2_job *job, u64 v)
+{
+    if (job->sg)
+        return l2_sg_vec(job->sg, v);
+    return (const u8 *)job->base_va + v * job->dim * l2_elem_size(job->elem);
+}
+
+static const void *l2_job_query(const struct l2_job *job, u32 q)
+{
+    return (const u8 *)job->query_va + (size_t)q * job->query_stride;
+}
+
+static void l2_engine_check(struct l2_engine *eng, const struct l2_job *job,
+                            u32 q, u64 v, u64 got, u64 mask)
+{
+    u64 want = l2_dist(l2_job_vec(job, v), l2_job_query(job, q), job->dim, job->elem) & mask;
+
+    eng->stats.verified++;
+    if (got == want)
+        return;
+    eng->stats.mismatches++;
+    pr_err_ratelimited("l2_engine: verify mismatch batch=%llu q=%u vec=%llu engine=%llu cpu=%llu\n",
+                       eng->stats.batches, q, v, got, want);
+}
+
+/*
+ * Verify mode: recompute on the CPU the last vector of the batch (the one
+ * RESP reports) and cfg.verify randomly sampled vectors from the engine's
+ * distance buffer, when it wrote one.
+ */
+static void l2_engine_verify(struct l2_engine *eng, const struct l2_job *job, u32 nq,
+                             u64 resp, bool dev_dist)
+{
+    const struct l2_engine_ops *ops = eng->ops;
+    u32 q, i;
+
+    if ((!job->base_va && !job->sg) || !job->query_va || !job->num_vecs)
+        return;
+
+    for (q = 0; q < nq; q++) {
+        u64 r = nq > 1 ? ops->read_query_resp(eng, q) : resp;
+
+        l2_engine_check(eng, job, q, job->num_vecs - 1, r >> 1, U64_MAX >> 1);
+    }
+
+    if (!dev_dist)
+        return;
+    for (i = 0; i < eng->cfg.verify; i++) {
+        u64 v = get_random_u32_below(min_t(u64, job->num_vecs, U32_MAX));
+
+        for (q = 0; q < nq; q++)
+            l2_engine_check(eng, job, q, v, job->dist[(u64)q * job->num_vecs + v], U64_MAX);
+    }
+}
+
+// Per-vector distances for backends that only report the last one
+static void l2_engine_host_dist(const struct l2_job *job, u32 nq)
+{
+    u64 v;
+    u32 q;
+
+    for (q = 0; q < nq; q++) {
+        const void *qv = l2_job_query(job, q);
+        u64 *out = job->dist + (u64)q * job->num_vecs;
+
+        for (v = 0; v < job->num_vecs; v++) {
+            out[v] = l2_dist(l2_job_vec(job, v), qv, job->dim, job->elem);
+            if ((v & 1023) == 1023)
+                cond_resched();
+        }
+    }
+}
+
+static int l2_engine_run_one(struct l2_engine *eng, const struct l2_job *job, u32 nq,
+                             u64 *cycles, u64 *resp)
+{
+    const struct l2_engine_ops *ops = eng->ops;
+    bool host_dist = false, native_topk = false;
+    ktime_t t_csr = ktime_get(), t0, t1;
+    u64 vecs = job->num_vecs * nq, ns;
+    u64 r = 0;
+    u32 q;
+    int rc;
+
+    // The FPGA datapath is Q16.16 only
+    if (job->elem != L2_ELEM_Q16 &&
+        (!ops->set_elem || ops->set_elem(eng, job->elem))) {
+        pr_err("l2_engine: %s backend does not support %s vectors\n",
+               ops->name, l2_elem_name(job->elem));
+        return -EOPNOTSUPP;
+    }
+    if (job->elem == L2_ELEM_Q16 && ops->set_elem)
+        ops->set_elem(eng, L2_ELEM_Q16);
+
+    ops->set_base(eng, job->base_pa, job->base_va);
+    ops->set_query(eng, job->query_pa, job->query_va);
+    ops->set_num_req(eng, job->num_vecs);
+    ops->set_dim(eng, job->dim);
+    if (ops->set_num_query)
+        ops->set_num_query(eng, nq, job->query_stride);
+    if (ops->set_dist_out)
+        host_dist = ops->set_dist_out(eng, job->dist ? job->dist_pa : 0, job->dist) != 0;
+    else
+        host_dist = job->dist != NULL;
+    if (host_dist && ((!job->base_va && !job->sg) || !job->query_va))
+        return -EOPNOTSUPP;
+    if (ops->set_sg && ops->set_sg(eng, job->sg) && job->sg)
+        return -EOPNOTSUPP;
+    if (ops->set_topk)
+        native_topk = !ops->set_topk(eng, job->topk, nq, job->id_base) && job->topk;
+    if (job->topk && !native_topk && !job->dist)
+        return -EINVAL;
+
+    t0 = ktime_get();
+    ns = ktime_to_ns(ktime_sub(t0, t_csr));
+    l2_stats_phase(L2_PH_CSR, ns);
+    trace_l2_csr(job->num_vecs, nq, ns);
+    ops->start(eng);
+
+    rc = l2_engine_wait(eng, vecs, &r);
+    if (rc) {
+        ops->stop(eng);
+        return rc;
+    }
+    t1 = ktime_get();
+    ns = ktime_to_ns(ktime_sub(t1, t0));
+    l2_stats_phase(L2_PH_WAIT, ns);
+    trace_l2_wait(job->num_vecs, nq, ns);
+
+    *cycles = ops->read_delay(eng);
+    *resp   = r;
+    if (job->last_l2) {
+        for (q = 0; q < nq; q++)
+            job->last_l2[q] = (nq > 1 ? ops->read_query_resp(eng, q) : r) >> 1;
+    }
+    l2_engine_account(eng, vecs, *cycles, ktime_to_ns(ktime_sub(ktime_get(), t0)));
+    if (eng->cfg.verify)
+        l2_engine_verify(eng, job, nq, r, job->dist && !host_dist);
+    ops->stop(eng);
+
+    // Outside the timed window: this is host work, not engine time
+    if (host_dist) {
+        pr_info_once("l2_engine: %s backend has no distance writeback, computing distances on the host\n",
+                     ops->name);
+        l2_engine_host_dist(job, nq);
+    }
+    if (job->topk && !native_topk) {
+        for (q = 0; q < nq; q++)
+            l2_topk_merge(&job->topk[q], job->dist + (u64)q * job->num_vecs,
+                          job->num_vecs, job->id_base);
+    }
+
+    // Readback: everything between RESP done and the results being usable
+    ns = ktime_to_ns(ktime_sub(ktime_get(), t1));
+    l2_stats_phase(L2_PH_READBACK, ns);
+    trace_l2_readback(job->num_vecs, nq, ns);
+    return 0;
+}
+
+/*
+ * One single-query launch per query over the vectors one->base_* points
+ * at, which start off vectors into job. last says whether they end the
+ * batch, i.e. whether their RESP is the batch's per-query last distance.
+ */
+static int l2_engine_run_split(struct l2_engine *eng, const struct l2_job *job,
+                               struct l2_job *one, u64 off, bool last,
+                               u64 *cycles, u64 *resp)
+{
+    u32 nq = max_t(u32, job->num_queries, 1);
+    u64 c, r;
+    u32 q;
+    int rc;
+
+    one->num_queries = 1;
+    one->last_l2     = NULL;
+    one->id_base     = job->id_base + off;
+    for (q = 0; q < nq; q++) {
+        u64 d = (u64)q * job->num_vecs + off;
+
+        one->query_pa = job->query_pa + (phys_addr_t)q * job->query_stride;
+        one->query_va = job->query_va ? (const u8 *)job->query_va + (size_t)q * job->query_stride : NULL;
+        if (job->dist) {
+            one->dist    = job->dist + d;
+            one->dist_pa = job->dist_pa + (phys_addr_t)d * sizeof(u64);
+        }
+        if (job->topk)
+            one->topk = job->topk + q;
+
+        rc = l2_engine_run_one(eng, one, 1, &c, &r);
+        if (rc)
+            return rc;
+        *cycles += c;
+        *resp    = r;
+        if (last && job->last_l2)
+            job->last_l2[q] = r >> 1;
+    }
+    return 0;
+}
+
+int l2_engine_run(struct l2_engine *eng, const struct l2_job *job,
+                  u64 *cycles, u64 *resp)
+{
+    const struct l2_engine_ops *ops = eng->ops;
+    u32 nq = max_t(u32, job->num_queries, 1);
+    struct l2_job one;
+    u64 off = 0;
+    u32 i;
+    int rc;
+
+    *cycles = 0;
+    one = *job;
+
+    // No scatter-gather: one launch per chunk (and per query, so dist keeps its layout)
+    if (job->sg && (!ops->set_sg || ops->set_sg(eng, job->sg))) {
+        const struct l2_sg_table *sg = job->sg;
+
+        one.sg = NULL;
+        for (i = 0; i < sg->used; i++) {
+            one.base_pa  = sg->chunks[i].dev_pa;
+            one.base_va  = sg->chunks[i].va;
+            one.num_vecs = sg->chunks[i].nvecs;
+            rc = l2_engine_run_split(eng, job, &one, off, i + 1 == sg->used, cycles, resp);
+            if (rc)
+                return rc;
+            off += sg->chunks[i].nvecs;
+        }
+        return 0;
+    }
+
+    if (nq == 1 || ops->set_num_query)
+        return l2_engine_run_one(eng, job, nq, cycles, resp);
+
+    // No native multi-query: one launch per query against the same batch
+    return l2_engine_run_split(eng, job, &one, 0, true, cycles, resp);
+}
+EXPORT_SYMBOL(l2_engine_run);
+
+int l2_engine_init(const struct l2_engine_cfg *cfg)
+{
+    const char *name = cfg->name;
+    bool fpga = !name || !strcmp(name, "fpga");
+    int (*create)(struct l2_engine *eng);
+    u32 n, i;
+    int rc;
+
+    if (fpga)
+        create = l2_engine_mmio_create;
+    else if (!strcmp(name, "sw"))
+        create = l2_engine_sw_create;
+    else if (!strcmp(name, "cpu"))
+        create = l2_engine_cpu_create;
+    else {
+        pr_err("l2_engine: unknown engine '%s' (expected fpga|sw|cpu)\n", name);
+        return -EINVAL;
+    }
+
+    // One engine per bound board; the CPU models run as many as asked for
+    n = fpga ? cxl_dev_count() : max_t(u32, cfg->count, 1);
+    n = min_t(u32, n, L2_MAX_ENGINES);
+    if (!n) {
+        pr_err("l2_engine: no FPGA bound\n");
+        return -ENODEV;
+    }
+
+    for (i = 0; i < n; i++) {
+        struct l2_engine *eng = &l2_engs[i];
+
+        eng->cfg   = *cfg;
+        eng->index = i;
+        if (!eng->cfg.timeout_ms)
+            eng->cfg.timeout_ms = 60000;
+
+        rc = create(eng);
+        if (rc) {
+            memset(eng, 0, sizeof(*eng));
+            l2_engine_exit();
+            return rc;
+        }
+        l2_neng = i + 1;
+    }
+
+    pr_info("l2_engine: using %s backend, %u engine(s)\n", l2_engs[0].ops->name, l2_neng);
+    return 0;
+}
+
+void l2_engine_exit(void)
+{
+    u32 i;
+
+    for (i = 0; i < l2_neng; i++) {
+        if (l2_engs[i].ops && l2_engs[i].ops->release)
+            l2_engs[i].ops->release(&l2_engs[i]);
+        memset(&l2_engs[i], 0, sizeof(l2_engs[i]));
+    }
+    l2_neng = 0;
+}
+
+u32 l2_engine_count(void)
+{
+    return l2_neng;
+}
+EXPORT_SYMBOL(l2_engine_count);
+
+struct l2_engine *l2_engine_get_nth(u32 i)
+{
+    return i < l2_neng ? &l2_engs[i] : NULL;
+}
+EXPORT_SYMBOL(l2_engine_get_nth);
+
+struct l2_engine *l2_engine_get(void)
+{
+    return l2_engine_get_nth(0);
+}
+EXPORT_SYMBOL(l2_engine_get);
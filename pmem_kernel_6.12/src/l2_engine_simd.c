@@ -0,0 +1,166 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#endif
+
+#include "l2_engine.h"
+
+/*
+ * Vectorised Q16.16 distance kernels for the "cpu" backend.
+ *
+ * Element differences are widened to 64-bit lanes before squaring and
+ * summed in u64 lanes, so results are bit-identical to l2_dist_q16() (and
+ * the FPGA), wrap-around included. The file is built with the FPU flags;
+ * vector code may only run between l2_simd_begin() and l2_simd_end().
+ *
+ * The PQ8 kernel gathers four lookup-table entries per instruction; sums
+ * are in u64 lanes, so it matches l2_dist_pq() exactly.
+ */
+
+#ifdef CONFIG_X86_64
+typedef s32 l2_v4si __attribute__((vector_size(16), aligned(4)));
+typedef s32 l2_v8si __attribute__((vector_size(32), aligned(4)));
+typedef s64 l2_v4di __attribute__((vector_size(32)));
+typedef u64 l2_v4du __attribute__((vector_size(32)));
+typedef s64 l2_v8di __attribute__((vector_size(64)));
+typedef u64 l2_v8du __attribute__((vector_size(64)));
+
+static __attribute__((target("avx2")))
+u64 l2_dist_q16_avx2(const s32 *v, const s32 *q, u32 dim)
+{
+    l2_v4du acc0 = { 0 }, acc1 = { 0 };
+    u64 acc;
+    u32 i = 0;
+
+    for (; i + 8 <= dim; i += 8) {
+        l2_v4du d0 = (l2_v4du)(__builtin_convertvector(*(const l2_v4si *)(v + i), l2_v4di) -
+                               __builtin_convertvector(*(const l2_v4si *)(q + i), l2_v4di));
+        l2_v4du d1 = (l2_v4du)(__builtin_convertvector(*(const l2_v4si *)(v + i + 4), l2_v4di) -
+                               __builtin_convertvector(*(const l2_v4si *)(q + i + 4), l2_v4di));
+
+        acc0 += d0 * d0;
+        acc1 += d1 * d1;
+    }
+    acc0 += acc1;
+    acc = acc0[0] + acc0[1] + acc0[2] + acc0[3];
+
+    for (; i < dim; i++) {
+        s64 d = (s64)v[i] - (s64)q[i];
+
+        acc += (u64)(d * d);
+    }
+    return acc;
+}
+
+static __attribute__((target("avx512f")))
+u64 l2_dist_q16_avx512(const s32 *v, const s32 *q, u32 dim)
+{
+    l2_v8du acc0 = { 0 }, acc1 = { 0 };
+    u64 acc = 0;
+    u32 i = 0, l;
+
+    for (; i + 16 <= dim; i += 16) {
+        l2_v8du d0 = (l2_v8du)(__builtin_convertvector(*(const l2_v8si *)(v + i), l2_v8di) -
+                               __builtin_convertvector(*(const l2_v8si *)(q + i), l2_v8di));
+        l2_v8du d1 = (l2_v8du)(__builtin_convertvector(*(const l2_v8si *)(v + i + 8), l2_v8di) -
+                               __builtin_convertvector(*(const l2_v8si *)(q + i + 8), l2_v8di));
+
+        acc0 += d0 * d0;
+        acc1 += d1 * d1;
+    }
+    acc0 += acc1;
+    for (l = 0; l < 8; l++)
+        acc += acc0[l];
+
+    for (; i < dim; i++) {
+        s64 d = (s64)v[i] - (s64)q[i];
+
+        acc += (u64)(d * d);
+    }
+    return acc;
+}
+
+static __attribute__((target("avx2")))
+u64 l2_dist_pq_avx2(const u8 *code, const u64 *lut, u32 m)
+{
+    const l2_v4si row = { 0, 256, 512, 768 };
+    const l2_v4di all = { -1, -1, -1, -1 };
+    l2_v4du acc0 = { 0 }, acc1 = { 0 };
+    u64 acc;
+    u32 i = 0;
+
+    for (; i + 8 <= m; i += 8) {
+        l2_v4si i0 = { code[i],     code[i + 1], code[i + 2], code[i + 3] };
+        l2_v4si i1 = { code[i + 4], code[i + 5], code[i + 6], code[i + 7] };
+
+        i0 += row + (s32)(i * 256);
+        i1 += row + (s32)((i + 4) * 256);
+        acc0 += (l2_v4du)__builtin_ia32_gathersiv4di((l2_v4di){ 0 }, (const long long *)lut, i0, all, 8);
+        acc1 += (l2_v4du)__builtin_ia32_gathersiv4di((l2_v4di){ 0 }, (const long long *)lut, i1, all, 8);
+    }
+    acc0 += acc1;
+    acc = acc0[0] + acc0[1] + acc0[2] + acc0[3];
+
+    for (; i < m; i++)
+        acc += lut[i * 256 + code[i]];
+    return acc;
+}
+#endif
+
+/*
+ * Widest kernel this CPU and the kernel's xsave setup allow; the scalar
+ * model otherwise. *fpu tells the caller whether it must bracket calls
+ * with l2_simd_begin()/l2_simd_end().
+ */
+l2_dist_q16_fn l2_simd_select(const char **name, bool *fpu)
+{
+#ifdef CONFIG_X86_64
+    if (boot_cpu_has(X86_FEATURE_AVX512F) &&
+        cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM | XFEATURE_MASK_AVX512, NULL)) {
+        *name = "avx512";
+        *fpu  = true;
+        return l2_dist_q16_avx512;
+    }
+    if (boot_cpu_has(X86_FEATURE_AVX2) &&
+        cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL)) {
+        *name = "avx2";
+        *fpu  = true;
+        return l2_dist_q16_avx2;
+    }
+#endif
+    *name = "scalar";
+    *fpu  = false;
+    return l2_dist_q16;
+}
+
+l2_dist_pq_fn l2_simd_select_pq(const char **name, bool *fpu)
+{
+#ifdef CONFIG_X86_64
+    if (boot_cpu_has(X86_FEATURE_AVX2) &&
+        cpu_has_xfeatures(XFEATURE_MASK_SSE | XFEATURE_MASK_YMM, NULL)) {
+        *name = "avx2";
+        *fpu  = true;
+        return l2_dist_pq_avx2;
+    }
+#endif
+    *name = "scalar";
+    *fpu  = false;
+    return l2_dist_pq;
+}
+
+void l2_simd_begin(void)
+{
+#ifdef CONFIG_X86_64
+    kernel_fpu_begin();
+#endif
+}
+
+void l2_simd_end(void)
+{
+#ifdef CONFIG_X86_64
+    kernel_fpu_end();
+#endif
+}
@@ -0,0 +1,491 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/types.h>
+
+#include "l2_engine.h"
+#include "l2_pool.h"
+#include "l2_topk.h"
+
+/*
+ * Software model of the L2 engine.
+ *
+ * Keeps a shadow of the CSRs the FPGA exposes and computes the batch on the
+ * CPU when START is raised. Distances follow the hardware: squared L2 over
+ * signed Q16.16 int32 elements, accumulated in 64 bits, with the last
+ * vector's result reported in RESP[63:1]. The model additionally accepts
+ * int8 and fp16 vectors, and PQ8 codes against per-query lookup tables.
+ * DELAY reports the measured compute time converted to cycles at clk_mhz.
+ *
+ * The model also implements multi-query natively: each base vector is
+ * loaded once and compared against the whole query block. Scatter-gather
+ * batches are walked chunk by chunk, as the FPGA walks the descriptors.
+ *
+ * The "cpu" backend is the same model with Q16.16 distances computed by
+ * the AVX2/AVX-512 kernels in l2_engine_simd.c; it serves as the CPU
+ * baseline and as the fallback when no FPGA is present. It splits each
+ * batch across a worker pool on the CPUs nearest the CXL node; every
+ * worker keeps its own partial top-k, merged once the batch is done.
+ */
+
+// Vectors per kernel_fpu section; keeps preemption-off stretches short
+#define L2_SW_CHUNK 1024
+
+struct l2_sw {
+    u32         clk_mhz;
+
+    const u8   *base;
+    const struct l2_sg_table *sg;   /* base gathered from chunks when set */
+    const u8   *query;
+    u64         num_req;
+    u32         dim;
+    enum l2_elem elem;
+    u32         nq;
+    u32         qstride;        /* in bytes */
+    u64        *last;           /* per-query last distance */
+    u64        *dist;           /* optional per-vector output */
+
+    l2_dist_q16_fn dist_q16;    /* scalar or vectorised Q16.16 kernel */
+    bool        fpu;            /* dist_q16 needs l2_simd_begin/end */
+    l2_dist_pq_fn dist_pq;      /* ... and PQ8 lookup-sum kernel */
+    bool        pq_fpu;
+
+    // Native top-k for the current launch
+    struct l2_topk *tk;
+    u64         id_base;
+
+    // Worker pool ("cpu" backend) and one partial top-k per worker x query
+    struct l2_pool *pool;
+    struct l2_topk *wtk;
+    u32         wtk_nq;
+    u32         wtk_k;
+
+    bool        running;
+    u64         resp;
+    u64         delay;
+};
+
+u64 l2_dist_q16(const s32 *v, const s32 *q, u32 dim)
+{
+    u64 acc = 0;
+    u32 i;
+
+    for (i = 0; i < dim; i++) {
+        s64 d = (s64)v[i] - (s64)q[i];
+
+        acc += (u64)(d * d);
+    }
+    return acc;
+}
+EXPORT_SYMBOL(l2_dist_q16);
+
+static u64 l2_dist_i8(const s8 *v, const s8 *q, u32 dim)
+{
+    u64 acc = 0;
+    u32 i;
+
+    for (i = 0; i < dim; i++) {
+        s32 d = (s32)v[i] - (s32)q[i];
+
+        acc += (u32)(d * d);
+    }
+    return acc;
+}
+
+// IEEE half -> Q16.16, rounding to nearest; Inf/NaN saturate to +-65504
+static s64 l2_fp16_to_q16(u16 h)
+{
+    u32 exp = (h >> 10) & 0x1f;
+    u32 man = h & 0x3ff;
+    s64 mag;
+
+    if (exp == 0x1f) {
+        exp = 0x1e;
+        man = 0x3ff;
+    }
+    if (exp == 0) {
+        mag = (man + 0x80) >> 8;        /* subnormal: man * 2^-24 */
+    } else {
+        u32 m = man | 0x400;            /* value = m * 2^(exp - 25) */
+
+        mag = exp >= 9 ? (s64)m << (exp - 9) : (m + (1u << (8 - exp))) >> (9 - exp);
+    }
+    return (h & 0x8000) ? -mag : mag;
+}
+
+static u64 l2_dist_f16(const u16 *v, const u16 *q, u32 dim)
+{
+    u64 acc = 0;
+    u32 i;
+
+    for (i = 0; i < dim; i++) {
+        s64 d = l2_fp16_to_q16(v[i]) - l2_fp16_to_q16(q[i]);
+
+        acc += (u64)(d * d);
+    }
+    return acc;
+}
+
+u64 l2_dist_pq(const u8 *code, const u64 *lut, u32 m)
+{
+    u64 acc = 0;
+    u32 i;
+
+    for (i = 0; i < m; i++)
+        acc += lut[i * 256 + code[i]];
+    return acc;
+}
+EXPORT_SYMBOL(l2_dist_pq);
+
+u64 l2_dist(const void *v, const void *q, u32 dim, enum l2_elem elem)
+{
+    switch (elem) {
+    case L2_ELEM_INT8:
+        return l2_dist_i8(v, q, dim);
+    case L2_ELEM_PQ8:
+        return l2_dist_pq(v, q, dim);
+    case L2_ELEM_FP16:
+        return l2_dist_f16(v, q, dim);
+    default:
+        return l2_dist_q16(v, q, dim);
+    }
+}
+EXPORT_SYMBOL(l2_dist);
+
+static void l2_sw_set_base(struct l2_engine *eng, phys_addr_t pa, const void *va)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->base = va ? va : phys_to_virt(pa);
+}
+
+static void l2_sw_set_query(struct l2_engine *eng, phys_addr_t pa, const void *va)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->query = va ? va : phys_to_virt(pa);
+}
+
+static void l2_sw_set_num_req(struct l2_engine *eng, u64 num_vecs)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->num_req = num_vecs;
+}
+
+static void l2_sw_set_dim(struct l2_engine *eng, u32 dim)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->dim = dim;
+}
+
+static int l2_sw_set_elem(struct l2_engine *eng, enum l2_elem elem)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->elem = elem;
+    return 0;
+}
+
+static void l2_sw_set_num_query(struct l2_engine *eng, u32 nq, u32 stride)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->nq      = clamp_t(u32, nq, 1, L2_MAX_QUERY_BLOCK);
+    sw->qstride = stride;
+}
+
+static int l2_sw_set_dist_out(struct l2_engine *eng, phys_addr_t pa, u64 *va)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->dist = pa || va ? (va ? va : phys_to_virt(pa)) : NULL;
+    return 0;
+}
+
+static int l2_sw_set_sg(struct l2_engine *eng, const struct l2_sg_table *sg)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->sg = sg;
+    return 0;
+}
+
+// Vector n and the end of the contiguous run holding it
+static const u8 *l2_sw_vec(const struct l2_sw *sw, u64 n, u32 vec_bytes, u64 *seg_end)
+{
+    u64 off = 0;
+    u32 i;
+
+    if (!sw->sg) {
+        *seg_end = U64_MAX;
+        return sw->base + n * vec_bytes;
+    }
+    for (i = 0; i + 1 < sw->sg->used && n >= off + sw->sg->chunks[i].nvecs; i++)
+        off += sw->sg->chunks[i].nvecs;
+    *seg_end = off + sw->sg->chunks[i].nvecs;
+    return (const u8 *)sw->sg->chunks[i].va + (n - off) * vec_bytes;
+}
+
+// Compare vectors [begin, end) against every query; tk is this caller's heaps
+static void l2_sw_range(struct l2_sw *sw, u64 begin, u64 end, struct l2_topk *tk)
+{
+    u32 vec_bytes = sw->dim * l2_elem_size(sw->elem);
+    u32 nq = sw->nq ? sw->nq : 1, q;
+    bool fpu = (sw->fpu && sw->elem == L2_ELEM_Q16) ||
+               (sw->pq_fpu && sw->elem == L2_ELEM_PQ8);
+    u64 n, stop, seg_end;
+
+    for (n = begin; n < end; n = stop) {
+        const u8 *v = l2_sw_vec(sw, n, vec_bytes, &seg_end);
+
+        stop = min3(n + L2_SW_CHUNK, end, seg_end);
+        if (fpu)
+            l2_simd_begin();
+        for (; n < stop; n++, v += vec_bytes) {
+            const u8 *qv = sw->query;
+
+            for (q = 0; q < nq; q++, qv += sw->qstride) {
+                u64 d;
+
+                if (sw->elem == L2_ELEM_Q16)
+                    d = sw->dist_q16((const s32 *)v, (const s32 *)qv, sw->dim);
+                else if (sw->elem == L2_ELEM_PQ8)
+                    d = sw->dist_pq(v, (const u64 *)qv, sw->dim);
+                else
+                    d = l2_dist(v, qv, sw->dim, sw->elem);
+
+                if (sw->dist)
+                    sw->dist[q * sw->num_req + n] = d;
+                if (tk)
+                    l2_topk_push(&tk[q], sw->id_base + n, d);
+                if (n == sw->num_req - 1)
+                    sw->last[q] = d;
+            }
+        }
+        if (fpu)
+            l2_simd_end();
+        cond_resched();
+    }
+}
+
+static void l2_sw_work(void *arg, u32 idx, u32 nr)
+{
+    struct l2_sw *sw = arg;
+    u64 begin = div_u64(sw->num_req * idx, nr);
+    u64 end   = div_u64(sw->num_req * (idx + 1), nr);
+
+    l2_sw_range(sw, begin, end, sw->tk ? &sw->wtk[idx * sw->wtk_nq] : NULL);
+}
+
+static void l2_sw_free_wtk(struct l2_sw *sw)
+{
+    u32 i;
+
+    if (!sw->wtk)
+        return;
+    for (i = 0; i < l2_pool_size(sw->pool) * sw->wtk_nq; i++)
+        l2_topk_free(&sw->wtk[i]);
+    kvfree(sw->wtk);
+    sw->wtk    = NULL;
+    sw->wtk_nq = 0;
+    sw->wtk_k  = 0;
+}
+
+// Per-worker heaps are sized for the largest (nq, k) seen so far
+static int l2_sw_set_topk(struct l2_engine *eng, struct l2_topk *tk, u32 nq, u64 id_base)
+{
+    struct l2_sw *sw = eng->priv;
+    u32 nr, i, k;
+
+    sw->tk      = tk;
+    sw->id_base = id_base;
+    if (!tk || !sw->pool)
+        return 0;
+
+    k = tk[0].k;
+    if (sw->wtk && nq <= sw->wtk_nq && k == sw->wtk_k)
+        return 0;
+
+    l2_sw_free_wtk(sw);
+    nr = l2_pool_size(sw->pool);
+    sw->wtk = kvcalloc((size_t)nr * nq, sizeof(*sw->wtk), GFP_KERNEL);
+    if (!sw->wtk)
+        goto err;
+    sw->wtk_nq = nq;
+    sw->wtk_k  = k;
+    for (i = 0; i < nr * nq; i++) {
+        if (l2_topk_init(&sw->wtk[i], k))
+            goto err;
+    }
+    return 0;
+
+err:
+    l2_sw_free_wtk(sw);
+    sw->tk = NULL;
+    return -ENOMEM;
+}
+
+static void l2_sw_start(struct l2_engine *eng)
+{
+    struct l2_sw *sw = eng->priv;
+    u32 nq = sw->nq ? sw->nq : 1, q, w;
+    ktime_t t0;
+    s64 ns;
+
+    if (sw->running)
+        return;
+    sw->running = true;
+
+    t0 = ktime_get();
+    if (!sw->pool || sw->num_req < L2_SW_CHUNK) {
+        l2_sw_range(sw, 0, sw->num_req, sw->tk);
+    } else {
+        l2_pool_run(sw->pool, l2_sw_work, sw);
+
+        // Workers are done: fold their partial heaps in, no locking needed
+        if (sw->tk) {
+            for (w = 0; w < l2_pool_size(sw->pool); w++) {
+                for (q = 0; q < nq; q++) {
+                    struct l2_topk *part = &sw->wtk[w * sw->wtk_nq + q];
+
+                    l2_topk_merge_heap(&sw->tk[q], part);
+                    l2_topk_reset(part);
+                }
+            }
+        }
+    }
+    ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+
+    sw->delay = div_u64((u64)ns * sw->clk_mhz, 1000);
+    sw->resp  = ((sw->last[nq - 1] & (U64_MAX >> 1)) << 1) | L2_RESP_DONE;
+}
+
+static u64 l2_sw_read_query_resp(struct l2_engine *eng, u32 q)
+{
+    struct l2_sw *sw = eng->priv;
+
+    return ((sw->last[q] & (U64_MAX >> 1)) << 1) | L2_RESP_DONE;
+}
+
+static void l2_sw_stop(struct l2_engine *eng)
+{
+    struct l2_sw *sw = eng->priv;
+
+    sw->running = false;
+    sw->resp    = 0;
+}
+
+static u64 l2_sw_read_resp(struct l2_engine *eng)
+{
+    struct l2_sw *sw = eng->priv;
+
+    return sw->resp;
+}
+
+static u64 l2_sw_read_delay(struct l2_engine *eng)
+{
+    struct l2_sw *sw = eng->priv;
+
+    return sw->delay;
+}
+
+static void l2_sw_release(struct l2_engine *eng)
+{
+    struct l2_sw *sw = eng->priv;
+
+    l2_sw_free_wtk(sw);
+    l2_pool_destroy(sw->pool);
+    kfree(sw->last);
+    kfree(sw);
+}
+
+static const struct l2_engine_ops l2_sw_ops = {
+    .name        = "sw",
+    .set_base    = l2_sw_set_base,
+    .set_query   = l2_sw_set_query,
+    .set_num_req = l2_sw_set_num_req,
+    .set_dim     = l2_sw_set_dim,
+    .set_elem    = l2_sw_set_elem,
+    .start       = l2_sw_start,
+    .stop        = l2_sw_stop,
+    .read_resp   = l2_sw_read_resp,
+    .read_delay  = l2_sw_read_delay,
+    .set_num_query   = l2_sw_set_num_query,
+    .read_query_resp = l2_sw_read_query_resp,
+    .set_dist_out    = l2_sw_set_dist_out,
+    .set_topk        = l2_sw_set_topk,
+    .set_sg          = l2_sw_set_sg,
+    .release     = l2_sw_release,
+};
+
+static const struct l2_engine_ops l2_cpu_ops = {
+    .name        = "cpu",
+    .set_base    = l2_sw_set_base,
+    .set_query   = l2_sw_set_query,
+    .set_num_req = l2_sw_set_num_req,
+    .set_dim     = l2_sw_set_dim,
+    .set_elem    = l2_sw_set_elem,
+    .start       = l2_sw_start,
+    .stop        = l2_sw_stop,
+    .read_resp   = l2_sw_read_resp,
+    .read_delay  = l2_sw_read_delay,
+    .set_num_query   = l2_sw_set_num_query,
+    .read_query_resp = l2_sw_read_query_resp,
+    .set_dist_out    = l2_sw_set_dist_out,
+    .set_topk        = l2_sw_set_topk,
+    .set_sg          = l2_sw_set_sg,
+    .release     = l2_sw_release,
+};
+
+static int l2_sw_init(struct l2_engine *eng, const struct l2_engine_ops *ops, bool simd)
+{
+    struct l2_sw *sw = kzalloc(sizeof(*sw), GFP_KERNEL);
+    const char *kernel = "scalar";
+
+    if (!sw)
+        return -ENOMEM;
+
+    sw->last = kcalloc(L2_MAX_QUERY_BLOCK, sizeof(*sw->last), GFP_KERNEL);
+    if (!sw->last) {
+        kfree(sw);
+        return -ENOMEM;
+    }
+
+    sw->nq      = 1;
+    sw->clk_mhz = eng->cfg.clk_mhz ? eng->cfg.clk_mhz : 400;
+    sw->dist_q16 = l2_dist_q16;
+    sw->dist_pq  = l2_dist_pq;
+    if (simd) {
+        sw->dist_q16 = l2_simd_select(&kernel, &sw->fpu);
+        pr_info("l2_engine: cpu backend using %s Q16.16 kernel\n", kernel);
+        sw->dist_pq = l2_simd_select_pq(&kernel, &sw->pq_fpu);
+        pr_info("l2_engine: cpu backend using %s PQ8 kernel\n", kernel);
+
+        if (eng->cfg.threads != 1) {
+            sw->pool = l2_pool_create(eng->cfg.nid, eng->cfg.threads);
+            if (IS_ERR(sw->pool)) {
+                pr_warn("l2_engine: worker pool unavailable (%ld), scanning inline\n",
+                        PTR_ERR(sw->pool));
+                sw->pool = NULL;
+            }
+        }
+    }
+    eng->ops  = ops;
+    eng->priv = sw;
+    return 0;
+}
+
+int l2_engine_sw_create(struct l2_engine *eng)
+{
+    return l2_sw_init(eng, &l2_sw_ops, false);
+}
+
+int l2_engine_cpu_create(struct l2_engine *eng)
+{
+    return l2_sw_init(eng, &l2_cpu_ops, true);
+}
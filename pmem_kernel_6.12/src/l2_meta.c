@@ -0,0 +1,181 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "l2_meta.h"
+
+#define L2_META_MAX 4096
+
+static const struct {
+    const char  *name;
+    const char  *format;    /* fixed_format prefix written by fvecs_to_bin.py */
+    enum l2_elem elem;
+} l2_elems[] = {
+    { "q16",  "Q16.16", L2_ELEM_Q16  },
+    { "int8", "int8",   L2_ELEM_INT8 },
+    { "fp16", "fp16",   L2_ELEM_FP16 },
+    { "pq8",  "pq8",    L2_ELEM_PQ8  },
+};
+
+const char *l2_elem_name(enum l2_elem elem)
+{
+    u32 i;
+
+    for (i = 0; i < ARRAY_SIZE(l2_elems); i++) {
+        if (l2_elems[i].elem == elem)
+            return l2_elems[i].name;
+    }
+    return "?";
+}
+
+int l2_elem_parse(const char *s, enum l2_elem *elem)
+{
+    u32 i;
+
+    for (i = 0; i < ARRAY_SIZE(l2_elems); i++) {
+        if (!strcasecmp(s, l2_elems[i].name) ||
+            !strncasecmp(s, l2_elems[i].format, strlen(l2_elems[i].format))) {
+            *elem = l2_elems[i].elem;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+// "dir/base.bin" -> "dir/base.meta", as Path.with_suffix(".meta") does
+char *l2_sidecar_path(const char *bin_path, const char *suffix)
+{
+    const char *slash = strrchr(bin_path, '/');
+    const char *dot   = strrchr(bin_path, '.');
+    int stem = strlen(bin_path);
+
+    if (dot && (!slash || dot > slash + 1))
+        stem = dot - bin_path;
+    return kasprintf(GFP_KERNEL, "%.*s%s", stem, bin_path, suffix);
+}
+EXPORT_SYMBOL(l2_sidecar_path);
+
+static int l2_meta_parse(char *buf, struct l2_vec_layout *lay)
+{
+    char *line;
+    int rc;
+
+    while ((line = strsep(&buf, "\n")) != NULL) {
+        char *val = strchr(line, '=');
+
+        if (!val)
+            continue;
+        *val++ = '\0';
+        line = strim(line);
+
+        if (!strcmp(line, "vectors")) {
+            rc = kstrtou64(strim(val), 10, &lay->vectors);
+        } else if (!strcmp(line, "dimension")) {
+            rc = kstrtou32(strim(val), 10, &lay->dim);
+        } else if (!strcmp(line, "fixed_format")) {
+            rc = l2_elem_parse(strim(val), &lay->elem);
+        } else if (!strcmp(line, "pq_m")) {
+            rc = kstrtou32(strim(val), 10, &lay->pq_m);
+        } else if (!strcmp(line, "pq_elem")) {
+            rc = l2_elem_parse(strim(val), &lay->query_elem);
+        } else {
+            continue;
+        }
+        if (rc) {
+            pr_err("l2_meta: bad value for %s\n", line);
+            return rc;
+        }
+    }
+    return 0;
+}
+
+static int l2_meta_load(const char *bin_path, struct l2_vec_layout *lay)
+{
+    char *path = l2_sidecar_path(bin_path, ".meta");
+    struct file *f;
+    loff_t pos = 0;
+    char *buf;
+    ssize_t n;
+    int rc;
+
+    if (!path)
+        return -ENOMEM;
+    buf = kzalloc(L2_META_MAX, GFP_KERNEL);
+    if (!buf) {
+        kfree(path);
+        return -ENOMEM;
+    }
+
+    f = filp_open(path, O_RDONLY, 0);
+    if (IS_ERR(f)) {
+        rc = PTR_ERR(f);
+        goto out;
+    }
+    n = kernel_read(f, buf, L2_META_MAX - 1, &pos);
+    filp_close(f, NULL);
+    if (n < 0) {
+        rc = n;
+        goto out;
+    }
+
+    rc = l2_meta_parse(buf, lay);
+    if (!rc)
+        pr_info("l2_meta: %s vectors=%llu dim=%u elem=%s\n", path,
+                lay->vectors, lay->dim, l2_elem_name(lay->elem));
+out:
+    kfree(buf);
+    kfree(path);
+    return rc;
+}
+
+int l2_layout_resolve(const char *bin_path, u32 dim, const char *elem,
+                      struct l2_vec_layout *lay)
+{
+    int rc;
+
+    memset(lay, 0, sizeof(*lay));
+    lay->dim  = 128;
+    lay->elem = L2_ELEM_Q16;
+
+    rc = l2_meta_load(bin_path, lay);
+    if (rc == -ENOENT)
+        pr_warn("l2_meta: no .meta for %s, using module parameters\n", bin_path);
+    else if (rc)
+        return rc;
+
+    if (dim) {
+        if (lay->vectors && dim != lay->dim)
+            pr_warn("l2_meta: dim=%u overrides %u from .meta\n", dim, lay->dim);
+        lay->dim = dim;
+    }
+    if (elem && *elem) {
+        rc = l2_elem_parse(elem, &lay->elem);
+        if (rc) {
+            pr_err("l2_meta: unknown element type '%s' (expected q16|int8|fp16)\n", elem);
+            return rc;
+        }
+    }
+
+    lay->elem_bytes = l2_elem_size(lay->elem);
+    if (lay->elem != L2_ELEM_PQ8) {
+        lay->pq_m        = 0;
+        lay->query_elem  = lay->elem;
+        lay->vec_bytes   = lay->dim * lay->elem_bytes;
+        lay->query_bytes = lay->vec_bytes;
+        return lay->vec_bytes ? 0 : -EINVAL;
+    }
+
+    // Codes are pq_m bytes; queries are dim elements the codebook is in
+    if (!lay->pq_m || !lay->dim || lay->dim % lay->pq_m || lay->query_elem == L2_ELEM_PQ8) {
+        pr_err("l2_meta: %s: bad PQ layout (dim=%u pq_m=%u pq_elem=%s)\n", bin_path,
+               lay->dim, lay->pq_m, l2_elem_name(lay->query_elem));
+        return -EINVAL;
+    }
+    lay->vec_bytes   = lay->pq_m;
+    lay->query_bytes = lay->dim * l2_elem_size(lay->query_elem);
+    return 0;
+}
+EXPORT_SYMBOL(l2_layout_resolve);
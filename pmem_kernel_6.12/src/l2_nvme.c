@@ -0,0 +1,570 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/io.h>
+#include <linux/fs.h>
+#include <linux/highmem.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/bitmap.h>
+#include <linux/string.h>
+#include <linux/err.h>
+#include <linux/list.h>
+#include <asm/barrier.h>
+
+#include "cxl_dev.h"
+#include "l2_nvme.h"
+
+#define L2_NVME_OP_READ         0x02
+
+// Status codes (generic command status) the emulated controller returns
+#define L2_NVME_SC_INVALID_OP   0x01
+#define L2_NVME_SC_DATA_XFER    0x04
+#define L2_NVME_SC_INVALID_NS   0x0b
+#define L2_NVME_SC_PRP_OFFSET   0x13
+
+// A READ not completed within this long fails the batch
+#define L2_NVME_TIMEOUT_MS      10000
+
+// Submission queue entry: NVM command set READ layout
+struct l2_nvme_sqe {
+    u8     opcode;
+    u8     flags;
+    __le16 cid;
+    __le32 nsid;
+    __le64 rsvd2;
+    __le64 mptr;
+    __le64 prp1;
+    __le64 prp2;
+    __le64 slba;        /* CDW10-11 */
+    __le16 nlb;         /* CDW12[15:0]: blocks - 1 */
+    __le16 control;
+    __le32 dsmgmt;
+    __le32 reftag;
+    __le16 apptag;
+    __le16 appmask;
+};
+
+struct l2_nvme_cqe {
+    __le32 result;
+    __le32 rsvd;
+    __le16 sq_head;
+    __le16 sq_id;
+    __le16 cid;
+    __le16 status;      /* bit 0 = phase, [15:1] = status field */
+};
+
+// A command in flight; its cid is the index into q->cmds
+struct l2_nvme_cmd {
+    struct l2_nvme_io *io;      /* NULL once its waiter gave up */
+    bool               stale;   /* its waiter timed out: the READ may still land */
+    __le64            *prp;     /* PRP list page */
+    phys_addr_t        prp_pa;
+};
+
+// Buffers of timed-out READs, released once none of those can land any more
+struct l2_nvme_parked {
+    struct list_head node;
+    void           (*release)(void *arg);
+    void            *arg;
+};
+
+struct l2_nvme_q {
+    struct l2_nvme_cfg  cfg;
+    bool                emu;
+    u32                 max_xfer;
+
+    struct l2_nvme_sqe *sq;
+    struct l2_nvme_cqe *cq;
+    size_t              sq_bytes;
+    size_t              cq_bytes;
+    u32                 sq_tail;
+    u32                 cq_head;
+    u16                 phase;
+    void __iomem       *sq_db;      /* ssd */
+    void __iomem       *cq_db;
+
+    spinlock_t          lock;       /* indices, cmds and busy; shards share the queue */
+    struct l2_nvme_cmd *cmds;
+    unsigned long      *busy;
+    u32                 inflight;
+    bool                dead;       /* a READ timed out: no more are taken */
+    u32                 stale;      /* busy cids whose waiter timed out */
+    struct list_head    parked;
+
+    // emu: the controller side of the queue pair
+    struct file        *backing;
+    struct task_struct *ctrl;
+    wait_queue_head_t   ctrl_wq;
+    u32                 emu_sq_db;  /* SQ tail doorbell */
+    u32                 emu_sq_head;
+    u32                 emu_cq_tail;
+    u16                 emu_phase;
+};
+
+static struct l2_nvme_q *l2_nvme;
+
+// ---------- Emulated controller ----------
+static u16 l2_nvme_emu_read(struct l2_nvme_q *q, const struct l2_nvme_sqe *sqe)
+{
+    u32 shift = q->cfg.lba_shift;
+    size_t len = (size_t)(le16_to_cpu(sqe->nlb) + 1) << shift;
+    u32 npages = DIV_ROUND_UP(len, L2_NVME_PAGE), i;
+    u64 prp1 = le64_to_cpu(sqe->prp1), prp2 = le64_to_cpu(sqe->prp2);
+    loff_t pos = (loff_t)le64_to_cpu(sqe->slba) << shift;
+    const __le64 *list = NULL;
+
+    if (le32_to_cpu(sqe->nsid) != q->cfg.nsid)
+        return L2_NVME_SC_INVALID_NS;
+    // The submitter only builds page-aligned transfers
+    if (offset_in_page(prp1) || len > q->max_xfer)
+        return L2_NVME_SC_PRP_OFFSET;
+    if (npages > 2)
+        list = phys_to_virt(prp2);
+
+    for (i = 0; i < npages; i++) {
+        u64 addr = !i ? prp1 : (list ? le64_to_cpu(list[i - 1]) : prp2);
+        size_t n = min_t(size_t, len, L2_NVME_PAGE);
+        ssize_t got;
+        void *va;
+
+        if (!pfn_valid(PHYS_PFN(addr)))
+            return L2_NVME_SC_DATA_XFER;
+        va  = kmap_local_page(pfn_to_page(PHYS_PFN(addr)));
+        got = kernel_read(q->backing, va, n, &pos);
+        // Past the end of the file reads as zeroes, like unwritten blocks
+        if (got >= 0 && got < n)
+            memset(va + got, 0, n - got);
+        kunmap_local(va);
+        if (got < 0)
+            return L2_NVME_SC_DATA_XFER;
+        len -= n;
+    }
+    return 0;
+}
+
+static void l2_nvme_emu_post(struct l2_nvme_q *q, u16 cid, u16 sc)
+{
+    struct l2_nvme_cqe *c = &q->cq[q->emu_cq_tail];
+
+    c->result  = 0;
+    c->sq_head = cpu_to_le16(q->emu_sq_head);
+    c->sq_id   = cpu_to_le16(q->cfg.qid);
+    c->cid     = cpu_to_le16(cid);
+    // The phase flip publishes the entry
+    smp_store_release(&c->status, cpu_to_le16(sc << 1 | q->emu_phase));
+
+    if (++q->emu_cq_tail == q->cfg.depth) {
+        q->emu_cq_tail = 0;
+        q->emu_phase ^= 1;
+    }
+}
+
+static int l2_nvme_emu_fn(void *arg)
+{
+    struct l2_nvme_q *q = arg;
+
+    while (!kthread_should_stop()) {
+        wait_event_interruptible(q->ctrl_wq, smp_load_acquire(&q->emu_sq_db) != q->emu_sq_head ||
+                                             kthread_should_stop());
+
+        while (q->emu_sq_head != smp_load_acquire(&q->emu_sq_db)) {
+            struct l2_nvme_sqe sqe;
+            u16 sc;
+
+            memcpy(&sqe, &q->sq[q->emu_sq_head], sizeof(sqe));
+            if (++q->emu_sq_head == q->cfg.depth)
+                q->emu_sq_head = 0;
+
+            sc = sqe.opcode == L2_NVME_OP_READ ? l2_nvme_emu_read(q, &sqe) : L2_NVME_SC_INVALID_OP;
+            l2_nvme_emu_post(q, le16_to_cpu(sqe.cid), sc);
+            cond_resched();
+        }
+    }
+    return 0;
+}
+
+// ---------- Host side ----------
+static void l2_nvme_ring_sq(struct l2_nvme_q *q)
+{
+    if (q->emu) {
+        smp_store_release(&q->emu_sq_db, q->sq_tail);
+        wake_up(&q->ctrl_wq);
+    } else {
+        wmb();  /* SQE before the doorbell */
+        writel(q->sq_tail, q->sq_db);
+    }
+}
+
+static void l2_nvme_release(struct list_head *list)
+{
+    struct l2_nvme_parked *pk, *tmp;
+
+    list_for_each_entry_safe(pk, tmp, list, node) {
+        list_del(&pk->node);
+        pk->release(pk->arg);
+        kfree(pk);
+    }
+}
+
+// Retire every posted completion; callers poll this while waiting
+static void l2_nvme_reap(struct l2_nvme_q *q)
+{
+    LIST_HEAD(done);
+    bool reaped = false;
+
+    spin_lock(&q->lock);
+    for (;;) {
+        struct l2_nvme_cqe *c = &q->cq[q->cq_head];
+        u16 st = le16_to_cpu(smp_load_acquire(&c->status));
+        u16 cid;
+
+        if ((st & 1) != q->phase)
+            break;
+        cid = le16_to_cpu(c->cid);
+        if (cid < q->cfg.depth && test_bit(cid, q->busy)) {
+            struct l2_nvme_io *io = q->cmds[cid].io;
+
+            if (io && st >> 1) {
+                pr_err_ratelimited("l2_nvme: READ cid %u failed, status 0x%x\n", cid, st >> 1);
+                if (!io->status)
+                    io->status = -EIO;
+            }
+            if (io)
+                atomic_dec(&io->pending);
+            if (q->cmds[cid].stale) {
+                q->cmds[cid].stale = false;
+                q->stale--;
+            }
+            clear_bit(cid, q->busy);
+            q->inflight--;
+        } else {
+            pr_warn_ratelimited("l2_nvme: completion for idle cid %u\n", cid);
+        }
+
+        if (++q->cq_head == q->cfg.depth) {
+            q->cq_head = 0;
+            q->phase ^= 1;
+        }
+        reaped = true;
+    }
+    if (reaped && !q->emu)
+        writel(q->cq_head, q->cq_db);
+    // The last late READ has landed: parked buffers are safe to free
+    if (!q->stale)
+        list_splice_init(&q->parked, &done);
+    spin_unlock(&q->lock);
+    l2_nvme_release(&done);
+}
+
+// One READ of len bytes (<= max_xfer) from block slba into pa; -EBUSY when the queue is full
+static int l2_nvme_submit(struct l2_nvme_q *q, struct l2_nvme_io *io, u64 slba,
+                          phys_addr_t pa, size_t len)
+{
+    u32 npages = DIV_ROUND_UP(len, L2_NVME_PAGE), i;
+    struct l2_nvme_sqe *sqe;
+    struct l2_nvme_cmd *cmd;
+    u32 cid;
+
+    spin_lock(&q->lock);
+    if (q->dead) {
+        spin_unlock(&q->lock);
+        return -EIO;
+    }
+    // One entry stays empty so a full SQ never looks empty to the controller
+    if (q->inflight == q->cfg.depth - 1) {
+        spin_unlock(&q->lock);
+        return -EBUSY;
+    }
+    cid = find_first_zero_bit(q->busy, q->cfg.depth);
+    set_bit(cid, q->busy);
+    q->inflight++;
+    cmd = &q->cmds[cid];
+    cmd->io = io;
+    atomic_inc(&io->pending);
+
+    sqe = &q->sq[q->sq_tail];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = L2_NVME_OP_READ;
+    sqe->cid    = cpu_to_le16(cid);
+    sqe->nsid   = cpu_to_le32(q->cfg.nsid);
+    sqe->slba   = cpu_to_le64(slba);
+    sqe->nlb    = cpu_to_le16((len >> q->cfg.lba_shift) - 1);
+    sqe->prp1   = cpu_to_le64(pa);
+    if (npages == 2) {
+        sqe->prp2 = cpu_to_le64(pa + L2_NVME_PAGE);
+    } else if (npages > 2) {
+        for (i = 1; i < npages; i++)
+            cmd->prp[i - 1] = cpu_to_le64(pa + (u64)i * L2_NVME_PAGE);
+        sqe->prp2 = cpu_to_le64(cmd->prp_pa);
+    }
+
+    if (++q->sq_tail == q->cfg.depth)
+        q->sq_tail = 0;
+    l2_nvme_ring_sq(q);
+    spin_unlock(&q->lock);
+    return 0;
+}
+
+int l2_nvme_read(struct l2_nvme_q *q, struct l2_nvme_io *io, u64 pos, phys_addr_t pa,
+                 size_t len)
+{
+    u32 bs = l2_nvme_block_size(q);
+
+    if (!IS_ALIGNED(pos, bs) || !IS_ALIGNED(len, bs) || !PAGE_ALIGNED(pa))
+        return -EINVAL;
+
+    while (len) {
+        size_t n = min_t(size_t, len, q->max_xfer);
+        int rc;
+
+        while ((rc = l2_nvme_submit(q, io, q->cfg.slba + (pos >> q->cfg.lba_shift), pa, n)) == -EBUSY) {
+            l2_nvme_reap(q);
+            cond_resched();
+        }
+        if (rc)
+            return rc;
+        pos += n;
+        pa  += n;
+        len -= n;
+    }
+    return 0;
+}
+EXPORT_SYMBOL(l2_nvme_read);
+
+int l2_nvme_wait(struct l2_nvme_q *q, struct l2_nvme_io *io)
+{
+    ktime_t deadline = ktime_add_ms(ktime_get(), L2_NVME_TIMEOUT_MS);
+    u32 cid;
+
+    while (atomic_read(&io->pending)) {
+        l2_nvme_reap(q);
+        if (!atomic_read(&io->pending))
+            break;
+        // Once one waiter timed out the others' READs are not coming back either
+        if (READ_ONCE(q->dead) || ktime_after(ktime_get(), deadline)) {
+            pr_err("l2_nvme: %d READs timed out, queue pair %u disabled\n",
+                   atomic_read(&io->pending), q->cfg.qid);
+            // io is about to go away: late completions must not touch it
+            spin_lock(&q->lock);
+            q->dead = true;
+            for_each_set_bit(cid, q->busy, q->cfg.depth) {
+                if (q->cmds[cid].io == io) {
+                    q->cmds[cid].io    = NULL;
+                    q->cmds[cid].stale = true;
+                    q->stale++;
+                }
+            }
+            spin_unlock(&q->lock);
+            return -ETIMEDOUT;
+        }
+        usleep_range(5, 20);
+    }
+    return io->status;
+}
+EXPORT_SYMBOL(l2_nvme_wait);
+
+void l2_nvme_park(struct l2_nvme_q *q, void (*release)(void *arg), void *arg)
+{
+    struct l2_nvme_parked *pk = kmalloc(sizeof(*pk), GFP_KERNEL);
+
+    if (!pk) {
+        // Leaking the buffers is the only safe choice left
+        pr_warn("l2_nvme: cannot park buffers of timed-out READs, leaking them\n");
+        return;
+    }
+    pk->release = release;
+    pk->arg     = arg;
+    spin_lock(&q->lock);
+    list_add_tail(&pk->node, &q->parked);
+    spin_unlock(&q->lock);
+    // Frees them right away if the late READs have landed meanwhile
+    l2_nvme_reap(q);
+}
+EXPORT_SYMBOL(l2_nvme_park);
+
+u32 l2_nvme_block_size(const struct l2_nvme_q *q)
+{
+    return 1u << q->cfg.lba_shift;
+}
+EXPORT_SYMBOL(l2_nvme_block_size);
+
+struct l2_nvme_q *l2_nvme_get(void)
+{
+    return l2_nvme;
+}
+EXPORT_SYMBOL(l2_nvme_get);
+
+// ---------- Setup ----------
+static void l2_nvme_free(struct l2_nvme_q *q)
+{
+    u32 i;
+
+    if (q->ctrl)
+        kthread_stop(q->ctrl);
+    /*
+     * Torn down: nothing reaps the queue any more. emu has stopped writing;
+     * an SSD still holding READs must have its queue pair deleted first.
+     */
+    if (q->stale)
+        pr_warn("l2_nvme: releasing buffers of %u READs that never completed\n", q->stale);
+    l2_nvme_release(&q->parked);
+    if (q->backing)
+        filp_close(q->backing, NULL);
+    for (i = 0; q->cmds && i < q->cfg.depth; i++)
+        free_page((unsigned long)q->cmds[i].prp);
+    kfree(q->cmds);
+    bitmap_free(q->busy);
+    if (q->emu) {
+        free_pages_exact(q->sq, q->sq_bytes);
+        free_pages_exact(q->cq, q->cq_bytes);
+    } else {
+        if (q->sq)
+            memunmap(q->sq);
+        if (q->cq)
+            memunmap(q->cq);
+    }
+    kfree(q);
+}
+
+// emu: rings in host memory and a controller thread reading cfg->file
+static int l2_nvme_setup_emu(struct l2_nvme_q *q)
+{
+    q->sq = alloc_pages_exact(q->sq_bytes, GFP_KERNEL | __GFP_ZERO);
+    q->cq = alloc_pages_exact(q->cq_bytes, GFP_KERNEL | __GFP_ZERO);
+    if (!q->sq || !q->cq)
+        return -ENOMEM;
+
+    if (!q->cfg.file || !*q->cfg.file) {
+        pr_err("l2_nvme: emu needs a backing file\n");
+        return -EINVAL;
+    }
+    q->backing = filp_open(q->cfg.file, O_RDONLY | O_LARGEFILE, 0);
+    if (IS_ERR(q->backing)) {
+        int rc = PTR_ERR(q->backing);
+
+        pr_err("l2_nvme: cannot open %s (%d)\n", q->cfg.file, rc);
+        q->backing = NULL;
+        return rc;
+    }
+
+    q->emu_phase = 1;
+    init_waitqueue_head(&q->ctrl_wq);
+    q->ctrl = kthread_run(l2_nvme_emu_fn, q, "l2_nvme_emu/%u", q->cfg.qid);
+    if (IS_ERR(q->ctrl)) {
+        int rc = PTR_ERR(q->ctrl);
+
+        q->ctrl = NULL;
+        return rc;
+    }
+    return 0;
+}
+
+// ssd: the rings someone created on the SSD, doorbells in cxl_dev's SSD BAR
+static int l2_nvme_setup_ssd(struct l2_nvme_q *q)
+{
+    struct cxl_dev *d = cxl_dev_get();
+
+    if (!d || !d->nvme) {
+        pr_err("l2_nvme: ssd mode needs the SSD BAR (engine=fpga, nvme_bar set)\n");
+        return -ENODEV;
+    }
+    if (!q->cfg.qid || !q->cfg.sq_pa || !q->cfg.cq_pa) {
+        pr_err("l2_nvme: ssd mode needs the queue pair's qid, SQ and CQ addresses\n");
+        return -EINVAL;
+    }
+    if (NVME_REG_DOORBELL(q->cfg.qid) + 8 > CXL_NVME_BAR_SIZE) {
+        pr_err("l2_nvme: qid %u is past the mapped doorbells\n", q->cfg.qid);
+        return -EINVAL;
+    }
+
+    q->sq = memremap(q->cfg.sq_pa, q->sq_bytes, MEMREMAP_WB);
+    q->cq = memremap(q->cfg.cq_pa, q->cq_bytes, MEMREMAP_WB);
+    if (!q->sq || !q->cq)
+        return -ENOMEM;
+    memset(q->cq, 0, q->cq_bytes);
+
+    // SQ y tail at 0x1000 + 2y * 4, CQ y head right after (CAP.DSTRD = 0), as check_db reads them
+    q->sq_db = d->nvme + NVME_REG_DOORBELL(q->cfg.qid);
+    q->cq_db = q->sq_db + 4;
+    return 0;
+}
+
+int l2_nvme_init(const struct l2_nvme_cfg *cfg)
+{
+    struct l2_nvme_q *q;
+    u32 i;
+    int rc;
+
+    if (cfg->depth < 2 || cfg->depth > L2_NVME_MAX_DEPTH ||
+        cfg->lba_shift < 9 || cfg->lba_shift > 12) {
+        pr_err("l2_nvme: bad queue depth %u or lba_shift %u\n", cfg->depth, cfg->lba_shift);
+        return -EINVAL;
+    }
+
+    q = kzalloc(sizeof(*q), GFP_KERNEL);
+    if (!q)
+        return -ENOMEM;
+    q->cfg      = *cfg;
+    q->emu      = !strcmp(cfg->mode, "emu");
+    q->max_xfer = cfg->max_xfer ? min(cfg->max_xfer, L2_NVME_MAX_XFER) : L2_NVME_MAX_XFER;
+    q->max_xfer = round_down(q->max_xfer, L2_NVME_PAGE);
+    q->sq_bytes = PAGE_ALIGN(cfg->depth * sizeof(struct l2_nvme_sqe));
+    q->cq_bytes = PAGE_ALIGN(cfg->depth * sizeof(struct l2_nvme_cqe));
+    q->phase    = 1;
+    spin_lock_init(&q->lock);
+    INIT_LIST_HEAD(&q->parked);
+
+    if (!q->emu && strcmp(cfg->mode, "ssd")) {
+        pr_err("l2_nvme: unknown mode '%s' (ssd | emu)\n", cfg->mode);
+        rc = -EINVAL;
+        goto err;
+    }
+    if (!q->max_xfer) {
+        rc = -EINVAL;
+        goto err;
+    }
+
+    q->busy = bitmap_zalloc(cfg->depth, GFP_KERNEL);
+    q->cmds = kcalloc(cfg->depth, sizeof(*q->cmds), GFP_KERNEL);
+    if (!q->busy || !q->cmds) {
+        rc = -ENOMEM;
+        goto err;
+    }
+    for (i = 0; i < cfg->depth; i++) {
+        q->cmds[i].prp = (__le64 *)get_zeroed_page(GFP_KERNEL);
+        if (!q->cmds[i].prp) {
+            rc = -ENOMEM;
+            goto err;
+        }
+        q->cmds[i].prp_pa = virt_to_phys(q->cmds[i].prp);
+    }
+
+    rc = q->emu ? l2_nvme_setup_emu(q) : l2_nvme_setup_ssd(q);
+    if (rc)
+        goto err;
+
+    l2_nvme = q;
+    pr_info("l2_nvme: %s queue pair qid=%u depth=%u nsid=%u block=%u slba=%llu max_xfer=%u\n",
+            cfg->mode, cfg->qid, cfg->depth, cfg->nsid, l2_nvme_block_size(q),
+            (unsigned long long)cfg->slba, q->max_xfer);
+    return 0;
+
+err:
+    l2_nvme_free(q);
+    return rc;
+}
+EXPORT_SYMBOL(l2_nvme_init);
+
+void l2_nvme_exit(void)
+{
+    if (!l2_nvme)
+        return;
+    l2_nvme_free(l2_nvme);
+    l2_nvme = NULL;
+}
+EXPORT_SYMBOL(l2_nvme_exit);
@@ -0,0 +1,169 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/nodemask.h>
+#include <linux/numa.h>
+#include <asm/barrier.h>
+
+#include "l2_pool.h"
+
+struct l2_worker {
+    struct l2_pool     *pool;
+    struct task_struct *task;
+    u32                 idx;
+};
+
+struct l2_pool {
+    u32               nr;
+    int               nid;      /* node the workers run on */
+    struct l2_worker *w;
+
+    // Current job; gen bumps once per l2_pool_run()
+    l2_pool_fn        fn;
+    void             *arg;
+    unsigned long     gen;
+    atomic_t          pending;
+    wait_queue_head_t wq;
+    struct completion done;
+};
+
+// CXL memory nodes usually have no CPUs: pick the closest node that does
+static int l2_pool_cpu_node(int nid)
+{
+    int n, best = NUMA_NO_NODE, best_dist = INT_MAX;
+
+    if (nid == NUMA_NO_NODE || !node_online(nid))
+        return numa_node_id();
+    if (node_state(nid, N_CPU))
+        return nid;
+
+    for_each_node_state(n, N_CPU) {
+        int d = node_distance(nid, n);
+
+        if (d < best_dist) {
+            best_dist = d;
+            best = n;
+        }
+    }
+    return best == NUMA_NO_NODE ? numa_node_id() : best;
+}
+
+static int l2_pool_worker(void *arg)
+{
+    struct l2_worker *w = arg;
+    struct l2_pool *pool = w->pool;
+    unsigned long seen = 0;
+
+    for (;;) {
+        // Interruptible so idle workers do not count as hung tasks
+        wait_event_interruptible(pool->wq, smp_load_acquire(&pool->gen) != seen ||
+                                           kthread_should_stop());
+        if (kthread_should_stop())
+            break;
+        if (smp_load_acquire(&pool->gen) == seen)
+            continue;
+        seen = pool->gen;
+
+        pool->fn(pool->arg, w->idx, pool->nr);
+        if (atomic_dec_and_test(&pool->pending))
+            complete(&pool->done);
+    }
+    return 0;
+}
+
+struct l2_pool *l2_pool_create(int near_nid, u32 max_workers)
+{
+    const struct cpumask *mask;
+    struct l2_pool *pool;
+    u32 nr, i = 0;
+    int cpu;
+
+    pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+    if (!pool)
+        return ERR_PTR(-ENOMEM);
+
+    pool->nid = l2_pool_cpu_node(near_nid);
+    mask = cpumask_of_node(pool->nid);
+    nr = cpumask_weight_and(mask, cpu_online_mask);
+    if (max_workers && max_workers < nr)
+        nr = max_workers;
+    if (!nr) {
+        kfree(pool);
+        return ERR_PTR(-ENODEV);
+    }
+
+    pool->w = kcalloc(nr, sizeof(*pool->w), GFP_KERNEL);
+    if (!pool->w) {
+        kfree(pool);
+        return ERR_PTR(-ENOMEM);
+    }
+    init_waitqueue_head(&pool->wq);
+    init_completion(&pool->done);
+
+    for_each_cpu_and(cpu, mask, cpu_online_mask) {
+        struct l2_worker *w = &pool->w[i];
+
+        if (i == nr)
+            break;
+        w->pool = pool;
+        w->idx  = i;
+        w->task = kthread_create_on_node(l2_pool_worker, w, pool->nid, "l2_worker/%d", cpu);
+        if (IS_ERR(w->task)) {
+            int err = PTR_ERR(w->task);
+
+            w->task = NULL;
+            pool->nr = i;
+            l2_pool_destroy(pool);
+            return ERR_PTR(err);
+        }
+        kthread_bind(w->task, cpu);
+        wake_up_process(w->task);
+        i++;
+    }
+    pool->nr = i;
+
+    pr_info("l2_pool: %u workers on node %d (near node %d)\n", pool->nr, pool->nid, near_nid);
+    return pool;
+}
+
+void l2_pool_destroy(struct l2_pool *pool)
+{
+    u32 i;
+
+    if (IS_ERR_OR_NULL(pool))
+        return;
+    for (i = 0; i < pool->nr; i++) {
+        if (pool->w[i].task)
+            kthread_stop(pool->w[i].task);
+    }
+    kfree(pool->w);
+    kfree(pool);
+}
+
+u32 l2_pool_size(const struct l2_pool *pool)
+{
+    return pool->nr;
+}
+
+int l2_pool_node(const struct l2_pool *pool)
+{
+    return pool->nid;
+}
+
+void l2_pool_run(struct l2_pool *pool, l2_pool_fn fn, void *arg)
+{
+    pool->fn  = fn;
+    pool->arg = arg;
+    atomic_set(&pool->pending, pool->nr);
+    reinit_completion(&pool->done);
+
+    smp_store_release(&pool->gen, pool->gen + 1);
+    wake_up_all(&pool->wq);
+    wait_for_completion(&pool->done);
+}
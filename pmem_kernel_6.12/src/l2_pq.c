@@ -0,0 +1,105 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/types.h>
+
+#include "l2_engine.h"
+#include "l2_pq.h"
+#include "l2_topk.h"
+
+int l2_pq_load(struct l2_pq *pq, const char *bin_path, const struct l2_vec_layout *lay)
+{
+    char *path = l2_sidecar_path(bin_path, ".pq");
+    size_t bytes;
+    struct file *f;
+    loff_t pos = 0;
+    ssize_t n;
+    int rc;
+
+    if (!path)
+        return -ENOMEM;
+
+    memset(pq, 0, sizeof(*pq));
+    pq->m         = lay->pq_m;
+    pq->dsub      = lay->dim / lay->pq_m;
+    pq->elem      = lay->query_elem;
+    pq->sub_bytes = pq->dsub * l2_elem_size(pq->elem);
+    bytes = (size_t)pq->m * L2_PQ_KSUB * pq->sub_bytes;
+
+    f = filp_open(path, O_RDONLY, 0);
+    if (IS_ERR(f)) {
+        rc = PTR_ERR(f);
+        pr_err("l2_pq: cannot open codebook %s (%d)\n", path, rc);
+        goto out;
+    }
+    if (i_size_read(file_inode(f)) != bytes) {
+        pr_err("l2_pq: %s is %lld bytes, expected %zu (m=%u dsub=%u %s)\n", path,
+               i_size_read(file_inode(f)), bytes, pq->m, pq->dsub, l2_elem_name(pq->elem));
+        rc = -EINVAL;
+        goto out_close;
+    }
+
+    pq->codebook = kvmalloc(bytes, GFP_KERNEL);
+    if (!pq->codebook) {
+        rc = -ENOMEM;
+        goto out_close;
+    }
+    n  = kernel_read(f, pq->codebook, bytes, &pos);
+    rc = n == bytes ? 0 : (n < 0 ? n : -EIO);
+    if (rc)
+        l2_pq_free(pq);
+    else
+        pr_info("l2_pq: codebook %s: m=%u dsub=%u %s\n", path, pq->m, pq->dsub,
+                l2_elem_name(pq->elem));
+
+out_close:
+    filp_close(f, NULL);
+out:
+    kfree(path);
+    return rc;
+}
+EXPORT_SYMBOL(l2_pq_load);
+
+void l2_pq_free(struct l2_pq *pq)
+{
+    kvfree(pq->codebook);
+    pq->codebook = NULL;
+}
+EXPORT_SYMBOL(l2_pq_free);
+
+void l2_pq_build_lut(const struct l2_pq *pq, const void *query, u64 *lut)
+{
+    const u8 *cent = pq->codebook;
+    const u8 *qsub = query;
+    u32 i, c;
+
+    for (i = 0; i < pq->m; i++, qsub += pq->sub_bytes) {
+        for (c = 0; c < L2_PQ_KSUB; c++, cent += pq->sub_bytes)
+            *lut++ = l2_dist(cent, qsub, pq->dsub, pq->elem);
+    }
+}
+EXPORT_SYMBOL(l2_pq_build_lut);
+
+int l2_pq_rerank(struct file *full, const struct l2_vec_layout *lay, const void *query,
+                 struct l2_topk *tk, u32 k, void *scratch)
+{
+    u32 i;
+
+    for (i = 0; i < tk->n; i++) {
+        struct l2_topk_ent *e = &tk->e[i];
+        loff_t pos = (loff_t)e->id * lay->query_bytes;
+        ssize_t n = kernel_read(full, scratch, lay->query_bytes, &pos);
+
+        if (n != lay->query_bytes)
+            return n < 0 ? n : -EIO;
+        e->dist = l2_dist(scratch, query, lay->dim, lay->query_elem);
+        cond_resched();
+    }
+    l2_topk_sort(tk);
+    tk->n = min(tk->n, k);
+    return 0;
+}
+EXPORT_SYMBOL(l2_pq_rerank);
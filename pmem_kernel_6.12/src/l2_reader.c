@@ -0,0 +1,266 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/fadvise.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/bvec.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
+
+#include "l2_reader.h"
+
+static int l2_reader_filp(struct l2_reader *r)
+{
+    int flags = O_RDONLY | O_LARGEFILE | (r->direct ? O_DIRECT : 0);
+
+    r->f = filp_open(r->path, flags, 0);
+    if (IS_ERR(r->f)) {
+        int err = PTR_ERR(r->f);
+
+        r->f = NULL;
+        return err;
+    }
+    return 0;
+}
+
+int l2_reader_open(struct l2_reader *r, const char *path, bool direct, size_t ra_bytes)
+{
+    int rc;
+
+    memset(r, 0, sizeof(*r));
+    r->path     = path;
+    r->direct   = direct;
+    r->align    = L2_READER_ALIGN;
+    r->ra_bytes = ra_bytes;
+
+    rc = l2_reader_filp(r);
+    if (rc && direct) {
+        // Filesystem without O_DIRECT support: fall back to the page cache
+        pr_warn("l2_reader: O_DIRECT open of %s failed (%d), using buffered reads\n", path, rc);
+        r->direct = false;
+        rc = l2_reader_filp(r);
+    }
+    if (rc) {
+        pr_err("l2_reader: open failed: %s (%d)\n", path, rc);
+        return rc;
+    }
+
+    // f_mapping->host: a block device's size lives on its bdev inode, not the /dev node
+    r->size = i_size_read(r->f->f_mapping->host);
+    if (!r->direct)
+        vfs_fadvise(r->f, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    pr_info("l2_reader: %s size=%lld direct=%d readahead=%zu\n",
+            path, (long long)r->size, r->direct, r->ra_bytes);
+    return 0;
+}
+
+void l2_reader_close(struct l2_reader *r)
+{
+    if (r->aio_qd) {
+        // Callers wait for their batches; this only catches an error path's leftovers
+        wait_event(r->aio_wq, !atomic_read(&r->aio_inflight));
+        // The last completion may still be inside its wakeup
+        spin_lock_irq(&r->aio_wq.lock);
+        spin_unlock_irq(&r->aio_wq.lock);
+    }
+    if (r->aio_wq_submit)
+        destroy_workqueue(r->aio_wq_submit);
+    r->aio_wq_submit = NULL;
+    if (r->f)
+        filp_close(r->f, NULL);
+    r->f = NULL;
+}
+
+void l2_reader_rewind(struct l2_reader *r)
+{
+    r->pos    = r->start;
+    r->ra_pos = r->start;
+}
+
+// Keep a readahead window ahead of the consumer (buffered mode only)
+static void l2_reader_readahead(struct l2_reader *r, size_t want)
+{
+    loff_t start, target;
+
+    if (r->direct || !r->ra_bytes)
+        return;
+
+    start  = max_t(loff_t, r->ra_pos, r->pos + want);
+    target = min_t(loff_t, r->pos + want + r->ra_bytes, r->size);
+    if (target <= start)
+        return;
+
+    vfs_fadvise(r->f, start, target - start, POSIX_FADV_WILLNEED);
+    r->ra_pos = target;
+}
+
+long l2_reader_read(struct l2_reader *r, void *dst, size_t want, size_t cap)
+{
+    size_t len = want, done = 0;
+    loff_t pos = r->pos;
+
+    if (!r->f)
+        return -EBADF;
+
+    if (r->direct) {
+        if (!IS_ALIGNED(pos, r->align) || !IS_ALIGNED((unsigned long)dst, r->align))
+            return -EINVAL;
+        len = round_up(want, r->align);
+    }
+    if (len > cap)
+        return -EINVAL;
+
+    // Kick off I/O for the chunks after this one before blocking on it
+    l2_reader_readahead(r, want);
+
+    while (done < len) {
+        ssize_t n = kernel_read(r->f, (char *)dst + done, len - done, &pos);
+
+        if (n < 0) {
+            pr_err("l2_reader: read error %zd at %lld on %s\n", n, (long long)pos, r->path);
+            return n;
+        }
+        if (n == 0)
+            break;  /* EOF */
+        done += (size_t)n;
+    }
+
+    // O_DIRECT may have pulled in bytes past `want`; they belong to the next chunk
+    if (done > want)
+        done = want;
+    if (done < cap)
+        memset((char *)dst + done, 0, cap - done);
+
+    r->pos        += done;
+    r->bytes_read += done;
+    return (long)done;
+}
+
+// ---------- Asynchronous reads ----------
+struct l2_aio_req {
+    struct kiocb            iocb;
+    struct bio_vec          bv;
+    struct iov_iter         iter;
+    struct work_struct      work;
+    struct l2_reader       *r;
+    struct l2_reader_batch *b;
+    size_t                  expect;     /* bytes before EOF; fewer is an error */
+};
+
+int l2_reader_aio(struct l2_reader *r, u32 qd, size_t bytes, u32 cpus)
+{
+    r->aio_qd    = qd;
+    r->aio_bytes = max_t(size_t, round_down(bytes, r->align), r->align);
+    r->aio_cpus  = cpus;
+    atomic_set(&r->aio_inflight, 0);
+    init_waitqueue_head(&r->aio_wq);
+    if (!qd || cpus < 2)
+        return 0;
+
+    r->aio_wq_submit = alloc_workqueue("l2_aio", WQ_HIGHPRI, 0);
+    return r->aio_wq_submit ? 0 : -ENOMEM;
+}
+
+// May run in interrupt context
+static void l2_aio_complete(struct kiocb *iocb, long ret)
+{
+    struct l2_aio_req *req = container_of(iocb, struct l2_aio_req, iocb);
+    struct l2_reader_batch *b = req->b;
+    struct l2_reader *r = req->r;
+    unsigned long flags;
+
+    if (ret < (long)req->expect) {
+        pr_err_ratelimited("l2_reader: read at %lld: %ld of %zu bytes\n",
+                           (long long)iocb->ki_pos, ret, req->expect);
+        cmpxchg(&b->status, 0, ret < 0 ? (int)ret : -EIO);
+    }
+    kfree(req);
+
+    // b may be gone as soon as pending drops; r stays until close, which takes this lock
+    spin_lock_irqsave(&r->aio_wq.lock, flags);
+    atomic_dec(&b->pending);
+    atomic_dec(&r->aio_inflight);
+    wake_up_locked(&r->aio_wq);
+    spin_unlock_irqrestore(&r->aio_wq.lock, flags);
+}
+
+static void l2_aio_issue(struct l2_aio_req *req)
+{
+    struct file *f = req->r->f;
+    ssize_t ret;
+
+    ret = f->f_op->read_iter(&req->iocb, &req->iter);
+    if (ret != -EIOCBQUEUED)
+        l2_aio_complete(&req->iocb, ret);
+}
+
+static void l2_aio_work(struct work_struct *work)
+{
+    l2_aio_issue(container_of(work, struct l2_aio_req, work));
+}
+
+long l2_reader_submit(struct l2_reader *r, struct l2_reader_batch *b, struct page *pages,
+                      size_t want, size_t cap)
+{
+    size_t len = want, off;
+    loff_t pos = r->pos;
+
+    if (!r->f)
+        return -EBADF;
+    if (r->direct) {
+        if (!IS_ALIGNED(pos, r->align))
+            return -EINVAL;
+        len = round_up(want, r->align);
+    }
+    if (len > cap)
+        return -EINVAL;
+
+    l2_reader_readahead(r, want);
+
+    for (off = 0; off < len; ) {
+        size_t n = min(len - off, r->aio_bytes);
+        struct l2_aio_req *req;
+
+        wait_event(r->aio_wq, atomic_read(&r->aio_inflight) < r->aio_qd);
+
+        req = kzalloc(sizeof(*req), GFP_KERNEL);
+        if (!req)
+            return -ENOMEM;
+        req->r      = r;
+        req->b      = b;
+        req->expect = pos + off < r->size ? min_t(loff_t, n, r->size - (pos + off)) : 0;
+        bvec_set_page(&req->bv, nth_page(pages, off >> PAGE_SHIFT), n, off & ~PAGE_MASK);
+        iov_iter_bvec(&req->iter, ITER_DEST, &req->bv, 1, n);
+        init_sync_kiocb(&req->iocb, r->f);
+        req->iocb.ki_pos      = pos + off;
+        req->iocb.ki_complete = l2_aio_complete;
+
+        atomic_inc(&b->pending);
+        atomic_inc(&r->aio_inflight);
+        if (r->aio_wq_submit) {
+            // Each CPU submits to its own hardware queue
+            INIT_WORK(&req->work, l2_aio_work);
+            queue_work_on(cpumask_local_spread(r->aio_next++ % r->aio_cpus, NUMA_NO_NODE),
+                          r->aio_wq_submit, &req->work);
+        } else {
+            l2_aio_issue(req);
+        }
+        off += n;
+    }
+
+    // Like l2_reader_read(): bytes past `want` belong to the next chunk
+    r->pos        += want;
+    r->bytes_read += want;
+    return (long)want;
+}
+
+int l2_reader_wait(struct l2_reader *r, struct l2_reader_batch *b)
+{
+    wait_event(r->aio_wq, !atomic_read(&b->pending));
+    return b->status;
+}
@@ -0,0 +1,253 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/eventfd.h>
+#include <linux/poll.h>
+#include <linux/err.h>
+#include <asm/barrier.h>
+
+#include "l2_ioctl.h"
+#include "l2_ring.h"
+
+#define L2_RING_MAX_ENTRIES 4096
+
+// Busy-poll window before an idle worker sleeps and asks for a kick
+#define L2_RING_IDLE_US     50
+
+struct l2_ring {
+    struct l2_ring_hdr *hdr;        /* start of the shared mapping */
+    struct l2_sqe      *sq;
+    struct l2_cqe      *cq;
+    size_t              bytes;
+    u32                 sq_entries;
+    u32                 cq_entries;
+
+    // Worker-private copies of the indices it owns
+    u32                 sq_head;
+    u32                 cq_tail;
+    u16                 phase;
+
+    l2_ring_fn          fn;
+    void               *arg;
+    struct task_struct *task;
+    struct eventfd_ctx *efd;
+    bool                kicked;
+    wait_queue_head_t   sq_wq;      /* idle worker */
+    wait_queue_head_t   cq_wq;      /* poll() */
+};
+
+static void l2_ring_notify(struct l2_ring *ring)
+{
+    if (ring->efd)
+        eventfd_signal(ring->efd);
+    wake_up_interruptible(&ring->cq_wq);
+}
+
+static bool l2_ring_cq_full(const struct l2_ring *ring)
+{
+    u32 head = READ_ONCE(ring->hdr->cq_head);
+
+    // A bogus head from userspace stalls the ring rather than overwriting CQEs
+    return head >= ring->cq_entries || (ring->cq_tail + 1) % ring->cq_entries == head;
+}
+
+// Wait for userspace to make room in the CQ; -EINTR when stopping
+static int l2_ring_cq_wait(struct l2_ring *ring)
+{
+    while (l2_ring_cq_full(ring)) {
+        if (kthread_should_stop())
+            return -EINTR;
+        usleep_range(10, 50);
+    }
+    return 0;
+}
+
+static void l2_ring_post(struct l2_ring *ring, struct l2_cqe *cqe)
+{
+    struct l2_cqe *dst = &ring->cq[ring->cq_tail];
+
+    dst->user_data = cqe->user_data;
+    dst->cycles    = cqe->cycles;
+    dst->wall_ns   = cqe->wall_ns;
+    dst->status    = cqe->status;
+    dst->sq_head   = ring->sq_head;
+    // The phase flip publishes the entry
+    smp_store_release(&dst->flags, ring->phase);
+
+    if (ring->cq_tail + 1 == ring->cq_entries) {
+        WRITE_ONCE(ring->cq_tail, 0);
+        ring->phase ^= L2_CQE_PHASE;
+    } else {
+        WRITE_ONCE(ring->cq_tail, ring->cq_tail + 1);
+    }
+}
+
+// Sleep until kicked, unless an SQE raced in after NEED_WAKEUP went up
+static void l2_ring_idle(struct l2_ring *ring)
+{
+    struct l2_ring_hdr *hdr = ring->hdr;
+
+    WRITE_ONCE(ring->kicked, false);
+    WRITE_ONCE(hdr->flags, hdr->flags | L2_RING_NEED_WAKEUP);
+    smp_mb();   /* flag before tail re-read; pairs with userspace's tail store, flag load */
+    if (smp_load_acquire(&hdr->sq_tail) == ring->sq_head)
+        wait_event_interruptible(ring->sq_wq, READ_ONCE(ring->kicked) || kthread_should_stop());
+    WRITE_ONCE(hdr->flags, hdr->flags & ~L2_RING_NEED_WAKEUP);
+}
+
+static int l2_ring_worker(void *data)
+{
+    struct l2_ring *ring = data;
+    struct l2_ring_hdr *hdr = ring->hdr;
+    ktime_t idle_start = 0;
+    bool idle = false;
+
+    while (!kthread_should_stop()) {
+        u32 tail = smp_load_acquire(&hdr->sq_tail);
+
+        if (tail >= ring->sq_entries) {
+            pr_warn_ratelimited("l2_ring: sq_tail %u out of range\n", tail);
+            tail = ring->sq_head;
+        }
+        if (tail == ring->sq_head) {
+            if (!idle) {
+                idle_start = ktime_get();
+                idle = true;
+            }
+            if (ktime_us_delta(ktime_get(), idle_start) < L2_RING_IDLE_US) {
+                cpu_relax();
+                continue;
+            }
+            l2_ring_idle(ring);
+            idle = false;
+            continue;
+        }
+        idle = false;
+
+        while (ring->sq_head != tail) {
+            struct l2_sqe sqe;
+            struct l2_cqe cqe = { 0 };
+
+            if (l2_ring_cq_wait(ring))
+                break;
+
+            // Snapshot: userspace may already be rewriting the slot
+            memcpy(&sqe, &ring->sq[ring->sq_head], sizeof(sqe));
+            cqe.user_data = sqe.user_data;
+            ring->fn(ring->arg, &sqe, &cqe);
+
+            ring->sq_head = (ring->sq_head + 1) % ring->sq_entries;
+            WRITE_ONCE(hdr->sq_head, ring->sq_head);
+            l2_ring_post(ring, &cqe);
+            l2_ring_notify(ring);
+        }
+        cond_resched();
+    }
+    return 0;
+}
+
+struct l2_ring *l2_ring_create(u32 sq_entries, u32 cq_entries, int eventfd,
+                               l2_ring_fn fn, void *arg)
+{
+    struct l2_ring *ring;
+    size_t sq_bytes, cq_bytes;
+    int rc;
+
+    if (sq_entries < 2 || sq_entries > L2_RING_MAX_ENTRIES ||
+        cq_entries < 2 || cq_entries > L2_RING_MAX_ENTRIES)
+        return ERR_PTR(-EINVAL);
+
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring)
+        return ERR_PTR(-ENOMEM);
+
+    sq_bytes    = PAGE_ALIGN(sq_entries * sizeof(struct l2_sqe));
+    cq_bytes    = PAGE_ALIGN(cq_entries * sizeof(struct l2_cqe));
+    ring->bytes = PAGE_SIZE + sq_bytes + cq_bytes;
+    ring->hdr   = vmalloc_user(ring->bytes);
+    if (!ring->hdr) {
+        rc = -ENOMEM;
+        goto err;
+    }
+    ring->sq = (void *)ring->hdr + PAGE_SIZE;
+    ring->cq = (void *)ring->sq + sq_bytes;
+    ring->sq_entries = sq_entries;
+    ring->cq_entries = cq_entries;
+    ring->phase      = L2_CQE_PHASE;
+    ring->fn         = fn;
+    ring->arg        = arg;
+    init_waitqueue_head(&ring->sq_wq);
+    init_waitqueue_head(&ring->cq_wq);
+
+    ring->hdr->sq_entries = sq_entries;
+    ring->hdr->cq_entries = cq_entries;
+    ring->hdr->sq_off     = PAGE_SIZE;
+    ring->hdr->cq_off     = PAGE_SIZE + sq_bytes;
+
+    if (eventfd >= 0) {
+        ring->efd = eventfd_ctx_fdget(eventfd);
+        if (IS_ERR(ring->efd)) {
+            rc = PTR_ERR(ring->efd);
+            ring->efd = NULL;
+            goto err;
+        }
+    }
+
+    ring->task = kthread_run(l2_ring_worker, ring, "l2_ring");
+    if (IS_ERR(ring->task)) {
+        rc = PTR_ERR(ring->task);
+        ring->task = NULL;
+        goto err;
+    }
+    return ring;
+
+err:
+    l2_ring_destroy(ring);
+    return ERR_PTR(rc);
+}
+
+void l2_ring_destroy(struct l2_ring *ring)
+{
+    if (IS_ERR_OR_NULL(ring))
+        return;
+    if (ring->task)
+        kthread_stop(ring->task);
+    if (ring->efd)
+        eventfd_ctx_put(ring->efd);
+    vfree(ring->hdr);
+    kfree(ring);
+}
+
+size_t l2_ring_bytes(const struct l2_ring *ring)
+{
+    return ring->bytes;
+}
+
+void l2_ring_kick(struct l2_ring *ring)
+{
+    WRITE_ONCE(ring->kicked, true);
+    wake_up(&ring->sq_wq);
+}
+
+__poll_t l2_ring_poll(struct l2_ring *ring, struct file *file, poll_table *wait)
+{
+    poll_wait(file, &ring->cq_wq, wait);
+
+    // cq_tail is only advanced by the worker; a stale read just re-polls
+    if (READ_ONCE(ring->cq_tail) != READ_ONCE(ring->hdr->cq_head))
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+int l2_ring_mmap(struct l2_ring *ring, struct vm_area_struct *vma)
+{
+    if (vma->vm_end - vma->vm_start > ring->bytes)
+        return -EINVAL;
+    return remap_vmalloc_range(vma, ring->hdr, 0);
+}
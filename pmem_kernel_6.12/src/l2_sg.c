@@ -0,0 +1,282 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/slab.h>
+#include <linux/io.h>
+#include <linux/numa.h>
+#include <linux/mmzone.h>
+#include <linux/nodemask.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "l2_sg.h"
+
+#define L2_SG_PER_PAGE  (PAGE_SIZE / sizeof(struct l2_sg_desc))
+
+struct l2_sg_owner {
+    int nid;
+    u64 cxl_base;
+};
+
+phys_addr_t l2_device_pa(phys_addr_t cpu_pa, int nid, u64 cxl_base)
+{
+    if (nid == NUMA_NO_NODE || cxl_base == 0)
+        return cpu_pa;
+    if (cpu_pa >= cxl_base)
+        return cpu_pa - cxl_base;
+
+    pr_warn("l2_sg: Allocated address %llx < cxl_base %llx, using raw PA\n",
+            (unsigned long long)cpu_pa, (unsigned long long)cxl_base);
+    return cpu_pa;
+}
+
+int l2_nodes_parse(const char *s, const struct l2_node *def, struct l2_node *nodes, u32 max)
+{
+    char *buf, *cur, *tok;
+    u32 n = 0;
+    int rc = 0;
+
+    if (!s || !*s) {
+        nodes[0] = *def;
+        return 1;
+    }
+    buf = kstrdup(s, GFP_KERNEL);
+    if (!buf)
+        return -ENOMEM;
+
+    cur = buf;
+    while ((tok = strsep(&cur, ",")) != NULL) {
+        char *at = strchr(tok, '@');
+
+        if (at)
+            *at++ = '\0';
+        tok = strim(tok);
+        if (!*tok)
+            continue;
+        if (n == max) {
+            pr_err("l2_sg: more than %u CXL nodes\n", max);
+            rc = -E2BIG;
+            break;
+        }
+        nodes[n].cxl_base = 0;
+        rc = kstrtoint(tok, 0, &nodes[n].nid);
+        if (!rc && at)
+            rc = kstrtou64(strim(at), 0, &nodes[n].cxl_base);
+        if (!rc && (nodes[n].nid < 0 || nodes[n].nid >= MAX_NUMNODES ||
+                    !node_online(nodes[n].nid)))
+            rc = -ENODEV;
+        if (rc) {
+            pr_err("l2_sg: bad CXL node '%s%s%s' (%d)\n", tok, at ? "@" : "", at ? at : "", rc);
+            break;
+        }
+        n++;
+    }
+    kfree(buf);
+    if (rc)
+        return rc;
+    return n ? n : -EINVAL;
+}
+EXPORT_SYMBOL(l2_nodes_parse);
+
+int l2_nodes_find(const struct l2_node *nodes, u32 n, phys_addr_t pa, u64 bytes)
+{
+    int nid = phys_to_target_node(pa);
+    u32 i;
+
+    for (i = 0; i < n; i++) {
+        if (nodes[i].cxl_base && nodes[i].nid == nid && pa >= nodes[i].cxl_base)
+            return i;
+    }
+    // No firmware node for the range: a window runs from its base to the node's end
+    for (i = 0; i < n; i++) {
+        phys_addr_t end = PFN_PHYS(node_end_pfn(nodes[i].nid));
+
+        if (nodes[i].cxl_base && pa >= nodes[i].cxl_base && pa + bytes <= end)
+            return i;
+    }
+    return -1;
+}
+
+static struct page *l2_sg_pages(int nid, unsigned int order)
+{
+    gfp_t gfp = GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY;
+
+    return nid == NUMA_NO_NODE ? alloc_pages(gfp, order) : alloc_pages_node(nid, gfp, order);
+}
+
+// Largest chunk that still fits, stepping the order down while allocation fails
+static int l2_sg_add_chunk(struct l2_sg_table *t, u64 want, u32 unit_vecs,
+                           const struct l2_sg_owner *o)
+{
+    size_t unit_bytes = (size_t)unit_vecs * t->vec_bytes;
+    unsigned int min_order = get_order(unit_bytes);
+    unsigned int order = min_t(unsigned int, get_order(want * t->vec_bytes), MAX_PAGE_ORDER);
+    struct l2_sg_chunk *c, *grown;
+    struct page *pg = NULL;
+
+    if (min_order > MAX_PAGE_ORDER)
+        return -EINVAL;
+    for (order = max(order, min_order); ; order--) {
+        pg = l2_sg_pages(o->nid, order);
+        if (pg || order == min_order)
+            break;
+    }
+    if (!pg)
+        return -ENOMEM;
+    // Without __GFP_THISNODE a full node falls back elsewhere: the DPA would be wrong
+    if (o->nid != NUMA_NO_NODE && page_to_nid(pg) != o->nid)
+        pr_warn_once("l2_sg: node %d is full, chunk landed on node %d\n",
+                     o->nid, page_to_nid(pg));
+
+    grown = krealloc_array(t->chunks, t->nchunks + 1, sizeof(*t->chunks), GFP_KERNEL);
+    if (!grown) {
+        __free_pages(pg, order);
+        return -ENOMEM;
+    }
+    t->chunks = grown;
+
+    c = &t->chunks[t->nchunks++];
+    c->pages  = pg;
+    c->order  = order;
+    c->va     = page_address(pg);
+    c->dev_pa = l2_device_pa(page_to_phys(pg), o->nid, o->cxl_base);
+    c->cap    = rounddown(((size_t)PAGE_SIZE << order) / t->vec_bytes, unit_vecs);
+    c->cap    = min(c->cap, want);
+    c->nvecs  = 0;
+    t->cap   += c->cap;
+    return 0;
+}
+
+// Chained descriptor pages for t->nchunks chunks, on the same node
+static int l2_sg_desc_alloc(struct l2_sg_table *t, int nid, u64 cxl_base)
+{
+    u32 i;
+
+    // One descriptor per chunk plus a chain slot per full page
+    t->ndesc = DIV_ROUND_UP(t->nchunks, L2_SG_PER_PAGE - 1);
+    t->desc  = kcalloc(t->ndesc, sizeof(*t->desc), GFP_KERNEL);
+    if (!t->desc)
+        return -ENOMEM;
+    for (i = 0; i < t->ndesc; i++) {
+        t->desc[i] = l2_sg_pages(nid, 0);
+        if (!t->desc[i])
+            return -ENOMEM;
+    }
+    t->desc_pa = l2_device_pa(page_to_phys(t->desc[0]), nid, cxl_base);
+
+    // Chain slots never change: write them once
+    for (i = 0; i + 1 < t->ndesc; i++) {
+        struct l2_sg_desc *d = page_address(t->desc[i]);
+
+        d[L2_SG_PER_PAGE - 1].addr  = cpu_to_le64(l2_device_pa(page_to_phys(t->desc[i + 1]),
+                                                               nid, cxl_base));
+        d[L2_SG_PER_PAGE - 1].nvecs = 0;
+        d[L2_SG_PER_PAGE - 1].flags = cpu_to_le32(L2_SG_CHAIN);
+    }
+    return 0;
+}
+
+int l2_sg_alloc(struct l2_sg_table *t, u64 vecs, u32 vec_bytes, u32 unit_vecs,
+                int nid, u64 cxl_base)
+{
+    struct l2_sg_owner o = { .nid = nid, .cxl_base = cxl_base };
+    int rc;
+
+    memset(t, 0, sizeof(*t));
+    t->vec_bytes = vec_bytes;
+    unit_vecs = max_t(u32, unit_vecs, 1);
+
+    while (t->cap < vecs) {
+        rc = l2_sg_add_chunk(t, roundup(vecs - t->cap, unit_vecs), unit_vecs, &o);
+        if (rc)
+            goto err;
+    }
+
+    rc = l2_sg_desc_alloc(t, nid, cxl_base);
+    if (rc)
+        goto err;
+    return 0;
+
+err:
+    l2_sg_free(t);
+    return rc;
+}
+
+int l2_sg_wrap(struct l2_sg_table *t, void *va, phys_addr_t dev_pa, u64 vecs, u32 vec_bytes,
+               int nid, u64 cxl_base)
+{
+    int rc;
+
+    memset(t, 0, sizeof(*t));
+    t->vec_bytes = vec_bytes;
+    t->chunks = kcalloc(1, sizeof(*t->chunks), GFP_KERNEL);
+    if (!t->chunks)
+        return -ENOMEM;
+    t->chunks[0].va     = va;
+    t->chunks[0].dev_pa = dev_pa;
+    t->chunks[0].cap    = vecs;
+    t->nchunks = 1;
+    t->cap     = vecs;
+
+    rc = l2_sg_desc_alloc(t, nid, cxl_base);
+    if (rc)
+        l2_sg_free(t);
+    return rc;
+}
+
+void l2_sg_free(struct l2_sg_table *t)
+{
+    u32 i;
+
+    for (i = 0; i < t->nchunks; i++) {
+        if (t->chunks[i].pages)
+            __free_pages(t->chunks[i].pages, t->chunks[i].order);
+    }
+    if (t->desc) {
+        for (i = 0; i < t->ndesc; i++) {
+            if (t->desc[i])
+                __free_page(t->desc[i]);
+        }
+    }
+    kfree(t->desc);
+    kfree(t->chunks);
+    memset(t, 0, sizeof(*t));
+}
+
+void l2_sg_fill(struct l2_sg_table *t, u64 nvecs)
+{
+    u64 left = nvecs;
+    u32 i;
+
+    t->used = 0;
+    for (i = 0; i < t->nchunks; i++) {
+        struct l2_sg_chunk *c = &t->chunks[i];
+
+        c->nvecs = min(c->cap, left);
+        left    -= c->nvecs;
+        if (c->nvecs)
+            t->used++;
+    }
+
+    for (i = 0; i < t->used; i++) {
+        struct l2_sg_desc *d = page_address(t->desc[i / (L2_SG_PER_PAGE - 1)]);
+        struct l2_sg_desc *e = &d[i % (L2_SG_PER_PAGE - 1)];
+
+        e->addr  = cpu_to_le64(t->chunks[i].dev_pa);
+        e->nvecs = cpu_to_le32((u32)t->chunks[i].nvecs);
+        e->flags = cpu_to_le32(i + 1 == t->used ? L2_SG_LAST : 0);
+    }
+}
+
+const void *l2_sg_vec(const struct l2_sg_table *t, u64 v)
+{
+    u32 i;
+
+    for (i = 0; i < t->used; i++) {
+        if (v < t->chunks[i].nvecs)
+            return (const u8 *)t->chunks[i].va + v * t->vec_bytes;
+        v -= t->chunks[i].nvecs;
+    }
+    return NULL;
+}
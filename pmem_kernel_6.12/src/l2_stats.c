@@ -0,0 +1,384 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/fs.h>
+#include <linux/string.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/mutex.h>
+
+#include "l2_stats.h"
+
+// The tracepoint bodies live here; everyone else just includes l2_trace.h
+#define CREATE_TRACE_POINTS
+#include "l2_trace.h"
+
+// Bucket b counts samples in [2^b, 2^(b+1)) ns; the last one is open-ended
+#define L2_STATS_BUCKETS 40
+
+struct l2_stats_cpu {
+    u64 hist[L2_PH_NR][L2_STATS_BUCKETS];
+    u64 ns[L2_PH_NR];
+    u64 ctr[L2_CTR_NR];
+};
+
+static DEFINE_PER_CPU(struct l2_stats_cpu, l2_stats_pcpu);
+static struct dentry *l2_stats_dir;
+
+struct l2_run_batch {
+    u64 scan;
+    u64 pass;
+    u64 vecs;
+    u64 cycles;
+    u64 dev_ns;
+    u64 wall_ns;
+    u32 nq;
+};
+
+// Last run; l2_run_lock guards it against the debugfs readers
+static struct {
+    enum l2_run_state    state;
+    int                  rc;
+    u64                  seq;       /* bumped by every run_begin */
+    bool                 have_totals;
+    struct l2_run_totals t;
+    struct l2_run_batch *batches;   /* L2_RUN_MAX_BATCHES, allocated on first use */
+    u32                  nbatches;
+    u64                  dropped;
+} l2_run;
+static DEFINE_MUTEX(l2_run_lock);
+
+static const char *const l2_run_state_names[] = {
+    [L2_RUN_IDLE]    = "idle",
+    [L2_RUN_RUNNING] = "running",
+    [L2_RUN_DONE]    = "done",
+    [L2_RUN_FAILED]  = "failed",
+};
+
+static const char *const l2_phase_names[L2_PH_NR] = {
+    [L2_PH_READ]     = "read",
+    [L2_PH_PREP]     = "prep",
+    [L2_PH_STALL]    = "stall",
+    [L2_PH_CSR]      = "csr",
+    [L2_PH_WAIT]     = "wait",
+    [L2_PH_READBACK] = "readback",
+    [L2_PH_BATCH]    = "batch",
+};
+
+static const char *const l2_ctr_names[L2_CTR_NR] = {
+    [L2_CTR_BYTES_READ] = "bytes_read",
+    [L2_CTR_BATCHES]    = "batches",
+    [L2_CTR_VECS]       = "vectors",
+    [L2_CTR_PAIRS]      = "pairs",
+    [L2_CTR_CYCLES]     = "cycles",
+    [L2_CTR_DEV_NS]     = "dev_ns",
+    [L2_CTR_WALL_NS]    = "wall_ns",
+    [L2_CTR_M5_HITS]    = "m5_hits",
+    [L2_CTR_TIER_CANDIDATES] = "tier_candidates",
+    [L2_CTR_TIER_PROMOTED]   = "tier_promoted",
+    [L2_CTR_TIER_DEMOTED]    = "tier_demoted",
+    [L2_CTR_TIER_UNMOVABLE]  = "tier_unmovable",
+};
+
+void l2_stats_phase(enum l2_phase ph, u64 ns)
+{
+    u32 b = ns ? min(ilog2(ns), L2_STATS_BUCKETS - 1) : 0;
+
+    this_cpu_inc(l2_stats_pcpu.hist[ph][b]);
+    this_cpu_add(l2_stats_pcpu.ns[ph], ns);
+}
+
+void l2_stats_add(enum l2_ctr c, u64 v)
+{
+    this_cpu_add(l2_stats_pcpu.ctr[c], v);
+}
+
+// Per-CPU sums are unsynchronised snapshots; good enough for counters
+static void l2_stats_sum(struct l2_stats_cpu *sum)
+{
+    int cpu, p, b, c;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        const struct l2_stats_cpu *s = per_cpu_ptr(&l2_stats_pcpu, cpu);
+
+        for (p = 0; p < L2_PH_NR; p++) {
+            for (b = 0; b < L2_STATS_BUCKETS; b++)
+                sum->hist[p][b] += READ_ONCE(s->hist[p][b]);
+            sum->ns[p] += READ_ONCE(s->ns[p]);
+        }
+        for (c = 0; c < L2_CTR_NR; c++)
+            sum->ctr[c] += READ_ONCE(s->ctr[c]);
+    }
+}
+
+static int l2_hist_show(struct seq_file *m, void *v)
+{
+    struct l2_stats_cpu *sum;
+    int p, b;
+
+    // ~2.6 KiB: too big for the stack
+    sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    l2_stats_sum(sum);
+
+    for (p = 0; p < L2_PH_NR; p++) {
+        u64 n = 0;
+        int lo = -1, hi = -1;
+
+        for (b = 0; b < L2_STATS_BUCKETS; b++) {
+            if (!sum->hist[p][b])
+                continue;
+            n += sum->hist[p][b];
+            if (lo < 0)
+                lo = b;
+            hi = b;
+        }
+        seq_printf(m, "%s: n=%llu total_ns=%llu avg_ns=%llu\n", l2_phase_names[p],
+                   n, sum->ns[p], n ? div64_u64(sum->ns[p], n) : 0);
+
+        // Print the populated range only, gaps included so the shape is visible
+        for (b = lo; lo >= 0 && b <= hi; b++)
+            seq_printf(m, "  %12llu ns%s %llu\n", 1ull << b,
+                       b == L2_STATS_BUCKETS - 1 ? "+:" : ": ", sum->hist[p][b]);
+    }
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(l2_hist);
+
+static int l2_counters_show(struct seq_file *m, void *v)
+{
+    struct l2_stats_cpu *sum;
+    int c;
+
+    sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    l2_stats_sum(sum);
+
+    for (c = 0; c < L2_CTR_NR; c++)
+        seq_printf(m, "%s %llu\n", l2_ctr_names[c], sum->ctr[c]);
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(l2_counters);
+
+// Any write clears everything; racing updates may survive, which is harmless
+static ssize_t l2_reset_write(struct file *file, const char __user *buf,
+                              size_t len, loff_t *ppos)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(&l2_stats_pcpu, cpu), 0, sizeof(struct l2_stats_cpu));
+    return len;
+}
+
+static const struct file_operations l2_reset_fops = {
+    .owner = THIS_MODULE,
+    .write = l2_reset_write,
+};
+
+// ---------- Last run ----------
+void l2_stats_run_begin(void)
+{
+    mutex_lock(&l2_run_lock);
+    if (!l2_run.batches)
+        l2_run.batches = kvcalloc(L2_RUN_MAX_BATCHES, sizeof(*l2_run.batches), GFP_KERNEL);
+    l2_run.state       = L2_RUN_RUNNING;
+    l2_run.rc          = 0;
+    l2_run.seq++;
+    l2_run.have_totals = false;
+    l2_run.nbatches    = 0;
+    l2_run.dropped     = 0;
+    mutex_unlock(&l2_run_lock);
+}
+
+void l2_stats_run_batch(u64 scan, u64 pass, u64 vecs, u32 nq, u64 cycles,
+                        u64 dev_ns, u64 wall_ns)
+{
+    struct l2_run_batch *b;
+
+    mutex_lock(&l2_run_lock);
+    if (l2_run.state != L2_RUN_RUNNING)
+        goto out;
+    if (!l2_run.batches || l2_run.nbatches == L2_RUN_MAX_BATCHES) {
+        l2_run.dropped++;
+        goto out;
+    }
+    b = &l2_run.batches[l2_run.nbatches++];
+    b->scan    = scan;
+    b->pass    = pass;
+    b->vecs    = vecs;
+    b->nq      = nq;
+    b->cycles  = cycles;
+    b->dev_ns  = dev_ns;
+    b->wall_ns = wall_ns;
+out:
+    mutex_unlock(&l2_run_lock);
+}
+
+void l2_stats_run_totals(const struct l2_run_totals *t)
+{
+    mutex_lock(&l2_run_lock);
+    l2_run.t           = *t;
+    l2_run.have_totals = true;
+    mutex_unlock(&l2_run_lock);
+}
+
+void l2_stats_run_end(int rc)
+{
+    mutex_lock(&l2_run_lock);
+    l2_run.rc    = rc;
+    l2_run.state = rc ? L2_RUN_FAILED : L2_RUN_DONE;
+    mutex_unlock(&l2_run_lock);
+}
+
+static int l2_state_show(struct seq_file *m, void *v)
+{
+    mutex_lock(&l2_run_lock);
+    seq_printf(m, "%s\n", l2_run_state_names[l2_run.state]);
+    mutex_unlock(&l2_run_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(l2_state);
+
+// x/1000 as a JSON number with three decimals
+static void l2_json_milli(struct seq_file *m, const char *key, u64 x1000, bool last)
+{
+    seq_printf(m, "  \"%s\": %llu.%03llu%s\n", key, div_u64(x1000, 1000),
+               x1000 % 1000, last ? "" : ",");
+}
+
+static void l2_json_u64(struct seq_file *m, const char *key, u64 v)
+{
+    seq_printf(m, "  \"%s\": %llu,\n", key, v);
+}
+
+static int l2_run_json_show(struct seq_file *m, void *v)
+{
+    const struct l2_run_totals *t = &l2_run.t;
+    u64 scanned, dev_ns;
+
+    mutex_lock(&l2_run_lock);
+    seq_puts(m, "{\n");
+    l2_json_u64(m, "seq", l2_run.seq);
+    seq_printf(m, "  \"state\": \"%s\",\n", l2_run_state_names[l2_run.state]);
+    seq_printf(m, "  \"rc\": %d,\n", l2_run.rc);
+    l2_json_u64(m, "batches", l2_run.nbatches);
+    if (!l2_run.have_totals) {
+        seq_printf(m, "  \"batches_dropped\": %llu\n}\n", l2_run.dropped);
+        goto out;
+    }
+    l2_json_u64(m, "batches_dropped", l2_run.dropped);
+
+    scanned = t->vecs * t->vec_bytes;
+    dev_ns  = t->clk_mhz ? div_u64(t->cycles * 1000ull, t->clk_mhz) : 0;
+    seq_printf(m, "  \"engine\": \"%s\",\n", t->engine);
+    seq_printf(m, "  \"elem\": \"%s\",\n", t->elem);
+    l2_json_u64(m, "dim", t->dim);
+    l2_json_u64(m, "vec_bytes", t->vec_bytes);
+    l2_json_u64(m, "clk_mhz", t->clk_mhz);
+    l2_json_u64(m, "queries", t->queries);
+    l2_json_u64(m, "depth", t->depth);
+    l2_json_u64(m, "nodes", t->nodes);
+    l2_json_u64(m, "engines", t->engines);
+    seq_printf(m, "  \"direct\": %s,\n", t->direct ? "true" : "false");
+    seq_printf(m, "  \"p2p\": %s,\n", t->p2p ? "true" : "false");
+    seq_printf(m, "  \"dax\": %s,\n", t->dax ? "true" : "false");
+    l2_json_u64(m, "aio_qd", t->aio_qd);
+    seq_printf(m, "  \"resident\": %s,\n", t->resident ? "true" : "false");
+    l2_json_u64(m, "batch_vecs", t->batch_vecs);
+    l2_json_u64(m, "scans", t->scans);
+    l2_json_u64(m, "vecs", t->vecs);
+    l2_json_u64(m, "pairs", t->pairs);
+    l2_json_u64(m, "bytes", scanned);
+    l2_json_u64(m, "bytes_read", t->bytes_read);
+    l2_json_u64(m, "cycles_total", t->cycles);
+    l2_json_milli(m, "cycles_per_vec", t->vecs ? div64_u64(t->cycles * 1000ull, t->vecs) : 0, false);
+    l2_json_milli(m, "cycles_per_pair", t->pairs ? div64_u64(t->cycles * 1000ull, t->pairs) : 0, false);
+    l2_json_u64(m, "dev_ns", dev_ns);
+    l2_json_u64(m, "wall_ns", t->wall_ns);
+    l2_json_u64(m, "read_ns", t->read_ns);
+    l2_json_u64(m, "compute_ns", t->compute_ns);
+    l2_json_u64(m, "io_stall_ns", t->io_stall_ns);
+    l2_json_u64(m, "load_stall_ns", t->load_stall_ns);
+    l2_json_u64(m, "verified", t->verified);
+    l2_json_u64(m, "mismatches", t->mismatches);
+    // bytes per ns == GB/s (decimal)
+    l2_json_milli(m, "gbps_dev", dev_ns ? div64_u64(scanned * 1000ull, dev_ns) : 0, false);
+    l2_json_milli(m, "gbps_wall", t->wall_ns ? div64_u64(scanned * 1000ull, t->wall_ns) : 0, true);
+    seq_puts(m, "}\n");
+out:
+    mutex_unlock(&l2_run_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(l2_run_json);
+
+// The series can run to megabytes: iterate rather than render it in one go
+static void *l2_batches_start(struct seq_file *m, loff_t *pos)
+{
+    mutex_lock(&l2_run_lock);
+    if (!*pos)
+        return SEQ_START_TOKEN;
+    return *pos <= l2_run.nbatches ? &l2_run.batches[*pos - 1] : NULL;
+}
+
+static void *l2_batches_next(struct seq_file *m, void *v, loff_t *pos)
+{
+    ++*pos;
+    return *pos <= l2_run.nbatches ? &l2_run.batches[*pos - 1] : NULL;
+}
+
+static void l2_batches_stop(struct seq_file *m, void *v)
+{
+    mutex_unlock(&l2_run_lock);
+}
+
+static int l2_batches_show(struct seq_file *m, void *v)
+{
+    const struct l2_run_batch *b = v;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_puts(m, "scan,pass,vecs,queries,cycles,dev_ns,wall_ns\n");
+        return 0;
+    }
+    seq_printf(m, "%llu,%llu,%llu,%u,%llu,%llu,%llu\n",
+               b->scan, b->pass, b->vecs, b->nq, b->cycles, b->dev_ns, b->wall_ns);
+    return 0;
+}
+
+static const struct seq_operations l2_batches_sops = {
+    .start = l2_batches_start,
+    .next  = l2_batches_next,
+    .stop  = l2_batches_stop,
+    .show  = l2_batches_show,
+};
+DEFINE_SEQ_ATTRIBUTE(l2_batches);
+
+int l2_stats_init(void)
+{
+    // debugfs failures are not fatal: the module just runs without the files
+    l2_stats_dir = debugfs_create_dir("l2_engine", NULL);
+    debugfs_create_file("hist", 0444, l2_stats_dir, NULL, &l2_hist_fops);
+    debugfs_create_file("counters", 0444, l2_stats_dir, NULL, &l2_counters_fops);
+    debugfs_create_file("reset", 0200, l2_stats_dir, NULL, &l2_reset_fops);
+    debugfs_create_file("state", 0444, l2_stats_dir, NULL, &l2_state_fops);
+    debugfs_create_file("run.json", 0444, l2_stats_dir, NULL, &l2_run_json_fops);
+    debugfs_create_file("batches.csv", 0444, l2_stats_dir, NULL, &l2_batches_fops);
+    return 0;
+}
+
+void l2_stats_exit(void)
+{
+    debugfs_remove_recursive(l2_stats_dir);
+    l2_stats_dir = NULL;
+    kvfree(l2_run.batches);
+    l2_run.batches = NULL;
+}
@@ -11,10 +11,25 @@
 #include <linux/version.h>
 #include <linux/string.h>
 #include <linux/types.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/gcd.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
 #include <asm/barrier.h>
 
 #include "cxl_func.h"
 #include "l2_stream.h"
+#include "l2_engine.h"
+#include "l2_nvme.h"
+#include "l2_pq.h"
+#include "l2_reader.h"
+#include "l2_sg.h"
+#include "l2_stats.h"
+#include "l2_topk.h"
+#include "l2_trace.h"
 
 // ---------- Simple file I/O wrappers ----------
 static long write_text_simple(const char *path, const char *buf, size_t len)
@@ -82,194 +97,1489 @@ static void free_contig(struct page *pg, size_t bytes)
     if (pg) __free_pages(pg, get_order(bytes));
 }
 
-// ---------- One-batch CSR launch ----------
-static int l2_launch_batch(phys_addr_t device_base_pa,
-                           phys_addr_t query_pa,
-                           u64         num_vecs,
-                           u32         dim_cfg,
+// ---------- One-batch launch ----------
+static int l2_launch_batch(struct l2_engine *eng,
+                           const struct l2_job *job,
                            u64        *cycles_out)
 {
-    volatile unsigned long long *csr = get_virt_addr();
+    u64 resp_val = 0;
 
-    volatile u64 *REG_PAGE_ADDR0  = (u64 *)(csr + (0x0008 >> 3));
-    volatile u64 *REG_PAGE_ADDR1  = (u64 *)(csr + (0x0010 >> 3));
-    volatile u64 *REG_DELAY       = (u64 *)(csr + (0x0018 >> 3));
-    volatile u64 *REG_TEST_CASE   = (u64 *)(csr + (0x0020 >> 3));
-    volatile u64 *REG_RESP        = (u64 *)(csr + (0x0028 >> 3));
-    volatile u64 *REG_NUM_REQ     = (u64 *)(csr + (0x0060 >> 3));
-    volatile u64 *REG_ADDR_RANGE  = (u64 *)(csr + (0x0068 >> 3));
-    volatile u64 *REG_L2_START    = (u64 *)(csr + (0x0070 >> 3));
+    // Per-batch results go to the l2_batch tracepoint, not the kernel log
+    return l2_engine_run(eng, job, cycles_out, &resp_val);
+}
+
+
+// ---------- Batch ring ----------
+#define L2_BATCH_KB_DEFAULT  4096
+// Pages asked of dax_direct_access() at a time when mapping a namespace (1 GiB)
+#define L2_DAX_MAP_ORDER     18
+
+#define L2_RESULT_PATH       "/home/lifan3/cxl_dist_cal/data/l2_stream_result.txt"
+#define L2_QUERY_RESULT_PATH "/home/lifan3/cxl_dist_cal/data/l2_stream_queries.txt"
+#define L2_TOPK_RESULT_PATH  "/home/lifan3/cxl_dist_cal/data/l2_stream_topk.bin"
+
+// Per-batch distance buffer is one contiguous allocation
+#define L2_DIST_BUF_MAX      ((size_t)PAGE_SIZE << MAX_PAGE_ORDER)
+
+enum { L2_SLOT_FREE = 0, L2_SLOT_FULL = 1 };
+
+struct l2_slot {
+    struct l2_sg_table sg;      /* batch buffer: one or more chunks on the CXL node */
+    u64          nvecs;
+    int          state;
+};
+
+struct l2_shard;
+
+struct l2_pipe {
+    const struct l2_stream_cfg *cfg;    /* caller's, valid during a load or run only */
+    struct l2_vec_layout lay;       /* base (and query) file layout */
+    struct l2_pq      pq;           /* codebook when the base set is PQ8 codes */
+    u64               total_vecs;
+    struct l2_reader  reader;
+    struct l2_nvme_q *nvme;         /* P2P ingest; the reader then only tracks offsets */
+    struct arona_dax_state *dax;    /* DAX: slots wrap this mapping, see l2_pipe_map_dax() */
+    struct l2_slot   *slots;
+    u32               depth;
+    u64               batch_vecs;
+    bool              resident;     /* every batch loaded once, slots never recycled */
+    struct l2_node    nodes[L2_MAX_NODES];  /* slot i lives on nodes[i % nnodes] */
+    u32               nnodes;
+
+    // Several engines: the base set is split into shards, see l2_pipe_shard()
+    struct l2_shard  *shards;
+    u32               nshards;
+    u64               first_vec;    /* shard: its first vector in the base file */
+    u64               pass0;        /* shard: its first batch in the base file */
+
+    wait_queue_head_t wq;
+    struct completion loader_done;
+    int               err;      /* set by the loader on a read failure */
+    bool              stop;     /* set by the consumer to retire the loader */
+
+    /* Totals over all scans of the base file */
+    u64               scans;
+    u64               cycles_acc;
+    u64               vecs_acc;     /* base vectors launched */
+    u64               pairs_acc;    /* vector x query comparisons */
+
+    /* Per-stage timing (ns) */
+    u64               read_ns;        /* loader: file reads into slots */
+    u64               load_stall_ns;  /* loader: waiting for a free slot */
+    u64               io_stall_ns;    /* engine side: waiting for a full slot */
+    u64               compute_ns;     /* engine side: launch to done */
+};
+
+static void l2_pipe_free(struct l2_pipe *p)
+{
+    u32 i;
+
+    if (p->slots) {
+        for (i = 0; i < p->depth; i++)
+            l2_sg_free(&p->slots[i].sg);
+        kfree(p->slots);
+        p->slots = NULL;
+    }
+    // After the slots: their chunks point into the mapping
+    if (p->dax) {
+        arona_dax_stop(p->dax);
+        p->dax = NULL;
+    }
+}
+
+// Chunks hold whole O_DIRECT steps (P2P: whole blocks) so every chunk read starts aligned
+static int l2_pipe_alloc(struct l2_pipe *p)
+{
+    bool aligned = p->cfg->direct || p->nvme;
+    u32 unit = aligned ? L2_READER_ALIGN / gcd(p->lay.vec_bytes, L2_READER_ALIGN) : 1;
+    u32 i;
+
+    p->slots = kcalloc(p->depth, sizeof(*p->slots), GFP_KERNEL);
+    if (!p->slots)
+        return -ENOMEM;
+
+    // Round-robin over the CXL nodes: consecutive batches use different links
+    for (i = 0; i < p->depth; i++) {
+        struct l2_slot *s = &p->slots[i];
+        const struct l2_node *n = &p->nodes[i % p->nnodes];
+
+        if (l2_sg_alloc(&s->sg, p->batch_vecs, p->lay.vec_bytes, unit, n->nid, n->cxl_base)) {
+            pr_err("l2_stream: batch buffer %u/%u allocation on node %d failed\n",
+                   i, p->depth, n->nid);
+            l2_pipe_free(p);
+            return -ENOMEM;
+        }
+        s->state = L2_SLOT_FREE;
+    }
+    pr_info("l2_stream: %u batch buffers of %u chunk(s) on %u node(s)\n", p->depth,
+            p->slots[0].sg.nchunks, p->nnodes);
+    return 0;
+}
+
+/*
+ * DAX: the base set already sits in pmem, so map the namespace and point one
+ * slot at each batch of it. Every slot is FULL from the start, nothing is
+ * read or copied; only the descriptor pages are allocated (round-robin over
+ * the nodes, as for l2_pipe_alloc()).
+ */
+static int l2_pipe_map_dax(struct l2_pipe *p)
+{
+    u32 vb = p->lay.vec_bytes;
+    phys_addr_t pa, dev_base;
+    u64 first = 0;
+    u32 i;
+    int rc, owner;
+
+    p->dax = arona_dax_start(p->cfg->base_path, L2_DAX_MAP_ORDER);
+    if (IS_ERR(p->dax)) {
+        rc = PTR_ERR(p->dax);
+        p->dax = NULL;
+        return rc;
+    }
+    if (p->dax->size < p->total_vecs * vb) {
+        pr_err("l2_stream: %s holds %lu bytes, %llu vectors need %llu\n", p->cfg->base_path,
+               p->dax->size, p->total_vecs, p->total_vecs * vb);
+        return -EINVAL;
+    }
+    pa = PFN_PHYS(p->dax->pfn);
+
+    // A namespace on a CXL device is addressed through its window; others by host PA
+    owner = l2_nodes_find(p->nodes, p->nnodes, pa, p->dax->size);
+    dev_base = owner < 0 ? pa : l2_device_pa(pa, p->nodes[owner].nid, p->nodes[owner].cxl_base);
+
+    p->depth = DIV_ROUND_UP(p->total_vecs, p->batch_vecs);
+    p->slots = kcalloc(p->depth, sizeof(*p->slots), GFP_KERNEL);
+    if (!p->slots)
+        return -ENOMEM;
+
+    for (i = 0; i < p->depth; i++) {
+        struct l2_slot *s = &p->slots[i];
+        const struct l2_node *n = &p->nodes[i % p->nnodes];
+        u64 nvecs = min(p->batch_vecs, p->total_vecs - first);
+
+        rc = l2_sg_wrap(&s->sg, p->dax->va + first * vb, dev_base + first * vb, nvecs, vb,
+                        n->nid, n->cxl_base);
+        if (rc)
+            return rc;
+        l2_sg_fill(&s->sg, nvecs);
+        s->nvecs = nvecs;
+        s->state = L2_SLOT_FULL;
+        first   += nvecs;
+    }
+    pr_info("l2_stream: %llu vectors in %u batches served in place from %s (%s)\n",
+            p->total_vecs, p->depth, p->cfg->base_path,
+            owner < 0 ? "host PA" : "CXL window");
+    return 0;
+}
+
+/*
+ * P2P: one NVMe READ stream per chunk, straight into the chunk's pages, all
+ * of the batch in flight at once. Each chunk's last block is read whole;
+ * nothing past the batch is zeroed, the engines stop at nvecs anyway.
+ */
+static void l2_slot_release_sg(void *arg)
+{
+    l2_sg_free(arg);
+    kfree(arg);
+}
 
-    const int max_tries = 1000000;
-    int       tries;
+static int l2_slot_read_p2p(struct l2_pipe *p, struct l2_slot *s, u64 *bytes)
+{
+    u32 bs = l2_nvme_block_size(p->nvme);
+    struct l2_nvme_io io;
+    int rc = 0, wrc;
+    u32 c;
 
-    /* Program batch parameters */
-    *REG_PAGE_ADDR0 = device_base_pa;      /* base vectors physical address */
-    *REG_PAGE_ADDR1 = query_pa;     /* query vector physical address */
-    *REG_NUM_REQ    = num_vecs;     /* number of vectors in this batch */
-    *REG_ADDR_RANGE = dim_cfg;      /* dimension, e.g., 128 */
-    mb();
+    l2_nvme_io_init(&io);
+    for (c = 0; c < s->sg.used; c++) {
+        const struct l2_sg_chunk *ch = &s->sg.chunks[c];
+        size_t len = (size_t)ch->nvecs * p->lay.vec_bytes;
 
-    *REG_TEST_CASE = 100ull;
-    mb();
+        rc = l2_nvme_read(p->nvme, &io, p->reader.pos, page_to_phys(ch->pages),
+                          round_up(len, bs));
+        if (rc)
+            break;
+        p->reader.pos        += len;
+        p->reader.bytes_read += len;
+        *bytes += len;
+    }
+    // Whatever was queued lands in the chunks: wait for it even after an error
+    wrc = l2_nvme_wait(p->nvme, &io);
+    if (wrc == -ETIMEDOUT) {
+        // The SSD may still write the chunks: they go to the queue, not l2_pipe_free()
+        struct l2_sg_table *t = kmemdup(&s->sg, sizeof(s->sg), GFP_KERNEL);
 
-    *REG_L2_START = 0ull;
-    mb();
+        if (t)
+            l2_nvme_park(p->nvme, l2_slot_release_sg, t);
+        else
+            pr_warn("l2_stream: leaking a batch buffer the SSD may still write\n");
+        memset(&s->sg, 0, sizeof(s->sg));
+    }
+    return rc ? rc : wrc;
+}
+
+// One synchronous kernel_read stream per chunk, in order
+static int l2_slot_read_sync(struct l2_pipe *p, struct l2_slot *s, u64 *bytes)
+{
+    u32 c;
+
+    for (c = 0; c < s->sg.used; c++) {
+        const struct l2_sg_chunk *ch = &s->sg.chunks[c];
+        size_t bs = (size_t)ch->nvecs * p->lay.vec_bytes;
+
+        if (l2_reader_read(&p->reader, ch->va, bs, PAGE_SIZE << ch->order) != (long)bs)
+            return -EIO;
+        *bytes += bs;
+    }
+    return 0;
+}
 
-    *REG_L2_START = 1ull; // set start
-    mb();
+// Every chunk of the batch queued as asynchronous reads at once, then waited for
+static int l2_slot_read_aio(struct l2_pipe *p, struct l2_slot *s, u64 *bytes)
+{
+    struct l2_reader_batch b;
+    long n = 0;
+    int rc;
+    u32 c;
 
-    for (tries = 0; tries < max_tries; ++tries) { // poll for done
-        u64 resp = *REG_RESP;
+    l2_reader_batch_init(&b);
+    for (c = 0; c < s->sg.used; c++) {
+        const struct l2_sg_chunk *ch = &s->sg.chunks[c];
+        size_t bs = (size_t)ch->nvecs * p->lay.vec_bytes;
 
-        if (resp & 0x1ull)
+        n = l2_reader_submit(&p->reader, &b, ch->pages, bs, PAGE_SIZE << ch->order);
+        if (n != (long)bs)
             break;
+        *bytes += bs;
+    }
+    // Whatever was queued lands in the chunks: wait for it even after an error
+    rc = l2_reader_wait(&p->reader, &b);
+    if (c < s->sg.used)
+        return n < 0 ? n : -EIO;
+    if (rc)
+        return rc;
+
+    // Same chunk contents as l2_reader_read(): zeroes past the payload
+    for (c = 0; c < s->sg.used; c++) {
+        const struct l2_sg_chunk *ch = &s->sg.chunks[c];
+        size_t bs = (size_t)ch->nvecs * p->lay.vec_bytes;
 
-        usleep_range(500, 700);
+        memset((u8 *)ch->va + bs, 0, (PAGE_SIZE << ch->order) - bs);
     }
+    return 0;
+}
 
-    if (tries == max_tries)
-        return -ETIMEDOUT;
+// Read the next nvecs base vectors into a slot's chunks
+static int l2_slot_read(struct l2_pipe *p, struct l2_slot *s, u64 pass, u64 nvecs)
+{
+    ktime_t t0 = ktime_get(), t1;
+    u64 bytes = 0, ns;
+    int rc;
 
-    // Read cycles and result
-    *cycles_out = *REG_DELAY; 
-    u64 resp_val = *REG_RESP;
-    u64 l2_res = resp_val >> 1; // Upper 63 bits hold the result
-    
-    // Print the last result for verification
-    pr_info("l2_stream: Batch done. Cycles=%llu, Last L2 Result=%llu\n", 
-            (unsigned long long)*cycles_out, (unsigned long long)l2_res);
+    l2_sg_fill(&s->sg, nvecs);
+    t1 = ktime_get();
+    ns = ktime_to_ns(ktime_sub(t1, t0));
+    l2_stats_phase(L2_PH_PREP, ns);
+    trace_l2_prep(pass, s->sg.used, ns);
 
-    *REG_L2_START = 0ull; // clear start
-    mb();
+    if (p->nvme)
+        rc = l2_slot_read_p2p(p, s, &bytes);
+    else if (p->reader.aio_qd)
+        rc = l2_slot_read_aio(p, s, &bytes);
+    else
+        rc = l2_slot_read_sync(p, s, &bytes);
+    if (rc)
+        return rc;
 
+    ns = ktime_to_ns(ktime_sub(ktime_get(), t1));
+    l2_stats_phase(L2_PH_READ, ns);
+    l2_stats_add(L2_CTR_BYTES_READ, bytes);
+    trace_l2_read(pass, bytes, ns);
     return 0;
 }
 
+// Loader thread: fills slot (pass % depth) while the engine works on earlier passes
+static int l2_loader_fn(void *arg)
+{
+    struct l2_pipe *p = arg;
+    u64 remain = p->total_vecs, pass;
 
-// ---------- Public API ----------
-// ---------- Public API ----------
-int run_l2_streaming_from_file(const char *base_path,
-                               const char *query_path,
-                               u64 total_vecs, u32 dim,
-                               u64 batch_vecs, u32 clk_mhz,
-                               int cxl_nid, u64 cxl_base)
-{
-    const size_t BYTES_PER_VEC = 512;     // 128 * 4B
-    const size_t QUERY_BYTES   = BYTES_PER_VEC;
-
-    struct page *query_page = NULL, *base_pages = NULL;
-    void *query_va = NULL, *base_va = NULL;
-    phys_addr_t query_pa = 0, cpu_base_pa = 0;
-
-    // Allocate a page for the query (512B fits)
-    query_page = alloc_page(GFP_KERNEL);
-    if (!query_page) return -ENOMEM;
-    query_va = page_address(query_page);
-    query_pa = virt_to_phys(query_va);
-
-    // Load query
-    {
-        loff_t qpos = 0;
-        int e = read_exact_simple(query_path, query_va, QUERY_BYTES, &qpos);
-        if (e) { __free_page(query_page); return e; }
-    }
-
-    // Batch setup
-    if (batch_vecs == 0 || batch_vecs > total_vecs) batch_vecs = total_vecs;
-    {
-        size_t batch_bytes = (size_t)batch_vecs * BYTES_PER_VEC;
-        if (batch_bytes & (PAGE_SIZE - 1))
-            batch_bytes = (batch_bytes + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-
-        if (alloc_contig(batch_bytes, cxl_nid, &base_pages, &cpu_base_pa, &base_va)) {
-            __free_page(query_page);
+    for (pass = 0; remain; pass++) {
+        struct l2_slot *s = &p->slots[pass % p->depth];
+        u64 this_vecs  = (remain > p->batch_vecs) ? p->batch_vecs : remain;
+        ktime_t t0 = ktime_get(), t1;
+
+        wait_event(p->wq, smp_load_acquire(&s->state) == L2_SLOT_FREE ||
+                          READ_ONCE(p->stop));
+        if (READ_ONCE(p->stop))
+            break;
+        t1 = ktime_get();
+        p->load_stall_ns += ktime_to_ns(ktime_sub(t1, t0));
+
+        if (l2_slot_read(p, s, p->pass0 + pass, this_vecs)) {
+            pr_err("l2_stream: base read failed at pass %llu\n", p->pass0 + pass);
+            WRITE_ONCE(p->err, -EIO);
+            wake_up(&p->wq);
+            break;
+        }
+        p->read_ns += ktime_to_ns(ktime_sub(ktime_get(), t1));
+
+        s->nvecs = this_vecs;
+        smp_store_release(&s->state, L2_SLOT_FULL);
+        wake_up(&p->wq);
+
+        remain -= this_vecs;
+    }
+
+    kthread_complete_and_exit(&p->loader_done, 0);
+}
+
+// Block of queries compared against every base batch in one scan
+struct l2_qblock {
+    struct page *pages;
+    size_t       bytes;
+    void        *va;
+    phys_addr_t  pa;
+    u32          first;     /* index of the first query in query_path */
+    u32          nq;
+    u64         *last_l2;   /* per-query RESP[63:1] of the latest batch */
+    u64         *lut;       /* PQ: per-query lookup tables, the engine's "queries" */
+
+    // Top-k (cfg->topk > 0); dist only for engines without native top-k
+    struct l2_topk *tk;
+    struct page *dist_pages;
+    size_t       dist_bytes;
+    u64         *dist;
+    phys_addr_t  dist_pa;
+};
+
+static void l2_qblock_free(struct l2_qblock *qb, u32 block)
+{
+    u32 q;
+
+    if (qb->tk) {
+        for (q = 0; q < block; q++)
+            l2_topk_free(&qb->tk[q]);
+        kfree(qb->tk);
+    }
+    free_contig(qb->dist_pages, qb->dist_bytes);
+    kvfree(qb->lut);
+    kfree(qb->last_l2);
+    free_contig(qb->pages, qb->bytes);
+    memset(qb, 0, sizeof(*qb));
+}
+
+// vec_bytes == 0: no query region, the caller points va/pa at someone else's
+static int l2_qblock_alloc(struct l2_qblock *qb, u32 block, u32 vec_bytes, u32 k,
+                           bool need_dist, u64 batch_vecs, size_t lut_bytes)
+{
+    void *va;
+    u32 q;
+
+    if (vec_bytes) {
+        qb->bytes = PAGE_ALIGN((size_t)block * vec_bytes);
+        if (alloc_contig(qb->bytes, NUMA_NO_NODE, &qb->pages, &qb->pa, &qb->va))
             return -ENOMEM;
+    }
+    qb->last_l2 = kcalloc(block, sizeof(*qb->last_l2), GFP_KERNEL);
+    if (!qb->last_l2)
+        goto err;
+    if (lut_bytes) {
+        qb->lut = kvmalloc_array(block, lut_bytes, GFP_KERNEL);
+        if (!qb->lut)
+            goto err;
+    }
+    if (!k)
+        return 0;
+
+    if (need_dist) {
+        qb->dist_bytes = PAGE_ALIGN((size_t)batch_vecs * block * sizeof(u64));
+        if (alloc_contig(qb->dist_bytes, NUMA_NO_NODE, &qb->dist_pages, &qb->dist_pa, &va))
+            goto err;
+        qb->dist = va;
+    }
+
+    qb->tk = kcalloc(block, sizeof(*qb->tk), GFP_KERNEL);
+    if (!qb->tk)
+        goto err;
+    for (q = 0; q < block; q++) {
+        if (l2_topk_init(&qb->tk[q], k))
+            goto err;
+    }
+    return 0;
+
+err:
+    l2_qblock_free(qb, block);
+    return -ENOMEM;
+}
+
+static int l2_load_queries(const struct l2_pipe *p, struct l2_qblock *qb)
+{
+    loff_t qpos = (loff_t)qb->first * p->lay.query_bytes;
+    long r = read_exact_simple(p->cfg->query_path, qb->va, (size_t)qb->nq * p->lay.query_bytes, &qpos);
+
+    // Short read: query_path holds fewer than query_first + num_queries queries
+    if (r > 0)
+        return -EIO;
+    return (int)r;
+}
+
+// Append "qid last_l2" lines for one query block
+static void l2_write_query_results(struct file *f, loff_t *pos, const struct l2_qblock *qb)
+{
+    char line[64];
+    u32 q;
+
+    for (q = 0; q < qb->nq; q++) {
+        int n = scnprintf(line, sizeof(line), "%u %llu\n", qb->first + q,
+                          (unsigned long long)qb->last_l2[q]);
+
+        if (kernel_write(f, line, n, pos) != n) {
+            pr_err("l2_stream: failed to write per-query results\n");
+            return;
         }
+    }
+}
 
-        // Calculate Device Physical Address (DPA) if using CXL memory
-        phys_addr_t device_pa = cpu_base_pa;
-        if (cxl_nid != NUMA_NO_NODE && cxl_base != 0) {
-            if (cpu_base_pa >= cxl_base) {
-                device_pa = cpu_base_pa - cxl_base;
-            } else {
-                pr_warn("l2_stream: Allocated address %llx < cxl_base %llx, using raw PA\n",
-                        (unsigned long long)cpu_base_pa, (unsigned long long)cxl_base);
-            }
+// One full scan of the base file against a query block
+static int l2_stream_scan(struct l2_pipe *p, struct l2_engine *eng, struct l2_qblock *qb)
+{
+    struct task_struct *loader;
+    u64 nbatches = DIV_ROUND_UP(p->total_vecs, p->batch_vecs), pass;
+    bool pq = p->lay.pq_m;
+    size_t lut_bytes = pq ? l2_pq_lut_bytes(&p->pq) : 0;
+    u32 i;
+    int rc = 0;
+
+    // PQ: the engine compares codes against per-query tables, not the queries
+    for (i = 0; pq && i < qb->nq; i++)
+        l2_pq_build_lut(&p->pq, (const u8 *)qb->va + (size_t)i * p->lay.query_bytes,
+                        (u64 *)((u8 *)qb->lut + i * lut_bytes));
+
+    // Resident batches are all FULL already: no loader, no stalls
+    if (!p->resident) {
+        for (i = 0; i < p->depth; i++)
+            p->slots[i].state = L2_SLOT_FREE;
+        p->err  = 0;
+        p->stop = false;
+        reinit_completion(&p->loader_done);
+        l2_reader_rewind(&p->reader);
+
+        loader = kthread_run(l2_loader_fn, p, "l2_loader");
+        if (IS_ERR(loader))
+            return PTR_ERR(loader);
+    }
+
+    // Engine side: consume slots in order
+    for (pass = 0; pass < nbatches; pass++) {
+        struct l2_slot *s = &p->slots[pass % p->depth];
+        ktime_t t0 = ktime_get(), t1;
+        u64 cyc = 0, stall_ns, wall_ns, dev_ns;
+
+        wait_event(p->wq, smp_load_acquire(&s->state) == L2_SLOT_FULL ||
+                          READ_ONCE(p->err));
+        if (smp_load_acquire(&s->state) != L2_SLOT_FULL) {
+            rc = READ_ONCE(p->err);
+            break;
         }
+        t1 = ktime_get();
+        stall_ns = ktime_to_ns(ktime_sub(t1, t0));
+        p->io_stall_ns += stall_ns;
+        l2_stats_phase(L2_PH_STALL, stall_ns);
+        trace_l2_stall(p->pass0 + pass, stall_ns);
 
-        // Stream the base file
         {
-            loff_t bpos = 0;
-            u64 remain = total_vecs, pass = 0;
-            u64 cycles_acc = 0, vecs_acc = 0;
-
-            while (remain) {
-                u64 this_vecs  = (remain > batch_vecs) ? batch_vecs : remain;
-                size_t this_bs = (size_t)this_vecs * BYTES_PER_VEC;
-
-                memset(base_va, 0, batch_bytes);
-                if (read_exact_simple(base_path, base_va, this_bs, &bpos)) {
-                    pr_err("l2_stream: base read failed at pass %llu\n", pass);
-                    free_contig(base_pages, batch_bytes);
-                    __free_page(query_page);
-                    return -EIO;
-                }
-
-                {
-                    u64 cyc = 0;
-                    // Use device_pa for the FPGA
-                    int rc = l2_launch_batch(device_pa, query_pa, this_vecs, dim, &cyc);
-                    if (rc) {
-                        pr_err("l2_stream: batch failed at pass %llu (rc=%d)\n", pass, rc);
-                        free_contig(base_pages, batch_bytes);
-                        __free_page(query_page);
-                        return rc;
-                    }
-                    cycles_acc += cyc;
-                    vecs_acc   += this_vecs;
-                    pr_info("l2_stream: pass=%llu vecs=%llu cyc=%llu acc=%llu\n",
-                            pass, this_vecs, cyc, cycles_acc);
-                }
-
-                remain -= this_vecs;
-                pass++;
-            }
+            // Device addresses for the FPGA, va for CPU-side engines
+            struct l2_job job = {
+                .base_pa      = s->sg.chunks[0].dev_pa,
+                .base_va      = s->sg.chunks[0].va,
+                .sg           = s->sg.used > 1 ? &s->sg : NULL,
+                .query_pa     = pq ? 0 : qb->pa,
+                .query_va     = pq ? (void *)qb->lut : qb->va,
+                .num_vecs     = s->nvecs,
+                .dim          = l2_layout_width(&p->lay),
+                .elem         = p->lay.elem,
+                .num_queries  = qb->nq,
+                .query_stride = pq ? lut_bytes : p->lay.query_bytes,
+                .last_l2      = qb->last_l2,
+                .dist         = qb->dist,
+                .dist_pa      = qb->dist_pa,
+                .topk         = qb->tk,
+                .id_base      = p->first_vec + pass * p->batch_vecs,
+            };
 
-            // Summary
-            if (vecs_acc) {
-                char out[512];
-                u64 cpv_x1000 = (cycles_acc * 1000ull) / vecs_acc;
-                u64 time_ns   = clk_mhz ? (cycles_acc * 1000ull) / clk_mhz : 0;
-
-                scnprintf(out, sizeof(out),
-                          "L2 stream result:\n"
-                          "total_vecs=%llu\n"
-                          "dim=%u\n"
-                          "clk_mhz=%u\n"
-                          "cycles_total=%llu\n"
-                          "cycles_per_vec=%llu.%03llu\n"
-                          "~time_ns=%llu\n",
-                          (unsigned long long)vecs_acc,
-                          dim,
-                          clk_mhz,
-                          (unsigned long long)cycles_acc,
-                          (unsigned long long)(cpv_x1000/1000ull),
-                          (unsigned long long)(cpv_x1000%1000ull),
-                          (unsigned long long)time_ns);
-
-                if (write_text_simple("/home/lifan3/cxl_dist_cal/data/l2_stream_result.txt",
-                                      out, strlen(out)) < 0)
-                    pr_err("l2_stream: failed to write result file\n");
-                else
-                    pr_info("%s", out);
-            }
+            rc = l2_launch_batch(eng, &job, &cyc);
+        }
+        wall_ns = ktime_to_ns(ktime_sub(ktime_get(), t1));
+        p->compute_ns += wall_ns;
+        if (rc) {
+            pr_err("l2_stream: batch failed at pass %llu (rc=%d)\n", p->pass0 + pass, rc);
+            break;
         }
 
-        free_contig(base_pages, batch_bytes);
+        p->cycles_acc += cyc;
+        p->vecs_acc   += s->nvecs;
+        p->pairs_acc  += s->nvecs * qb->nq;
+
+        dev_ns = eng->cfg.clk_mhz ? div_u64(cyc * 1000ull, eng->cfg.clk_mhz) : 0;
+        l2_stats_phase(L2_PH_BATCH, wall_ns);
+        l2_stats_add(L2_CTR_BATCHES, 1);
+        l2_stats_add(L2_CTR_VECS, s->nvecs);
+        l2_stats_add(L2_CTR_PAIRS, s->nvecs * qb->nq);
+        l2_stats_add(L2_CTR_CYCLES, cyc);
+        l2_stats_add(L2_CTR_DEV_NS, dev_ns);
+        l2_stats_add(L2_CTR_WALL_NS, wall_ns);
+        trace_l2_batch(p->pass0 + pass, s->nvecs, qb->nq, cyc, dev_ns, wall_ns);
+        l2_stats_run_batch(p->scans, p->pass0 + pass, s->nvecs, qb->nq, cyc, dev_ns, wall_ns);
+
+        if (!p->resident) {
+            smp_store_release(&s->state, L2_SLOT_FREE);
+            wake_up(&p->wq);
+        }
+    }
+
+    // Retire the loader before the slots are reused
+    if (!p->resident) {
+        WRITE_ONCE(p->stop, true);
+        wake_up(&p->wq);
+        wait_for_completion(&p->loader_done);
     }
 
-    __free_page(query_page);
+    if (!rc)
+        p->scans++;
+    return rc;
+}
+
+// ---------- Sharding across engines ----------
+/*
+ * With more than one engine (FPGA board) a file run splits the base set
+ * into contiguous, batch-aligned shards, one per engine. Each shard is a
+ * pipe of its own, with its own reader, batch buffers and loader, and a
+ * query block of its own for top-k and distances. Every query block is
+ * scanned by all shards at once; their heaps (global ids already) are then
+ * merged into the run's block.
+ */
+struct l2_shard {
+    struct l2_pipe    p;
+    struct l2_engine *eng;
+    struct l2_qblock  qb;       /* queries are the run's; the rest is per shard */
+    struct completion done;
+    int               rc;
+};
+
+static void l2_shards_free(struct l2_pipe *p)
+{
+    u32 i;
+
+    for (i = 0; i < p->nshards; i++) {
+        l2_pipe_free(&p->shards[i].p);
+        l2_reader_close(&p->shards[i].p.reader);
+    }
+    kfree(p->shards);
+    p->shards  = NULL;
+    p->nshards = 0;
+}
+
+// Split the set-up pipe p over up to n engines; frees nothing on error
+static int l2_pipe_shard(struct l2_pipe *p, u32 n)
+{
+    u64 per = roundup(DIV_ROUND_UP(p->total_vecs, n), p->batch_vecs);
+    u64 first;
+    u32 i;
+    int rc;
+
+    p->shards = kcalloc(n, sizeof(*p->shards), GFP_KERNEL);
+    if (!p->shards)
+        return -ENOMEM;
+
+    for (i = 0, first = 0; i < n && first < p->total_vecs; i++, first += per) {
+        struct l2_shard *sh = &p->shards[i];
+        struct l2_pipe *sp = &sh->p;
+
+        sp->cfg        = p->cfg;
+        sp->lay        = p->lay;
+        sp->pq         = p->pq;         /* shared, freed with p */
+        sp->nvme       = p->nvme;
+        sp->first_vec  = first;
+        sp->pass0      = div64_u64(first, p->batch_vecs);
+        sp->total_vecs = min(per, p->total_vecs - first);
+        sp->depth      = p->depth;
+        sp->batch_vecs = p->batch_vecs;
+        sp->nnodes     = p->nnodes;
+        memcpy(sp->nodes, p->nodes, sizeof(p->nodes));
+        init_waitqueue_head(&sp->wq);
+        init_completion(&sp->loader_done);
+        init_completion(&sh->done);
+        sh->eng = l2_engine_get_nth(i);
+        p->nshards = i + 1;
+
+        rc = l2_reader_open(&sp->reader, p->cfg->base_path, p->reader.direct,
+                            p->reader.ra_bytes);
+        if (rc)
+            return rc;
+        rc = l2_reader_aio(&sp->reader, p->reader.aio_qd, p->reader.aio_bytes,
+                           p->reader.aio_cpus);
+        if (rc)
+            return rc;
+        sp->reader.start = first * p->lay.vec_bytes;
+        rc = l2_pipe_alloc(sp);
+        if (rc)
+            return rc;
+    }
+    pr_info("l2_stream: %u shards of up to %llu vectors, one per engine\n", p->nshards, per);
     return 0;
 }
+
+static int l2_shards_qblock_alloc(struct l2_pipe *p, u32 block, u32 k, bool need_dist,
+                                  size_t lut_bytes)
+{
+    u32 i;
+
+    for (i = 0; i < p->nshards; i++) {
+        if (l2_qblock_alloc(&p->shards[i].qb, block, 0, k, need_dist, p->batch_vecs, lut_bytes))
+            return -ENOMEM;
+    }
+    return 0;
+}
+
+static void l2_shards_qblock_free(struct l2_pipe *p, u32 block)
+{
+    u32 i;
+
+    for (i = 0; i < p->nshards; i++)
+        l2_qblock_free(&p->shards[i].qb, block);
+}
+
+// The run's totals are the shards' sums (stage times add up across engines)
+static void l2_shards_sum(struct l2_pipe *p)
+{
+    u32 i;
+
+    p->cycles_acc = p->vecs_acc = p->pairs_acc = 0;
+    p->read_ns = p->load_stall_ns = p->io_stall_ns = p->compute_ns = 0;
+    p->reader.bytes_read = 0;
+    for (i = 0; i < p->nshards; i++) {
+        const struct l2_pipe *sp = &p->shards[i].p;
+
+        p->cycles_acc    += sp->cycles_acc;
+        p->vecs_acc      += sp->vecs_acc;
+        p->pairs_acc     += sp->pairs_acc;
+        p->read_ns       += sp->read_ns;
+        p->load_stall_ns += sp->load_stall_ns;
+        p->io_stall_ns   += sp->io_stall_ns;
+        p->compute_ns    += sp->compute_ns;
+        p->reader.bytes_read += sp->reader.bytes_read;
+    }
+}
+
+static int l2_shard_fn(void *arg)
+{
+    struct l2_shard *sh = arg;
+
+    sh->rc = l2_stream_scan(&sh->p, sh->eng, &sh->qb);
+    kthread_complete_and_exit(&sh->done, 0);
+}
+
+// One concurrent scan of every shard against qb's queries, merged into qb
+static int l2_stream_scan_shards(struct l2_pipe *p, struct l2_qblock *qb)
+{
+    struct task_struct *t;
+    u32 i, q, started;
+    int rc = 0;
+
+    for (started = 0; started < p->nshards; started++) {
+        struct l2_shard *sh = &p->shards[started];
+
+        sh->qb.va    = qb->va;
+        sh->qb.pa    = qb->pa;
+        sh->qb.first = qb->first;
+        sh->qb.nq    = qb->nq;
+        for (q = 0; sh->qb.tk && q < qb->nq; q++)
+            l2_topk_reset(&sh->qb.tk[q]);
+        reinit_completion(&sh->done);
+
+        t = kthread_run(l2_shard_fn, sh, "l2_shard/%u", started);
+        if (IS_ERR(t)) {
+            rc = PTR_ERR(t);
+            break;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        wait_for_completion(&p->shards[i].done);
+        if (!rc)
+            rc = p->shards[i].rc;
+    }
+    if (rc)
+        return rc;
+
+    // The last shard ends with the file's last vector: its RESP is the block's
+    for (q = 0; q < qb->nq; q++) {
+        for (i = 0; qb->tk && i < p->nshards; i++)
+            l2_topk_merge_heap(&qb->tk[q], &p->shards[i].qb.tk[q]);
+        qb->last_l2[q] = p->shards[p->nshards - 1].qb.last_l2[q];
+    }
+    l2_shards_sum(p);
+    p->scans++;
+    return 0;
+}
+
+// Engine completion stats of a run: eng's, or summed over the shards' engines
+static void l2_pipe_wait_stats(const struct l2_pipe *p, const struct l2_engine *eng,
+                               struct l2_wait_stats *st)
+{
+    u32 i;
+
+    if (!p->nshards) {
+        *st = eng->stats;
+        return;
+    }
+    memset(st, 0, sizeof(*st));
+    for (i = 0; i < p->nshards; i++) {
+        const struct l2_wait_stats *e = &p->shards[i].eng->stats;
+
+        st->batches    += e->batches;
+        st->wall_ns    += e->wall_ns;
+        st->dev_ns     += e->dev_ns;
+        st->spins      += e->spins;
+        st->sleeps     += e->sleeps;
+        st->irqs       += e->irqs;
+        st->verified   += e->verified;
+        st->mismatches += e->mismatches;
+    }
+}
+
+// Final per-query top-k of one block into the binary results file
+static int l2_write_topk(struct file *f, loff_t *pos, struct l2_qblock *qb)
+{
+    u32 q;
+    int rc;
+
+    for (q = 0; q < qb->nq; q++) {
+        l2_topk_sort(&qb->tk[q]);
+        rc = l2_topk_write(f, pos, qb->first + q, &qb->tk[q]);
+        if (rc)
+            return rc;
+    }
+    return 0;
+}
+
+static void l2_write_summary(const struct l2_pipe *p, const struct l2_engine *eng,
+                             const struct l2_wait_stats *st, u32 num_queries, u64 wall_ns)
+{
+    const struct l2_stream_cfg *cfg = p->cfg;
+    u64 vecs_acc   = p->vecs_acc;
+    u64 cycles_acc = p->cycles_acc;
+    char out[1024];
+    u64 cpv_x1000 = (cycles_acc * 1000ull) / vecs_acc;
+    u64 cpp_x1000 = (cycles_acc * 1000ull) / p->pairs_acc;
+    u64 time_ns   = cfg->clk_mhz ? (cycles_acc * 1000ull) / cfg->clk_mhz : 0;
+    u64 hidden_pct = p->read_ns ?
+        (p->read_ns > p->io_stall_ns ? (p->read_ns - p->io_stall_ns) * 100ull / p->read_ns : 0) : 100;
+
+    scnprintf(out, sizeof(out),
+              "L2 stream result:\n"
+              "engine=%s\n"
+              "engines=%u\n"
+              "total_vecs=%llu\n"
+              "dim=%u\n"
+              "elem=%s\n"
+              "vec_bytes=%u\n"
+              "batch_vecs=%llu\n"
+              "clk_mhz=%u\n"
+              "cycles_total=%llu\n"
+              "cycles_per_vec=%llu.%03llu\n"
+              "~time_ns=%llu\n"
+              "queries=%u\n"
+              "scans=%llu\n"
+              "cycles_per_pair=%llu.%03llu\n"
+              "depth=%u\n"
+              "direct=%d\n"
+              "p2p=%d\n"
+              "dax=%d\n"
+              "aio_qd=%u\n"
+              "resident=%d\n"
+              "bytes_read=%llu\n"
+              "wall_ns=%llu\n"
+              "read_ns=%llu\n"
+              "compute_ns=%llu\n"
+              "io_stall_ns=%llu\n"
+              "load_stall_ns=%llu\n"
+              "io_hidden_pct=%llu\n"
+              "batch_wall_ns=%llu\n"
+              "batch_dev_ns=%llu\n"
+              "poll_tax_ns=%llu\n"
+              "verified=%llu\n"
+              "mismatches=%llu\n",
+              eng->ops->name,
+              max_t(u32, p->nshards, 1),
+              (unsigned long long)vecs_acc,
+              p->lay.dim,
+              l2_elem_name(p->lay.elem),
+              p->lay.vec_bytes,
+              (unsigned long long)p->batch_vecs,
+              cfg->clk_mhz,
+              (unsigned long long)cycles_acc,
+              (unsigned long long)(cpv_x1000/1000ull),
+              (unsigned long long)(cpv_x1000%1000ull),
+              (unsigned long long)time_ns,
+              num_queries,
+              (unsigned long long)p->scans,
+              (unsigned long long)(cpp_x1000/1000ull),
+              (unsigned long long)(cpp_x1000%1000ull),
+              p->depth,
+              p->reader.direct,
+              !!p->nvme,
+              !!p->dax,
+              p->reader.aio_qd,
+              p->resident,
+              (unsigned long long)p->reader.bytes_read,
+              (unsigned long long)wall_ns,
+              (unsigned long long)p->read_ns,
+              (unsigned long long)p->compute_ns,
+              (unsigned long long)p->io_stall_ns,
+              (unsigned long long)p->load_stall_ns,
+              (unsigned long long)hidden_pct,
+              (unsigned long long)st->wall_ns,
+              (unsigned long long)st->dev_ns,
+              (unsigned long long)(st->wall_ns > st->dev_ns ? st->wall_ns - st->dev_ns : 0),
+              (unsigned long long)st->verified,
+              (unsigned long long)st->mismatches);
+
+    if (write_text_simple(L2_RESULT_PATH, out, strlen(out)) < 0)
+        pr_err("l2_stream: failed to write result file\n");
+    else
+        pr_info("%s", out);
+}
+
+// Same totals for debugfs run.json
+static void l2_record_totals(const struct l2_pipe *p, const struct l2_engine *eng,
+                             const struct l2_wait_stats *st, u32 num_queries, u64 wall_ns)
+{
+    struct l2_run_totals t = {
+        .dim           = p->lay.dim,
+        .vec_bytes     = p->lay.vec_bytes,
+        .clk_mhz       = p->cfg->clk_mhz,
+        .queries       = num_queries,
+        .depth         = p->depth,
+        .nodes         = p->nnodes,
+        .engines       = max_t(u32, p->nshards, 1),
+        .direct        = p->reader.direct,
+        .p2p           = !!p->nvme,
+        .dax           = !!p->dax,
+        .aio_qd        = p->reader.aio_qd,
+        .resident      = p->resident,
+        .batch_vecs    = p->batch_vecs,
+        .scans         = p->scans,
+        .vecs          = p->vecs_acc,
+        .pairs         = p->pairs_acc,
+        .bytes_read    = p->reader.bytes_read,
+        .cycles        = p->cycles_acc,
+        .wall_ns       = wall_ns,
+        .read_ns       = p->read_ns,
+        .compute_ns    = p->compute_ns,
+        .io_stall_ns   = p->io_stall_ns,
+        .load_stall_ns = p->load_stall_ns,
+        .verified      = st->verified,
+        .mismatches    = st->mismatches,
+    };
+
+    strscpy(t.engine, eng->ops->name, sizeof(t.engine));
+    strscpy(t.elem, l2_elem_name(p->lay.elem), sizeof(t.elem));
+    l2_stats_run_totals(&t);
+}
+
+
+// ---------- Setup ----------
+// Queries must have the base set's layout
+static int l2_check_query_layout(const struct l2_pipe *p, const struct l2_stream_cfg *cfg)
+{
+    struct l2_vec_layout qlay;
+    int rc;
+
+    rc = l2_layout_resolve(cfg->query_path, cfg->dim, cfg->elem, &qlay);
+    if (rc)
+        return rc;
+    // PQ bases take full queries in the codebook's element type
+    if (qlay.pq_m || qlay.query_bytes != p->lay.query_bytes ||
+        qlay.query_elem != p->lay.query_elem) {
+        pr_err("l2_stream: query layout (dim=%u %s) does not match base (dim=%u %s)\n",
+               qlay.dim, l2_elem_name(qlay.elem), p->lay.dim, l2_elem_name(p->lay.query_elem));
+        return -EINVAL;
+    }
+    return 0;
+}
+
+// Full-precision vectors for PQ re-ranking: same dim and element as the queries
+static struct file *l2_open_rerank(const struct l2_pipe *p, const struct l2_stream_cfg *cfg)
+{
+    struct l2_vec_layout flay;
+    struct file *f;
+    int rc;
+
+    rc = l2_layout_resolve(cfg->rerank_path, 0, NULL, &flay);
+    if (rc)
+        return ERR_PTR(rc);
+    if (flay.pq_m || flay.vec_bytes != p->lay.query_bytes || flay.elem != p->lay.query_elem) {
+        pr_err("l2_stream: rerank set (dim=%u %s) does not match the queries (dim=%u %s)\n",
+               flay.dim, l2_elem_name(flay.elem), p->lay.dim, l2_elem_name(p->lay.query_elem));
+        return ERR_PTR(-EINVAL);
+    }
+    f = filp_open(cfg->rerank_path, O_RDONLY | O_LARGEFILE, 0);
+    if (IS_ERR(f))
+        pr_err("l2_stream: cannot open %s (%ld)\n", cfg->rerank_path, PTR_ERR(f));
+    return f;
+}
+
+// Layout, codebook, nodes, reader and batch sizing; the caller closes
+// p->reader and frees p->pq on error
+static int l2_pipe_setup(struct l2_pipe *p, const struct l2_stream_cfg *cfg, bool need_dist)
+{
+    struct l2_node def = { .nid = cfg->cxl_nid, .cxl_base = cfg->cxl_base };
+    int rc;
+
+    rc = l2_nodes_parse(cfg->cxl_nodes, &def, p->nodes, L2_MAX_NODES);
+    if (rc < 0)
+        return rc;
+    p->nnodes = rc;
+
+    // Vector layout from the .meta sidecars (no query_path: queries come from memory)
+    rc = l2_layout_resolve(cfg->base_path, cfg->dim, cfg->elem, &p->lay);
+    if (rc)
+        return rc;
+    if (cfg->query_path) {
+        rc = l2_check_query_layout(p, cfg);
+        if (rc)
+            return rc;
+    }
+
+    if (p->lay.pq_m) {
+        rc = l2_pq_load(&p->pq, cfg->base_path, &p->lay);
+        if (rc)
+            return rc;
+    }
+
+    rc = l2_reader_open(&p->reader, cfg->base_path, cfg->direct,
+                        (size_t)cfg->readahead_kb * 1024);
+    if (rc)
+        return rc;
+    rc = l2_reader_aio(&p->reader, cfg->aio_qd, (size_t)cfg->aio_kb * 1024, cfg->aio_cpus);
+    if (rc)
+        return rc;
+
+    if (cfg->p2p && cfg->dax) {
+        pr_err("l2_stream: p2p and dax both replace the reads, pick one\n");
+        return -EINVAL;
+    }
+    if (cfg->p2p) {
+        p->nvme = l2_nvme_get();
+        if (!p->nvme) {
+            pr_err("l2_stream: p2p ingest requested but no NVMe queue pair is set up\n");
+            return -ENODEV;
+        }
+        if (l2_nvme_block_size(p->nvme) > L2_READER_ALIGN)
+            return -EINVAL;
+    }
+
+    // total_vecs = 0 streams the whole file
+    p->total_vecs = p->lay.vectors ? p->lay.vectors : div_u64(p->reader.size, p->lay.vec_bytes);
+    if (cfg->total_vecs && cfg->total_vecs < p->total_vecs)
+        p->total_vecs = cfg->total_vecs;
+    else if (cfg->total_vecs > p->total_vecs)
+        pr_warn("l2_stream: total_vecs=%llu exceeds the file, streaming %llu\n",
+                cfg->total_vecs, p->total_vecs);
+    if (!p->total_vecs)
+        return -EINVAL;
+
+    // Batch setup: batch_vecs, or as many vectors as fit batch_kb
+    p->depth      = clamp_t(u32, cfg->depth, 1, L2_MAX_DEPTH);
+    if (p->depth < p->nnodes) {
+        // Fewer buffers than nodes would leave links idle
+        p->depth = min_t(u32, p->nnodes, L2_MAX_DEPTH);
+        pr_info("l2_stream: pipeline_depth raised to %u to cover every node\n", p->depth);
+    }
+    p->batch_vecs = cfg->batch_vecs;
+    if (!p->batch_vecs)
+        p->batch_vecs = max_t(u64, div_u64((u64)(cfg->batch_kb ? cfg->batch_kb : L2_BATCH_KB_DEFAULT) * 1024,
+                                           p->lay.vec_bytes), 1);
+    if (p->batch_vecs > p->total_vecs)
+        p->batch_vecs = p->total_vecs;
+    if (need_dist && p->batch_vecs > L2_DIST_BUF_MAX / sizeof(u64)) {
+        // Batches are scattered but one query's distances are not
+        p->batch_vecs = L2_DIST_BUF_MAX / sizeof(u64);
+        pr_info("l2_stream: top-k limits batch_vecs to %llu\n", p->batch_vecs);
+    }
+    if (cfg->direct || p->nvme) {
+        // O_DIRECT and NVMe READs need every batch to start on an L2_READER_ALIGN boundary
+        u64 step = L2_READER_ALIGN / gcd(p->lay.vec_bytes, L2_READER_ALIGN);
+
+        if (p->batch_vecs > step)
+            p->batch_vecs = round_down(p->batch_vecs, step);
+    }
+    init_waitqueue_head(&p->wq);
+    init_completion(&p->loader_done);
+    return 0;
+}
+
+// Zero the per-run totals; a resident pipe is served many times
+static void l2_pipe_reset_stats(struct l2_pipe *p)
+{
+    p->scans         = 0;
+    p->cycles_acc    = 0;
+    p->vecs_acc      = 0;
+    p->pairs_acc     = 0;
+    p->read_ns       = 0;
+    p->load_stall_ns = 0;
+    p->io_stall_ns   = 0;
+    p->compute_ns    = 0;
+    p->reader.bytes_read = 0;
+}
+
+// Serve every query of cfg against the pipe's base set, one scan per block
+static int l2_stream_serve(struct l2_pipe *p, struct l2_engine *eng,
+                           const struct l2_stream_cfg *cfg, bool need_dist)
+{
+    struct l2_qblock qb = { 0 };
+    struct file *qout = NULL, *tkout = NULL, *full = NULL;
+    loff_t qout_pos = 0, tk_pos = 0;
+    u32 num_queries, block, done, q, k_scan = cfg->topk;
+    size_t lut_bytes = p->lay.pq_m ? l2_pq_lut_bytes(&p->pq) : 0;
+    void *scratch = NULL;
+    ktime_t t_start;
+    int rc;
+
+    // Query block: Q queries contiguous in one region, compared per base batch
+    num_queries = max_t(u32, cfg->num_queries, 1);
+    block = cfg->query_block ? cfg->query_block : num_queries;
+    block = clamp_t(u32, block, 1, min_t(u32, num_queries, L2_MAX_QUERY_BLOCK));
+    if (need_dist) {
+        // One batch of distances per query must fit the contiguous result buffer
+        u32 fit = max_t(u64, div64_u64(L2_DIST_BUF_MAX, p->batch_vecs * sizeof(u64)), 1);
+
+        if (block > fit) {
+            pr_info("l2_stream: top-k limits the query block to %u\n", fit);
+            block = fit;
+        }
+    }
+    if (lut_bytes && block > L2_PQ_LUT_MAX / lut_bytes) {
+        block = max_t(u32, L2_PQ_LUT_MAX / lut_bytes, 1);
+        pr_info("l2_stream: PQ lookup tables limit the query block to %u\n", block);
+    }
+    // PQ re-ranking: keep more candidates than asked for, then narrow them
+    if (lut_bytes && cfg->topk && cfg->rerank_path && cfg->rerank > cfg->topk)
+        k_scan = cfg->rerank;
+
+    rc = l2_qblock_alloc(&qb, block, p->lay.query_bytes, k_scan, need_dist, p->batch_vecs,
+                         lut_bytes);
+    if (rc)
+        return rc;
+    rc = l2_shards_qblock_alloc(p, block, k_scan, need_dist, lut_bytes);
+    if (rc)
+        goto out_files;
+
+    if (k_scan != cfg->topk) {
+        full = l2_open_rerank(p, cfg);
+        if (IS_ERR(full)) {
+            rc = PTR_ERR(full);
+            full = NULL;
+            goto out_files;
+        }
+        scratch = kmalloc(p->lay.query_bytes, GFP_KERNEL);
+        if (!scratch) {
+            rc = -ENOMEM;
+            goto out_files;
+        }
+        pr_info("l2_stream: re-ranking %u PQ candidates per query against %s\n",
+                k_scan, cfg->rerank_path);
+    }
+
+    qout = filp_open(L2_QUERY_RESULT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (IS_ERR(qout)) {
+        pr_warn("l2_stream: cannot open %s, per-query results not saved\n", L2_QUERY_RESULT_PATH);
+        qout = NULL;
+    }
+
+    if (cfg->topk) {
+        struct l2_topk_file_hdr hdr = {
+            .magic       = L2_TOPK_MAGIC,
+            .version     = L2_TOPK_VERSION,
+            .k           = cfg->topk,
+            .num_queries = num_queries,
+            .dim         = p->lay.dim,
+            .total_vecs  = p->total_vecs,
+        };
+
+        tkout = filp_open(L2_TOPK_RESULT_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (IS_ERR(tkout)) {
+            rc = PTR_ERR(tkout);
+            tkout = NULL;
+            pr_err("l2_stream: cannot open %s (%d)\n", L2_TOPK_RESULT_PATH, rc);
+            goto out_files;
+        }
+        rc = l2_topk_write_hdr(tkout, &tk_pos, &hdr);
+        if (rc)
+            goto out_files;
+    }
+
+    if (p->nshards) {
+        for (q = 0; q < p->nshards; q++)
+            l2_engine_reset_stats(p->shards[q].eng);
+    } else {
+        l2_engine_reset_stats(eng);
+    }
+    t_start = ktime_get();
+
+    // One scan of the base file per query block
+    for (done = 0; done < num_queries; done += qb.nq) {
+        qb.first = cfg->query_first + done;
+        qb.nq    = min(block, num_queries - done);
+
+        rc = l2_load_queries(p, &qb);
+        if (rc) {
+            pr_err("l2_stream: query load failed at query %u (rc=%d)\n", qb.first, rc);
+            break;
+        }
+        if (qb.tk) {
+            for (q = 0; q < qb.nq; q++)
+                l2_topk_reset(&qb.tk[q]);
+        }
+
+        rc = p->nshards ? l2_stream_scan_shards(p, &qb) : l2_stream_scan(p, eng, &qb);
+        if (rc)
+            break;
+
+        pr_info("l2_stream: scan %llu done, queries %u..%u\n",
+                p->scans, qb.first, qb.first + qb.nq - 1);
+        if (qout)
+            l2_write_query_results(qout, &qout_pos, &qb);
+        for (q = 0; full && q < qb.nq; q++) {
+            rc = l2_pq_rerank(full, &p->lay, (u8 *)qb.va + (size_t)q * p->lay.query_bytes,
+                              &qb.tk[q], cfg->topk, scratch);
+            if (rc) {
+                pr_err("l2_stream: re-rank failed at query %u (%d)\n", qb.first + q, rc);
+                break;
+            }
+        }
+        if (rc)
+            break;
+        if (tkout) {
+            rc = l2_write_topk(tkout, &tk_pos, &qb);
+            if (rc) {
+                pr_err("l2_stream: failed to write top-k results (%d)\n", rc);
+                break;
+            }
+        }
+    }
+
+    // Summary
+    if (!rc && p->vecs_acc) {
+        u64 wall_ns = ktime_to_ns(ktime_sub(ktime_get(), t_start));
+        struct l2_wait_stats st;
+
+        l2_pipe_wait_stats(p, eng, &st);
+        l2_write_summary(p, eng, &st, num_queries, wall_ns);
+        l2_record_totals(p, eng, &st, num_queries, wall_ns);
+        for (q = 0; q < p->nshards; q++)
+            l2_engine_dump_stats(p->shards[q].eng);
+        if (!p->nshards)
+            l2_engine_dump_stats(eng);
+    }
+
+out_files:
+    kfree(scratch);
+    if (full)
+        filp_close(full, NULL);
+    if (tkout)
+        filp_close(tkout, NULL);
+    if (qout)
+        filp_close(qout, NULL);
+    l2_shards_qblock_free(p, block);
+    l2_qblock_free(&qb, block);
+    return rc;
+}
+
+static int l2_stream_run_file(struct l2_engine *eng, const struct l2_stream_cfg *cfg)
+{
+    bool need_dist = cfg->topk && !eng->ops->set_topk;
+    struct l2_pipe *p;
+    u32 nshards;
+    int rc;
+
+    p = kzalloc(sizeof(*p), GFP_KERNEL);
+    if (!p)
+        return -ENOMEM;
+    p->cfg = cfg;
+
+    rc = l2_pipe_setup(p, cfg, need_dist);
+    if (rc)
+        goto out_reader;
+
+    // Several engines: a shard each, unless there are fewer batches than engines
+    nshards = min_t(u64, l2_engine_count(), DIV_ROUND_UP(p->total_vecs, p->batch_vecs));
+    if (cfg->dax) {
+        // Mapped batches are all there at once: served like a resident set
+        p->resident = true;
+        rc = l2_pipe_map_dax(p);
+    } else if (nshards > 1)
+        rc = l2_pipe_shard(p, nshards);
+    else
+        rc = l2_pipe_alloc(p);
+    if (rc)
+        goto out_free;
+
+    rc = l2_stream_serve(p, eng, cfg, need_dist);
+
+out_free:
+    l2_shards_free(p);
+    l2_pipe_free(p);
+out_reader:
+    l2_reader_close(&p->reader);
+    l2_pq_free(&p->pq);
+    kfree(p);
+    return rc;
+}
+
+// ---------- Resident dataset ----------
+/*
+ * The whole base set loaded once into CXL-node batch buffers, one slot per
+ * batch, all permanently FULL. Scans walk the slots without a loader and
+ * never touch the file again until it is dropped.
+ */
+static struct l2_pipe *l2_resident;
+static u64 l2_resident_gen;         /* handle of the current resident set */
+
+// Serialises runs on the (single) engine and the resident set's lifetime
+static DEFINE_MUTEX(l2_stream_lock);
+
+static void l2_resident_free(struct l2_pipe *p)
+{
+    l2_pipe_free(p);
+    l2_reader_close(&p->reader);
+    l2_pq_free(&p->pq);
+    kfree(p);
+}
+
+static int l2_stream_run_resident(struct l2_engine *eng, const struct l2_stream_cfg *cfg)
+{
+    struct l2_pipe *p = l2_resident;
+    int rc;
+
+    if (!p) {
+        pr_err("l2_stream: no resident dataset loaded\n");
+        return -ENOENT;
+    }
+    rc = l2_check_query_layout(p, cfg);
+    if (rc)
+        return rc;
+    if (cfg->total_vecs && cfg->total_vecs != p->total_vecs)
+        pr_info("l2_stream: total_vecs ignored, serving all %llu resident vectors\n", p->total_vecs);
+
+    p->cfg = cfg;
+    l2_pipe_reset_stats(p);
+    rc = l2_stream_serve(p, eng, cfg, cfg->topk && !eng->ops->set_topk);
+    p->cfg = NULL;
+    return rc;
+}
+
+// ---------- Public API ----------
+int run_l2_streaming_from_file(const struct l2_stream_cfg *cfg)
+{
+    struct l2_engine *eng = l2_engine_get();
+    int rc;
+
+    if (!eng) {
+        pr_err("l2_stream: no L2 engine selected\n");
+        return -ENODEV;
+    }
+
+    mutex_lock(&l2_stream_lock);
+    l2_stats_run_begin();
+    if (cfg->resident)
+        rc = l2_stream_run_resident(eng, cfg);
+    else
+        rc = l2_stream_run_file(eng, cfg);
+    l2_stats_run_end(rc);
+    mutex_unlock(&l2_stream_lock);
+    return rc;
+}
 EXPORT_SYMBOL(run_l2_streaming_from_file);
+
+int l2_stream_load_resident(const struct l2_stream_cfg *cfg)
+{
+    struct l2_engine *eng = l2_engine_get();
+    struct l2_pipe *p;
+    ktime_t t0;
+    u64 remain;
+    u32 i;
+    int rc;
+
+    if (!eng) {
+        pr_err("l2_stream: no L2 engine selected\n");
+        return -ENODEV;
+    }
+    p = kzalloc(sizeof(*p), GFP_KERNEL);
+    if (!p)
+        return -ENOMEM;
+    p->cfg      = cfg;
+    p->resident = true;
+
+    // Size batches for host-side top-k too: a later run may ask for it
+    rc = l2_pipe_setup(p, cfg, !eng->ops->set_topk);
+    if (rc)
+        goto err;
+
+    if (cfg->dax) {
+        rc = l2_pipe_map_dax(p);
+        if (rc)
+            goto err;
+        l2_reader_close(&p->reader);
+        goto publish;
+    }
+
+    p->depth = DIV_ROUND_UP(p->total_vecs, p->batch_vecs);
+    rc = l2_pipe_alloc(p);
+    if (rc)
+        goto err;
+
+    t0 = ktime_get();
+    remain = p->total_vecs;
+    for (i = 0; i < p->depth; i++) {
+        struct l2_slot *s = &p->slots[i];
+        u64 this_vecs = min(remain, p->batch_vecs);
+
+        rc = l2_slot_read(p, s, i, this_vecs);
+        if (rc) {
+            pr_err("l2_stream: resident load failed at batch %u\n", i);
+            goto err;
+        }
+        s->nvecs = this_vecs;
+        s->state = L2_SLOT_FULL;
+        remain  -= this_vecs;
+    }
+    p->read_ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+    l2_reader_close(&p->reader);
+
+    pr_info("l2_stream: %llu vectors (%llu MiB) resident on %u node(s) in %u batches, loaded in %llu ms\n",
+            p->total_vecs, (p->total_vecs * p->lay.vec_bytes) >> 20, p->nnodes, p->depth,
+            div_u64(p->read_ns, NSEC_PER_MSEC));
+
+publish:
+    // cfg (and its strings) belong to the caller and go away on return
+    p->cfg = NULL;
+    mutex_lock(&l2_stream_lock);
+    swap(l2_resident, p);
+    l2_resident_gen++;
+    mutex_unlock(&l2_stream_lock);
+    if (p)
+        l2_resident_free(p);
+    return 0;
+
+err:
+    l2_resident_free(p);
+    return rc;
+}
+EXPORT_SYMBOL(l2_stream_load_resident);
+
+void l2_stream_drop_resident(void)
+{
+    mutex_lock(&l2_stream_lock);
+    if (l2_resident) {
+        l2_resident_free(l2_resident);
+        l2_resident = NULL;
+        pr_info("l2_stream: resident dataset released\n");
+    }
+    mutex_unlock(&l2_stream_lock);
+}
+EXPORT_SYMBOL(l2_stream_drop_resident);
+
+int l2_stream_resident_info(struct l2_resident_info *info)
+{
+    int rc = 0;
+
+    mutex_lock(&l2_stream_lock);
+    if (l2_resident) {
+        info->handle  = l2_resident_gen;
+        info->vectors = l2_resident->total_vecs;
+        info->lay     = l2_resident->lay;
+    } else {
+        rc = -ENOENT;
+    }
+    mutex_unlock(&l2_stream_lock);
+    return rc;
+}
+EXPORT_SYMBOL(l2_stream_resident_info);
+
+int l2_stream_search(struct l2_search *req)
+{
+    struct l2_engine *eng = l2_engine_get();
+    struct l2_qblock qb = { 0 };
+    struct l2_pipe *p;
+    size_t lut_bytes;
+    bool need_dist;
+    u32 block, done, q;
+    ktime_t t0;
+    int rc = 0;
+
+    if (!eng)
+        return -ENODEV;
+    if (!req->nq || !req->tk)
+        return -EINVAL;
+
+    mutex_lock(&l2_stream_lock);
+    p = l2_resident;
+    if (!p || req->handle != l2_resident_gen) {
+        rc = p ? -ESTALE : -ENOENT;
+        goto out_unlock;
+    }
+
+    // The caller's buffers are the query block: only the scratch is ours
+    need_dist = !eng->ops->set_topk;
+    block = min_t(u32, req->nq, L2_MAX_QUERY_BLOCK);
+    if (need_dist) {
+        block = clamp_t(u64, div64_u64(L2_DIST_BUF_MAX, p->batch_vecs * sizeof(u64)), 1, block);
+        qb.dist_bytes = PAGE_ALIGN((size_t)p->batch_vecs * block * sizeof(u64));
+        if (alloc_contig(qb.dist_bytes, NUMA_NO_NODE, &qb.dist_pages, &qb.dist_pa, (void **)&qb.dist)) {
+            rc = -ENOMEM;
+            goto out_unlock;
+        }
+    }
+    // PQ: tables are built per block; distances stay PQ estimates (no re-rank)
+    lut_bytes = p->lay.pq_m ? l2_pq_lut_bytes(&p->pq) : 0;
+    if (lut_bytes) {
+        block = clamp_t(u32, L2_PQ_LUT_MAX / lut_bytes, 1, block);
+        qb.lut = kvmalloc_array(block, lut_bytes, GFP_KERNEL);
+    }
+    qb.last_l2 = kcalloc(block, sizeof(*qb.last_l2), GFP_KERNEL);
+    if (!qb.last_l2 || (lut_bytes && !qb.lut)) {
+        rc = -ENOMEM;
+        goto out_free;
+    }
+
+    l2_pipe_reset_stats(p);
+    t0 = ktime_get();
+    for (done = 0; done < req->nq; done += qb.nq) {
+        qb.first = done;
+        qb.nq    = min(block, req->nq - done);
+        qb.va    = (u8 *)req->query_va + (size_t)done * p->lay.query_bytes;
+        qb.pa    = req->query_pa + (phys_addr_t)done * p->lay.query_bytes;
+        qb.tk    = req->tk + done;
+        for (q = 0; q < qb.nq; q++)
+            l2_topk_reset(&qb.tk[q]);
+
+        rc = l2_stream_scan(p, eng, &qb);
+        if (rc)
+            break;
+        for (q = 0; q < qb.nq; q++)
+            l2_topk_sort(&qb.tk[q]);
+    }
+    req->wall_ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+    req->cycles  = p->cycles_acc;
+
+out_free:
+    kvfree(qb.lut);
+    kfree(qb.last_l2);
+    free_contig(qb.dist_pages, qb.dist_bytes);
+out_unlock:
+    mutex_unlock(&l2_stream_lock);
+    return rc;
+}
+EXPORT_SYMBOL(l2_stream_search);
@@ -0,0 +1,135 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/sort.h>
+#include <linux/types.h>
+
+#include "l2_topk.h"
+
+// Strict "a is a worse neighbour than b": larger distance, then larger id
+static inline bool l2_topk_worse(const struct l2_topk_ent *a, const struct l2_topk_ent *b)
+{
+    return a->dist > b->dist || (a->dist == b->dist && a->id > b->id);
+}
+
+static void l2_topk_sift_down(struct l2_topk *t, u32 i)
+{
+    struct l2_topk_ent *e = t->e;
+
+    for (;;) {
+        u32 l = 2 * i + 1, r = l + 1, w = i;
+
+        if (l < t->n && l2_topk_worse(&e[l], &e[w]))
+            w = l;
+        if (r < t->n && l2_topk_worse(&e[r], &e[w]))
+            w = r;
+        if (w == i)
+            return;
+        swap(e[i], e[w]);
+        i = w;
+    }
+}
+
+static void l2_topk_sift_up(struct l2_topk *t, u32 i)
+{
+    struct l2_topk_ent *e = t->e;
+
+    while (i) {
+        u32 parent = (i - 1) / 2;
+
+        if (!l2_topk_worse(&e[i], &e[parent]))
+            return;
+        swap(e[i], e[parent]);
+        i = parent;
+    }
+}
+
+int l2_topk_init(struct l2_topk *t, u32 k)
+{
+    t->k = k;
+    t->n = 0;
+    t->e = kvcalloc(k, sizeof(*t->e), GFP_KERNEL);
+    return t->e ? 0 : -ENOMEM;
+}
+
+void l2_topk_free(struct l2_topk *t)
+{
+    kvfree(t->e);
+    t->e = NULL;
+    t->k = t->n = 0;
+}
+
+void l2_topk_reset(struct l2_topk *t)
+{
+    t->n = 0;
+}
+
+void l2_topk_push(struct l2_topk *t, u64 id, u64 dist)
+{
+    struct l2_topk_ent c = { .id = id, .dist = dist };
+
+    if (t->n < t->k) {
+        t->e[t->n] = c;
+        l2_topk_sift_up(t, t->n++);
+    } else if (l2_topk_worse(&t->e[0], &c)) {
+        // Better than the current worst: replace the root
+        t->e[0] = c;
+        l2_topk_sift_down(t, 0);
+    }
+}
+
+void l2_topk_merge(struct l2_topk *t, const u64 *dist, u64 nvecs, u64 id_base)
+{
+    u64 v;
+
+    for (v = 0; v < nvecs; v++)
+        l2_topk_push(t, id_base + v, dist[v]);
+}
+
+void l2_topk_merge_heap(struct l2_topk *t, const struct l2_topk *part)
+{
+    u32 i;
+
+    for (i = 0; i < part->n; i++)
+        l2_topk_push(t, part->e[i].id, part->e[i].dist);
+}
+
+static int l2_topk_cmp(const void *a, const void *b)
+{
+    const struct l2_topk_ent *x = a, *y = b;
+
+    if (l2_topk_worse(x, y))
+        return 1;
+    return l2_topk_worse(y, x) ? -1 : 0;
+}
+
+void l2_topk_sort(struct l2_topk *t)
+{
+    sort(t->e, t->n, sizeof(*t->e), l2_topk_cmp, NULL);
+}
+
+static int l2_topk_put(struct file *f, loff_t *pos, const void *buf, size_t len)
+{
+    ssize_t n = kernel_write(f, buf, len, pos);
+
+    if (n < 0)
+        return n;
+    return n == len ? 0 : -EIO;
+}
+
+int l2_topk_write_hdr(struct file *f, loff_t *pos, const struct l2_topk_file_hdr *hdr)
+{
+    return l2_topk_put(f, pos, hdr, sizeof(*hdr));
+}
+
+int l2_topk_write(struct file *f, loff_t *pos, u32 qid, const struct l2_topk *t)
+{
+    u32 rec[2] = { qid, t->n };
+    int rc;
+
+    rc = l2_topk_put(f, pos, rec, sizeof(rec));
+    if (rc)
+        return rc;
+    return l2_topk_put(f, pos, t->e, (size_t)t->n * sizeof(*t->e));
+}
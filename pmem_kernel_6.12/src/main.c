@@ -2,12 +2,20 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/types.h>
+#include <linux/string.h>
 #include <linux/mm.h>
 #include <asm/cacheflush.h>
 #include <linux/moduleparam.h>
 #include <linux/virtio.h>
 #include "cxl_func.h"
 #include "l2_stream.h"
+#include "l2_engine.h"
+#include "l2_meta.h"
+#include "l2_cdev.h"
+#include "l2_stats.h"
+#include "l2_nvme.h"
+#include "cxl_tier.h"
+#include "cxl_dev.h"
 #include "nvme.h"
 
 static char *base_path  = "/home/lifan3/emr3_back/pmem_kernel_6.12/data/base.bin";
@@ -16,6 +24,14 @@ MODULE_PARM_DESC(base_path, "Path to base vectors (raw float32, row-major)");
 
 static char *query_path = "/home/lifan3/emr3_back/pmem_kernel_6.12/data/query.bin";
 module_param(query_path, charp, 0644);
+MODULE_PARM_DESC(query_path, "Path to the query vector (same layout as base)");
+
+// cxl_set: selects what runs at insmod time (4 = single-shot L2, 5 = L2 streaming, 6 = resident)
+static int cxl_set = 5;
+module_param(cxl_set, int, 0644);
+MODULE_PARM_DESC(cxl_set, "Test selector (4: single-shot L2, 5: L2 streaming benchmark, 6: resident dataset, queried via run_queries)");
+
+static int iter = 0;
 module_param(iter, int, 0644);
 MODULE_PARM_DESC(iter, "Iteration count for legacy host memory latency tests");
 
@@ -42,16 +58,430 @@ static unsigned long long cxl_base = 0x8080000000ull;
 module_param(cxl_base, ullong, 0644);
 MODULE_PARM_DESC(cxl_base, "Base physical address of CXL memory window (for DPA calculation)");
 
+// Several expanders: batch buffers go round-robin over the list, each with its own window
+static char *cxl_nodes = "";
+module_param(cxl_nodes, charp, 0644);
+MODULE_PARM_DESC(cxl_nodes, "Interleave batch buffers over CXL nodes: nid[@window_base],... (empty = cxl_nid/cxl_base)");
+
+static unsigned long long total_vecs = 0;
+module_param(total_vecs, ullong, 0644);
+MODULE_PARM_DESC(total_vecs, "Number of base vectors to stream (0 = all, per base .meta)");
+
+static int dim = 0;
+module_param(dim, int, 0644);
+MODULE_PARM_DESC(dim, "Vector dimension programmed into REG_ADDR_RANGE (0 = from .meta, else 128)");
+
+static char *elem = "";
+module_param(elem, charp, 0644);
+MODULE_PARM_DESC(elem, "Element type: q16 | int8 | fp16 (empty = from .meta, else q16); PQ8 sets come from .meta");
+
+static unsigned long long batch_vecs = 0;
+module_param(batch_vecs, ullong, 0644);
+MODULE_PARM_DESC(batch_vecs, "Vectors per streaming batch (0 = as many as fit in batch_kb)");
+
+static int batch_kb = 4096;
+module_param(batch_kb, int, 0644);
+MODULE_PARM_DESC(batch_kb, "Batch buffer size (KiB) when batch_vecs=0; narrower elements fit more vectors. Above 4096 the buffer is scatter-gathered");
+
+static int pipeline_depth = 2;
+module_param(pipeline_depth, int, 0644);
+MODULE_PARM_DESC(pipeline_depth, "Batch buffers in flight while streaming (1 = serial, 2 = double, 3 = triple)");
+
+static bool odirect = false;
+module_param(odirect, bool, 0644);
+MODULE_PARM_DESC(odirect, "Read the base file with O_DIRECT (bypass the page cache)");
+
+static int readahead_kb = 16384;
+module_param(readahead_kb, int, 0644);
+MODULE_PARM_DESC(readahead_kb, "Readahead window kept ahead of the loader in buffered mode (KiB)");
+
+// aio_qd: keep this many base-file reads in flight instead of one kernel_read at a time
+static int aio_qd = 0;
+module_param(aio_qd, int, 0644);
+MODULE_PARM_DESC(aio_qd, "Asynchronous base-file reads in flight (0 = synchronous; with odirect they land in the batch buffers)");
+
+static int aio_kb = 1024;
+module_param(aio_kb, int, 0644);
+MODULE_PARM_DESC(aio_kb, "Size of each asynchronous read (KiB)");
+
+static int aio_cpus = 0;
+module_param(aio_cpus, int, 0644);
+MODULE_PARM_DESC(aio_cpus, "CPUs the asynchronous reads are submitted from, spreading them over hardware queues (0/1 = the loader)");
+
+// p2p: base vectors land in the batch buffers by NVMe READs instead of kernel_read
+static char *p2p = "";
+module_param(p2p, charp, 0444);
+MODULE_PARM_DESC(p2p, "P2P ingest: \"\" = page cache, ssd = queue pair on the SSD, emu = emulated queue pair backed by p2p_file");
+
+static char *p2p_file = "";
+module_param(p2p_file, charp, 0444);
+MODULE_PARM_DESC(p2p_file, "p2p=emu: file the emulated namespace reads from (default base_path)");
+
+static int p2p_qid = 1;
+module_param(p2p_qid, int, 0444);
+MODULE_PARM_DESC(p2p_qid, "I/O queue ID of the queue pair");
+
+static int p2p_qdepth = 64;
+module_param(p2p_qdepth, int, 0444);
+MODULE_PARM_DESC(p2p_qdepth, "Entries in the queue pair's SQ and CQ");
+
+static unsigned long long p2p_sq_pa = 0;
+module_param(p2p_sq_pa, ullong, 0444);
+MODULE_PARM_DESC(p2p_sq_pa, "p2p=ssd: physical address of the SQ");
+
+static unsigned long long p2p_cq_pa = 0;
+module_param(p2p_cq_pa, ullong, 0444);
+MODULE_PARM_DESC(p2p_cq_pa, "p2p=ssd: physical address of the CQ");
+
+static int p2p_nsid = 1;
+module_param(p2p_nsid, int, 0444);
+MODULE_PARM_DESC(p2p_nsid, "Namespace holding the base set");
+
+static int p2p_lba_shift = 9;
+module_param(p2p_lba_shift, int, 0444);
+MODULE_PARM_DESC(p2p_lba_shift, "Namespace block size as a shift (9 = 512B, 12 = 4KiB)");
+
+static unsigned long long p2p_slba = 0;
+module_param(p2p_slba, ullong, 0444);
+MODULE_PARM_DESC(p2p_slba, "First block of the base set on the namespace");
+
+static int p2p_max_kb = 128;
+module_param(p2p_max_kb, int, 0444);
+MODULE_PARM_DESC(p2p_max_kb, "Largest transfer per READ (KiB, the SSD's MDTS)");
+
+// dax: base_path is a pmem namespace; the engine reads the vectors where they lie
+static bool dax = false;
+module_param(dax, bool, 0644);
+MODULE_PARM_DESC(dax, "base_path is an fsdax pmem device (e.g. /dev/pmem0): map it with DAX and hand the engine its physical addresses instead of reading it. Set dim/elem, there is no .meta");
+
+static int num_queries = 1;
+module_param(num_queries, int, 0644);
+MODULE_PARM_DESC(num_queries, "Queries to serve from query_path (SIFT1M has 10000)");
+
+static int query_first = 0;
+module_param(query_first, int, 0644);
+MODULE_PARM_DESC(query_first, "Index of the first query in query_path");
+
+static int query_block = 0;
+module_param(query_block, int, 0644);
+MODULE_PARM_DESC(query_block, "Queries compared per scan of the base file (0 = all, max 8192)");
+
+static int topk = 0;
+module_param(topk, int, 0644);
+MODULE_PARM_DESC(topk, "Nearest neighbours kept per query and written to l2_stream_topk.bin (0 = off)");
+
+// PQ8 base sets: re-rank the best pq_rerank codes per query against the full vectors
+static char *rerank_path = "";
+module_param(rerank_path, charp, 0644);
+MODULE_PARM_DESC(rerank_path, "PQ base sets: full-precision vectors (query layout) to re-rank candidates against");
+
+static int pq_rerank = 0;
+module_param(pq_rerank, int, 0644);
+MODULE_PARM_DESC(pq_rerank, "PQ base sets: candidates kept per query for re-ranking (<= topk = off)");
+
+// engine: which L2 backend executes batches ("fpga" = BAR_1 CSRs of each bound board, "sw"/"cpu" = CPU model)
+static char *engine = "fpga";
+module_param(engine, charp, 0644);
+MODULE_PARM_DESC(engine, "L2 engine backend: fpga | sw (scalar model) | cpu (AVX2/AVX-512 model), clocked at axi_clk_mhz");
+
+// fpga_*: which boards the PCI driver binds; every matching board becomes one engine
+static ushort fpga_vendor = FPGA_PCI_VENDOR_ID;
+module_param(fpga_vendor, ushort, 0444);
+MODULE_PARM_DESC(fpga_vendor, "PCI vendor ID of the L2 FPGA boards");
+
+static ushort fpga_device = FPGA_PCI_DEVICE_ID;
+module_param(fpga_device, ushort, 0444);
+MODULE_PARM_DESC(fpga_device, "PCI device ID of the L2 FPGA boards");
+
+static int fpga_csr_bar = FPGA_CSR_BAR;
+module_param(fpga_csr_bar, int, 0444);
+MODULE_PARM_DESC(fpga_csr_bar, "PCI BAR index of the function CSRs (BAR_1)");
+
+static int fpga_win_bar = FPGA_WIN_BAR;
+module_param(fpga_win_bar, int, 0444);
+MODULE_PARM_DESC(fpga_win_bar, "PCI BAR index of the 512B pattern window (BAR_0)");
+
+static unsigned long long nvme_bar = PCI_BAR_ADDRESS;
+module_param(nvme_bar, ullong, 0444);
+MODULE_PARM_DESC(nvme_bar, "Physical address of the SSD BAR the boards ring doorbells in (0 = none)");
+
+static int model_engines = 1;
+module_param(model_engines, int, 0444);
+MODULE_PARM_DESC(model_engines, "sw/cpu engines: model instances to shard streaming runs over");
+
+static int cpu_threads = 0;
+module_param(cpu_threads, int, 0644);
+MODULE_PARM_DESC(cpu_threads, "cpu engine: worker kthreads on the CPUs nearest cxl_nid (0 = all of them, 1 = inline)");
+
+static int verify = 0;
+module_param(verify, int, 0644);
+MODULE_PARM_DESC(verify, "Re-check each batch on the CPU: last vector plus this many sampled vectors (0 = off)");
+
+static int poll_spin_us = 20;
+module_param(poll_spin_us, int, 0644);
+MODULE_PARM_DESC(poll_spin_us, "Busy-poll window (us) around a batch's expected completion");
+
+static int poll_timeout_ms = 60000;
+module_param(poll_timeout_ms, int, 0644);
+MODULE_PARM_DESC(poll_timeout_ms, "Per-batch completion timeout (ms)");
+
+static bool l2_irq = false;
+module_param(l2_irq, bool, 0644);
+MODULE_PARM_DESC(l2_irq, "Wait for the FPGA's MSI instead of polling RESP (falls back to polling)");
+
+static uint l2_caps = 0;
+module_param(l2_caps, uint, 0644);
+MODULE_PARM_DESC(l2_caps, "FPGA bitstream capabilities: bit0 = per-vector distance writeback, bit1 = scatter-gather descriptor tables (CXL_REG_L2_SG_ADDR)");
+
+// m5_interval_us: background hot-page sampling and CXL -> DRAM promotion (see cxl_tier.h)
+static int m5_interval_us = 0;
+module_param(m5_interval_us, int, 0444);
+MODULE_PARM_DESC(m5_interval_us, "m5 hot-page tracker window (us); 0 = no sampler");
+
+static int tier_dram_nid = 0;
+module_param(tier_dram_nid, int, 0444);
+MODULE_PARM_DESC(tier_dram_nid, "DRAM node hot cxl_nid pages are promoted to");
+
+static int tier_heat = 4;
+module_param(tier_heat, int, 0444);
+MODULE_PARM_DESC(tier_heat, "Hot-page reports (decaying) after which a page is promoted");
+
+static int tier_max_pages = 65536;
+module_param(tier_max_pages, int, 0444);
+MODULE_PARM_DESC(tier_max_pages, "Promoted pages kept in DRAM; past it the coldest are demoted");
+
+static int tier_table = 16384;
+module_param(tier_table, int, 0444);
+MODULE_PARM_DESC(tier_table, "Hotness table entries");
+
+// run_queries: any write serves the current query params against the resident dataset
+static bool l2_ready;
+static int run_queries_set(const char *val, const struct kernel_param *kp);
+
+static const struct kernel_param_ops run_queries_ops = {
+    .set = run_queries_set,
+};
+module_param_cb(run_queries, &run_queries_ops, NULL, 0200);
+MODULE_PARM_DESC(run_queries, "Write to run num_queries queries from query_first against the resident dataset (cxl_set=6)");
+
 // Example pages (used by some legacy paths)
 struct page *page_0, *page_1, *page_2, *page_3, *page_4, *page_5, *page_6, *page_7;
 phys_addr_t phys_addr_0, phys_addr_1, phys_addr_2, phys_addr_3;
 phys_addr_t phys_addr_4, phys_addr_5, phys_addr_6, phys_addr_7;
 
 // Legacy buffers (not used by case 5, safe to keep)
+#define BASE_BUFFER_SIZE (4ul * 1024 * 1024)
+static struct page *base_pages;
+static struct page *query_page;
+
+// case 4: load one buffer worth of base vectors and run a single L2 pass
+static int run_l2_single(void)
+{
+    struct l2_vec_layout lay;
+    long nbytes;
+    int rc;
+
+    // The single-shot path drives the FPGA directly: Q16.16 only
+    rc = l2_layout_resolve(base_path, dim, elem, &lay);
+    if (rc)
+        return rc;
+    if (lay.elem != L2_ELEM_Q16) {
+        pr_err("L2 single-shot needs Q16.16 vectors, %s has %s\n", base_path, l2_elem_name(lay.elem));
+        return -EOPNOTSUPP;
+    }
+
+    base_pages = alloc_pages_node(cxl_nid, GFP_KERNEL | __GFP_NOWARN, get_order(BASE_BUFFER_SIZE));
+    query_page = alloc_page(GFP_KERNEL);
+    if (!base_pages || !query_page)
+        return -ENOMEM;
+
+    nbytes = read_file_into_buffer(base_path, page_address(base_pages), BASE_BUFFER_SIZE);
+    if (nbytes < 0)
+        return nbytes;
+    if (read_file_into_buffer(query_path, page_address(query_page), PAGE_SIZE) < 0)
+        return -EIO;
+
+    return run_l2_and_dump(page_to_phys(base_pages), page_to_phys(query_page),
+                           nbytes / lay.vec_bytes, lay.dim, axi_clk_mhz);
+}
+
+static void l2_stream_cfg_from_params(struct l2_stream_cfg *cfg)
+{
+    *cfg = (struct l2_stream_cfg) {
+        .base_path  = base_path,
+        .query_path = query_path,
+        .total_vecs = total_vecs,
+        .dim        = dim,
+        .elem       = elem,
+        .batch_vecs = batch_vecs,
+        .batch_kb   = batch_kb,
+        .clk_mhz    = axi_clk_mhz,
+        .cxl_nid    = cxl_nid,
+        .cxl_base   = cxl_base,
+        .cxl_nodes  = cxl_nodes,
+        .depth      = pipeline_depth,
+        .direct     = odirect,
+        .readahead_kb = readahead_kb,
+        .aio_qd       = aio_qd,
+        .aio_kb       = aio_kb,
+        .aio_cpus     = aio_cpus,
+        .p2p          = *p2p,
+        .dax          = dax,
+        .num_queries  = num_queries,
+        .query_first  = query_first,
+        .query_block  = query_block,
+        .topk         = topk,
+        .rerank_path  = *rerank_path ? rerank_path : NULL,
+        .rerank       = pq_rerank,
+    };
+}
+
+static int run_queries_set(const char *val, const struct kernel_param *kp)
+{
+    struct l2_stream_cfg cfg;
+
+    // Ignored on the insmod command line: nothing is resident yet
+    if (!l2_ready)
+        return 0;
+
+    l2_stream_cfg_from_params(&cfg);
+    cfg.resident = true;
+    return run_l2_streaming_from_file(&cfg);
+}
+
+static int __init my_module_init(void)
+{
+    struct l2_engine_cfg ecfg = {
+        .name       = engine,
+        .clk_mhz    = axi_clk_mhz,
+        .spin_us    = poll_spin_us,
+        .timeout_ms = poll_timeout_ms,
+        .use_irq    = l2_irq,
+        .caps       = l2_caps,
+        .verify     = verify,
+        .nid        = cxl_nid,
+        .threads    = cpu_threads,
+        .count      = max(model_engines, 1),
+    };
+    struct cxl_dev_cfg dcfg = {
+        .vendor  = fpga_vendor,
+        .device  = fpga_device,
+        .csr_bar = fpga_csr_bar,
+        .win_bar = fpga_win_bar,
+        .nvme_pa = nvme_bar,
+    };
+    struct l2_nvme_cfg ncfg = {
+        .mode      = p2p,
+        .file      = *p2p_file ? p2p_file : base_path,
+        .qid       = p2p_qid,
+        .depth     = p2p_qdepth,
+        .nsid      = p2p_nsid,
+        .lba_shift = p2p_lba_shift,
+        .slba      = p2p_slba,
+        .max_xfer  = p2p_max_kb * 1024,
+        .sq_pa     = p2p_sq_pa,
+        .cq_pa     = p2p_cq_pa,
+    };
+    struct cxl_tier_cfg tcfg = {
+        .interval_us  = m5_interval_us,
+        .clk_mhz      = axi_clk_mhz,
+        .cxl_nid      = cxl_nid,
+        .cxl_base     = cxl_base,
+        .dram_nid     = tier_dram_nid,
+        .table        = tier_table,
+        .promote_heat = tier_heat,
+        .max_promoted = tier_max_pages,
+    };
+    int rc;
+
+    pr_info("Kernel module loaded (cxl_set=%d, engine=%s)\n", cxl_set, engine);
+
+    // The CPU backends run without the FPGA; everything else needs its BARs
+    if (strcmp(engine, "sw") && strcmp(engine, "cpu")) {
+        rc = cxl_dev_init(&dcfg);
+        if (rc)
+            return rc;
+    }
+
+    // debugfs histograms/counters; the cxl_set runs below are already counted
+    l2_stats_init();
+
+    rc = l2_engine_init(&ecfg);
+    if (rc) {
+        l2_stats_exit();
+        cxl_dev_exit();
+        return rc;
+    }
+
+    // The SSD queue pair rings its doorbells through the BAR cxl_dev mapped
+    if (*p2p) {
+        rc = l2_nvme_init(&ncfg);
+        if (rc) {
+            l2_engine_exit();
+            l2_stats_exit();
+            cxl_dev_exit();
+            return rc;
+        }
+    }
+
+    // Tiering is a side feature: the benchmark runs without it
+    if (cxl_tier_start(&tcfg))
+        pr_warn("m5 hot-page sampler not started\n");
+
+    switch (cxl_set) {
+    case 4:
+        l2_stats_run_begin();
+        rc = run_l2_single();
+        l2_stats_run_end(rc);
+        if (rc)
+            pr_err("L2 single-shot failed rc=%d\n", rc);
+        break;
+    case 5: {
+        struct l2_stream_cfg cfg;
+
+        l2_stream_cfg_from_params(&cfg);
+        rc = run_l2_streaming_from_file(&cfg);
+        if (rc)
+            pr_err("L2 streaming failed rc=%d\n", rc);
+        break;
+    }
+    case 6: {
+        struct l2_stream_cfg cfg;
+
+        // Load once; the first query run follows, later ones via run_queries
+        l2_stream_cfg_from_params(&cfg);
+        // Recorded as a run so a failed load shows in the state file
+        l2_stats_run_begin();
+        rc = l2_stream_load_resident(&cfg);
+        l2_stats_run_end(rc);
+        if (rc) {
+            pr_err("L2 resident load failed rc=%d\n", rc);
+            break;
+        }
+        cfg.resident = true;
+        rc = run_l2_streaming_from_file(&cfg);
+        if (rc)
+            pr_err("L2 resident query run failed rc=%d\n", rc);
+        break;
+    }
+    default:
+        pr_info("cxl_set=%d: nothing to run\n", cxl_set);
+        break;
+    }
+
+    // Later queries: /dev/l2_engine (or run_queries) against the resident set
+    if (l2_cdev_init(l2_stream_cfg_from_params))
+        pr_warn("/dev/l2_engine unavailable, queries only via run_queries\n");
+
+    l2_ready = true;
+    return 0;
 }
 
 static void __exit my_module_exit(void)
 {
+    cxl_tier_stop();
+    l2_cdev_exit();
+    l2_stream_drop_resident();
     if (base_pages) {
         __free_pages(base_pages, get_order(BASE_BUFFER_SIZE));
         pr_info("Freed base vector pages\n");
@@ -60,6 +490,10 @@ static void __exit my_module_exit(void)
         __free_page(query_page);
         pr_info("Freed query vector page\n");
     }
+    l2_nvme_exit();
+    l2_engine_exit();
+    l2_stats_exit();
+    cxl_dev_exit();
     pr_info("Kernel module unloaded.\n");
 }
 
@@ -0,0 +1,829 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * vecconv: .fvecs/.bvecs/.ivecs -> raw .bin + .meta for the L2 streaming
+ * module, as scripts/fvecs_to_bin.py does, but fast enough for SIFT1B.
+ *
+ * The input is mmapped and split into blocks that worker threads convert
+ * straight into the mmapped output; the inner loops are plain per-element
+ * loops left for the compiler to vectorise (-O3 -march=native).
+ *
+ * Output files are zero-padded to a multiple of 2 MiB so O_DIRECT reads of
+ * the last batch never run short; .meta "vectors"/"bytes" give the real
+ * payload, which is what the module streams. With -S, the output is split
+ * into shards of at most that many MiB (whole vectors each), every shard a
+ * complete dataset with its own .meta: out.000.bin, out.001.bin, ...
+ *
+ * -s auto picks the int8 scale that maps max |x| (after -c) to 127 and
+ * records it in .meta; convert the query file with that -s value.
+ *
+ * With -p M the output is product-quantized: each vector becomes M one-byte
+ * codes, the index of the nearest of 256 centroids in each of its M
+ * sub-spaces of dim / M components. The centroids are trained with k-means
+ * on an evenly spaced sample (-T vectors, -I iterations), stored in the -t
+ * element type as "<stem>.pq" next to every output file, and vectors are
+ * encoded against the stored (rounded) centroids. Queries stay full
+ * vectors: convert them without -p, with the same -t and -s.
+ *
+ * Build: make -C tools
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define OUT_ALIGN       (2u << 20)
+#define BLOCK_VECS      16384
+#define PQ_KSUB         256
+
+enum in_fmt { IN_FVECS, IN_BVECS, IN_IVECS };
+enum out_elem { OUT_Q16, OUT_INT8, OUT_FP16 };
+
+struct opts {
+    enum out_elem elem;
+    double scale;           /* q16: 2^16, int8: 0.5 (as fvecs_to_bin.py) */
+    double clip_abs;        /* 0 = no clipping */
+    uint64_t limit;         /* 0 = all */
+    int threads;            /* 0 = online CPUs */
+    uint64_t shard_mb;      /* 0 = single file */
+    uint32_t expect_dim;    /* 0 = from the first record */
+    int auto_scale;         /* int8: scale = 127 / max |x| */
+    uint32_t pq_m;          /* 0 = no product quantization */
+    uint64_t pq_train;      /* k-means sample size */
+    int pq_iters;
+};
+
+// PQ codebook: m x PQ_KSUB centroids of dsub components
+struct pq {
+    uint32_t m, dsub;
+    float *cent;            /* as stored, in the output domain */
+    uint8_t *book;          /* as written to <stem>.pq */
+    size_t book_bytes;
+    double max_abs;
+};
+
+struct job {
+    const struct opts *o;
+    const uint8_t *in;
+    uint32_t dim;
+    size_t in_elem;         /* bytes per input component */
+    size_t in_stride;       /* 4-byte dim header + components */
+    enum in_fmt fmt;
+    size_t out_elem;
+    size_t vec_bytes;       /* per output vector: dim * out_elem, or pq->m */
+    const struct pq *pq;    /* NULL unless -p */
+    uint8_t *out;           /* current shard's mapping */
+    uint64_t first;         /* first vector of the shard */
+    uint64_t nvecs;         /* vectors in the shard */
+    atomic_uint_fast64_t next;
+    atomic_int bad_dim;
+    uint64_t bad_at;
+    pthread_mutex_t lock;
+    double max_abs;
+};
+
+static const char *elem_names[] = { "q16", "int8", "fp16" };
+static const size_t elem_sizes[] = { 4, 1, 2 };
+
+// float -> IEEE half, round to nearest even, saturating to +-inf
+static uint16_t f32_to_f16(float f)
+{
+    uint32_t x;
+    uint32_t sign, exp, mant;
+
+    memcpy(&x, &f, 4);
+    sign = (x >> 16) & 0x8000;
+    exp  = (x >> 23) & 0xff;
+    mant = x & 0x7fffff;
+
+    if (exp == 0xff)                        /* inf / nan */
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    if (exp > 142)                          /* >= 2^16: overflow */
+        return sign | 0x7c00;
+    if (exp >= 113) {                       /* normal half */
+        uint32_t h = ((exp - 112) << 10) | (mant >> 13);
+        uint32_t rem = mant & 0x1fff;
+
+        if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+            h++;                            /* may carry into the exponent: fine */
+        return sign | h;
+    }
+    if (exp >= 102) {                       /* subnormal half */
+        uint32_t m = mant | 0x800000;
+        uint32_t shift = 126 - exp;
+        uint32_t h = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+
+        if (rem > half || (rem == half && (h & 1)))
+            h++;
+        return sign | h;
+    }
+    return sign;
+}
+
+static float f16_to_f32(uint16_t h)
+{
+    uint32_t exp = (h >> 10) & 0x1f, mant = h & 0x3ff;
+    float v;
+
+    if (exp == 0)
+        v = ldexpf((float)mant, -24);
+    else if (exp == 31)
+        v = mant ? NAN : INFINITY;
+    else
+        v = ldexpf((float)(mant | 0x400), (int)exp - 25);
+    return (h & 0x8000) ? -v : v;
+}
+
+// Output values are the input times this before rounding (fp16 keeps floats)
+static float domain_scale(const struct opts *o)
+{
+    return o->elem == OUT_FP16 ? 1.0f : (float)o->scale;
+}
+
+// Store one output-domain value as an element; returns what was stored
+static float put_elem(enum out_elem e, float v, uint8_t *dst)
+{
+    switch (e) {
+    case OUT_INT8: {
+        float r = fminf(fmaxf(rintf(v), -128.0f), 127.0f);
+
+        *(int8_t *)dst = (int8_t)r;
+        return r;
+    }
+    case OUT_FP16: {
+        uint16_t h = f32_to_f16(v);
+
+        memcpy(dst, &h, 2);
+        return f16_to_f32(h);
+    }
+    default: {
+        float r = fminf(fmaxf(rintf(v), -2147483648.0f), 2147483520.0f);
+        int32_t q = (int32_t)r;
+
+        memcpy(dst, &q, 4);
+        return r;
+    }
+    }
+}
+
+// Index of the centroid in cent[PQ_KSUB][dsub] nearest to x
+static uint32_t nearest(const float *cent, const float *x, uint32_t dsub)
+{
+    float best = INFINITY;
+    uint32_t k, d, arg = 0;
+
+    for (k = 0; k < PQ_KSUB; k++, cent += dsub) {
+        float dist = 0.0f;
+
+        for (d = 0; d < dsub; d++)
+            dist += (x[d] - cent[d]) * (x[d] - cent[d]);
+        if (dist < best) {
+            best = dist;
+            arg  = k;
+        }
+    }
+    return arg;
+}
+
+// One record's components as floats
+static void load_vec(const struct job *j, const uint8_t *rec, float *dst)
+{
+    uint32_t i;
+
+    switch (j->fmt) {
+    case IN_BVECS:
+        for (i = 0; i < j->dim; i++)
+            dst[i] = rec[i];
+        break;
+    case IN_IVECS: {
+        int32_t v[1];
+
+        for (i = 0; i < j->dim; i++) {
+            memcpy(v, rec + 4 * i, 4);
+            dst[i] = (float)v[0];
+        }
+        break;
+    }
+    default:
+        memcpy(dst, rec, (size_t)j->dim * 4);
+        break;
+    }
+}
+
+// Convert vectors [v0, v1) of the shard; returns the block's max |fixed|
+static double convert_block(struct job *j, uint64_t v0, uint64_t v1, float *tmp)
+{
+    const struct opts *o = j->o;
+    const float scale = (float)o->scale, clip = (float)o->clip_abs;
+    float mx = 0.0f;
+    uint64_t v;
+    uint32_t i;
+
+    for (v = v0; v < v1; v++) {
+        const uint8_t *rec = j->in + (j->first + v) * j->in_stride;
+        uint8_t *dst = j->out + v * j->vec_bytes;
+        uint32_t d;
+
+        memcpy(&d, rec, 4);
+        if (d != j->dim) {
+            if (!atomic_exchange(&j->bad_dim, 1))
+                j->bad_at = j->first + v;
+            return mx;
+        }
+        load_vec(j, rec + 4, tmp);
+
+        if (clip > 0.0f) {
+            for (i = 0; i < j->dim; i++)
+                tmp[i] = fminf(fmaxf(tmp[i], -clip), clip);
+        }
+        if (j->pq) {
+            const float ds = domain_scale(o);
+
+            for (i = 0; i < j->dim; i++)
+                tmp[i] *= ds;
+            for (i = 0; i < j->pq->m; i++)
+                dst[i] = nearest(j->pq->cent + (size_t)i * PQ_KSUB * j->pq->dsub,
+                                 tmp + (size_t)i * j->pq->dsub, j->pq->dsub);
+            continue;
+        }
+
+        switch (o->elem) {
+        case OUT_INT8: {
+            int8_t *out = (int8_t *)dst;
+
+            for (i = 0; i < j->dim; i++) {
+                float r = fminf(fmaxf(rintf(tmp[i] * scale), -128.0f), 127.0f);
+
+                out[i] = (int8_t)r;
+                mx = fmaxf(mx, fabsf(r));
+            }
+            break;
+        }
+        case OUT_FP16: {
+            uint16_t h;
+
+            for (i = 0; i < j->dim; i++) {
+                h = f32_to_f16(tmp[i]);
+                memcpy(dst + 2 * i, &h, 2);
+                mx = fmaxf(mx, fabsf(f16_to_f32(h)));
+            }
+            break;
+        }
+        default: {
+            int32_t q;
+
+            // Saturate rather than wrap like numpy's astype would
+            for (i = 0; i < j->dim; i++) {
+                float r = fminf(fmaxf(rintf(tmp[i] * scale), -2147483648.0f), 2147483520.0f);
+
+                q = (int32_t)r;
+                memcpy(dst + 4 * i, &q, 4);
+                mx = fmaxf(mx, fabsf(r));
+            }
+            break;
+        }
+        }
+    }
+    return mx;
+}
+
+static void *worker(void *arg)
+{
+    struct job *j = arg;
+    double mx = 0.0;
+    float *tmp = malloc((size_t)j->dim * sizeof(float));
+
+    if (!tmp)
+        abort();
+    for (;;) {
+        uint64_t v0 = atomic_fetch_add(&j->next, BLOCK_VECS);
+        uint64_t v1;
+        double b;
+
+        if (v0 >= j->nvecs || atomic_load(&j->bad_dim))
+            break;
+        v1 = v0 + BLOCK_VECS < j->nvecs ? v0 + BLOCK_VECS : j->nvecs;
+        b  = convert_block(j, v0, v1, tmp);
+        if (b > mx)
+            mx = b;
+    }
+    free(tmp);
+
+    pthread_mutex_lock(&j->lock);
+    if (mx > j->max_abs)
+        j->max_abs = mx;
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
+
+// -s auto: max |x| (after clipping) over the shard's input
+static void *max_worker(void *arg)
+{
+    struct job *j = arg;
+    const float clip = (float)j->o->clip_abs;
+    float mx = 0.0f;
+    float *tmp = malloc((size_t)j->dim * sizeof(float));
+
+    if (!tmp)
+        abort();
+    for (;;) {
+        uint64_t v = atomic_fetch_add(&j->next, BLOCK_VECS);
+        uint64_t v1 = v + BLOCK_VECS < j->nvecs ? v + BLOCK_VECS : j->nvecs;
+        uint32_t i, d;
+
+        if (v >= j->nvecs)
+            break;
+        for (; v < v1; v++) {
+            const uint8_t *rec = j->in + (j->first + v) * j->in_stride;
+
+            memcpy(&d, rec, 4);
+            if (d != j->dim)
+                continue;       /* reported by the conversion */
+            load_vec(j, rec + 4, tmp);
+            for (i = 0; i < j->dim; i++)
+                mx = fmaxf(mx, fabsf(tmp[i]));
+        }
+    }
+    free(tmp);
+    if (clip > 0.0f)
+        mx = fminf(mx, clip);
+
+    pthread_mutex_lock(&j->lock);
+    if (mx > j->max_abs)
+        j->max_abs = mx;
+    pthread_mutex_unlock(&j->lock);
+    return NULL;
+}
+
+static void run_workers(struct job *j, void *(*fn)(void *))
+{
+    pthread_t *tids = calloc(j->o->threads, sizeof(*tids));
+    int t;
+
+    if (!tids)
+        abort();
+    atomic_store(&j->next, 0);
+    for (t = 0; t < j->o->threads; t++)
+        pthread_create(&tids[t], NULL, fn, j);
+    for (t = 0; t < j->o->threads; t++)
+        pthread_join(tids[t], NULL);
+    free(tids);
+}
+
+// ---------- PQ training ----------
+struct train {
+    struct pq *pq;
+    const float *x;         /* n x dim sample, in the output domain */
+    uint64_t n;
+    uint32_t dim;
+    int iters;
+    atomic_uint next;       /* sub-space */
+};
+
+// k-means of one sub-space at a time
+static void *train_worker(void *arg)
+{
+    struct train *t = arg;
+    const uint32_t dsub = t->pq->dsub;
+    float *sub = malloc(t->n * dsub * sizeof(float));
+    double *sum = malloc(PQ_KSUB * dsub * sizeof(double));
+    uint64_t *cnt = malloc(PQ_KSUB * sizeof(uint64_t));
+    uint64_t i;
+    uint32_t s, k, d;
+    int it;
+
+    if (!sub || !sum || !cnt)
+        abort();
+    while ((s = atomic_fetch_add(&t->next, 1)) < t->pq->m) {
+        float *c = t->pq->cent + (size_t)s * PQ_KSUB * dsub;
+
+        for (i = 0; i < t->n; i++)
+            memcpy(sub + i * dsub, t->x + i * t->dim + (size_t)s * dsub, dsub * sizeof(float));
+        // Evenly spaced seeds: deterministic, and the sample is spread already
+        for (k = 0; k < PQ_KSUB; k++)
+            memcpy(c + k * dsub, sub + (k * t->n / PQ_KSUB) * dsub, dsub * sizeof(float));
+
+        for (it = 0; it < t->iters; it++) {
+            memset(sum, 0, PQ_KSUB * dsub * sizeof(double));
+            memset(cnt, 0, PQ_KSUB * sizeof(uint64_t));
+            for (i = 0; i < t->n; i++) {
+                const float *x = sub + i * dsub;
+
+                k = nearest(c, x, dsub);
+                cnt[k]++;
+                for (d = 0; d < dsub; d++)
+                    sum[k * dsub + d] += x[d];
+            }
+            for (k = 0; k < PQ_KSUB; k++) {
+                if (!cnt[k]) {
+                    // Empty cluster: re-seed from a pseudo-random sample point
+                    i = ((uint64_t)k * 2654435761u + it) % t->n;
+                    memcpy(c + k * dsub, sub + i * dsub, dsub * sizeof(float));
+                    continue;
+                }
+                for (d = 0; d < dsub; d++)
+                    c[k * dsub + d] = (float)(sum[k * dsub + d] / cnt[k]);
+            }
+        }
+    }
+    free(cnt);
+    free(sum);
+    free(sub);
+    return NULL;
+}
+
+// Train on an evenly spaced sample of the first total vectors, then round
+// the centroids to the output element type
+static int pq_train(struct job *j, struct pq *pq, uint64_t total)
+{
+    const struct opts *o = j->o;
+    const float ds = domain_scale(o), clip = (float)o->clip_abs;
+    struct train t = { .pq = pq, .dim = j->dim, .iters = o->pq_iters };
+    pthread_t *tids;
+    float *x;
+    size_t e;
+    uint64_t i;
+    uint32_t d;
+    int th;
+
+    t.n = o->pq_train < total ? o->pq_train : total;
+    if (t.n < PQ_KSUB) {
+        fprintf(stderr, "vecconv: PQ needs at least %u training vectors, have %llu\n",
+                PQ_KSUB, (unsigned long long)t.n);
+        return -1;
+    }
+    pq->m    = o->pq_m;
+    pq->dsub = j->dim / o->pq_m;
+    pq->cent = malloc((size_t)pq->m * PQ_KSUB * pq->dsub * sizeof(float));
+    pq->book_bytes = (size_t)pq->m * PQ_KSUB * pq->dsub * j->out_elem;
+    pq->book = malloc(pq->book_bytes);
+    x = malloc(t.n * j->dim * sizeof(float));
+    if (!pq->cent || !pq->book || !x) {
+        fprintf(stderr, "vecconv: out of memory for PQ training\n");
+        return -1;
+    }
+
+    for (i = 0; i < t.n; i++) {
+        const uint8_t *rec = j->in + (i * total / t.n) * j->in_stride;
+        float *v = x + i * j->dim;
+
+        memcpy(&d, rec, 4);
+        if (d != j->dim) {
+            fprintf(stderr, "vecconv: vector %llu has dim=%u, expected %u\n",
+                    (unsigned long long)(i * total / t.n), d, j->dim);
+            free(x);
+            return -1;
+        }
+        load_vec(j, rec + 4, v);
+        for (d = 0; d < j->dim; d++)
+            v[d] = (clip > 0.0f ? fminf(fmaxf(v[d], -clip), clip) : v[d]) * ds;
+    }
+
+    printf("Training PQ: m=%u dsub=%u on %llu vectors, %d iterations\n", pq->m, pq->dsub,
+           (unsigned long long)t.n, t.iters);
+    t.x = x;
+    atomic_store(&t.next, 0);
+    tids = calloc(o->threads, sizeof(*tids));
+    if (!tids)
+        abort();
+    for (th = 0; th < o->threads; th++)
+        pthread_create(&tids[th], NULL, train_worker, &t);
+    for (th = 0; th < o->threads; th++)
+        pthread_join(tids[th], NULL);
+    free(tids);
+    free(x);
+
+    // Encode against what the module will see
+    pq->max_abs = 0.0;
+    for (e = 0; e < (size_t)pq->m * PQ_KSUB * pq->dsub; e++) {
+        pq->cent[e] = put_elem(o->elem, pq->cent[e], pq->book + e * j->out_elem);
+        if (fabsf(pq->cent[e]) > pq->max_abs)
+            pq->max_abs = fabsf(pq->cent[e]);
+    }
+    return 0;
+}
+
+// Python float repr for the values fvecs_to_bin.py prints ("65536.0", "0.5")
+static void put_float(FILE *f, const char *key, double v)
+{
+    if (v == floor(v) && fabs(v) < 1e16)
+        fprintf(f, "%s=%.1f\n", key, v);
+    else
+        fprintf(f, "%s=%.17g\n", key, v);
+}
+
+// "dir/x.bin" -> "dir/x.meta", as Path.with_suffix(".meta")
+static char *sidecar_path(const char *bin, const char *suffix)
+{
+    const char *slash = strrchr(bin, '/');
+    const char *dot = strrchr(bin, '.');
+    size_t stem = (dot && (!slash || dot > slash + 1)) ? (size_t)(dot - bin) : strlen(bin);
+    char *p = malloc(stem + strlen(suffix) + 1);
+
+    if (p)
+        sprintf(p, "%.*s%s", (int)stem, bin, suffix);
+    return p;
+}
+
+static int write_meta(const char *bin, const struct opts *o, uint64_t vecs,
+                      uint32_t dim, uint64_t bytes, double max_abs)
+{
+    char *path = sidecar_path(bin, ".meta");
+    const char *fmt;
+    FILE *f;
+
+    if (!path || !(f = fopen(path, "w"))) {
+        fprintf(stderr, "vecconv: cannot write %s: %s\n", path ? path : bin, strerror(errno));
+        free(path);
+        return -1;
+    }
+    fprintf(f, "vectors=%llu\n", (unsigned long long)vecs);
+    fprintf(f, "dimension=%u\n", dim);
+    fprintf(f, "bytes=%llu\n", (unsigned long long)bytes);
+    fprintf(f, "size_MB=%.2f\n", bytes / (1024.0 * 1024.0));
+    switch (o->elem) {
+    case OUT_INT8:
+        put_float(f, "fixed_scale", o->scale);
+        fmt = "int8 (signed int8)";
+        break;
+    case OUT_FP16:
+        fmt = "fp16 (IEEE half)";
+        break;
+    default:
+        put_float(f, "fixed_scale", o->scale);
+        fmt = "Q16.16 (signed int32)";
+        break;
+    }
+    if (o->pq_m) {
+        // Codes; the codebook (and the queries) are in pq_elem
+        fprintf(f, "fixed_format=pq8 (uint8 codes)\n");
+        fprintf(f, "pq_m=%u\n", o->pq_m);
+        fprintf(f, "pq_elem=%s\n", elem_names[o->elem]);
+    } else {
+        fprintf(f, "fixed_format=%s\n", fmt);
+    }
+    // Integer elements give an integer peak; fp16 a float, printed as the script does
+    if (o->elem == OUT_FP16)
+        put_float(f, "max_abs_fixed", max_abs);
+    else
+        fprintf(f, "max_abs_fixed=%.0f\n", max_abs);
+    if (o->clip_abs > 0)
+        put_float(f, "clip_abs", o->clip_abs);
+    fclose(f);
+    free(path);
+    return 0;
+}
+
+static int write_codebook(const char *bin, const struct pq *pq)
+{
+    char *path = sidecar_path(bin, ".pq");
+    FILE *f;
+    int rc = 0;
+
+    if (!path || !(f = fopen(path, "w"))) {
+        fprintf(stderr, "vecconv: cannot write %s: %s\n", path ? path : bin, strerror(errno));
+        free(path);
+        return -1;
+    }
+    if (fwrite(pq->book, 1, pq->book_bytes, f) != pq->book_bytes)
+        rc = -1;
+    if (fclose(f))
+        rc = -1;
+    if (rc)
+        fprintf(stderr, "vecconv: %s: %s\n", path, strerror(errno));
+    free(path);
+    return rc;
+}
+
+static int convert_shard(struct job *j, const char *path)
+{
+    uint64_t bytes = j->nvecs * j->vec_bytes;
+    uint64_t padded = (bytes + OUT_ALIGN - 1) / OUT_ALIGN * OUT_ALIGN;
+    int fd, rc = 0;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, padded)) {
+        fprintf(stderr, "vecconv: %s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    j->out = padded ? mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : NULL;
+    if (j->out == MAP_FAILED) {
+        fprintf(stderr, "vecconv: mmap %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    j->max_abs = 0.0;
+    run_workers(j, worker);
+    if (j->pq)
+        j->max_abs = j->pq->max_abs;
+
+    if (atomic_load(&j->bad_dim)) {
+        uint32_t d;
+
+        memcpy(&d, j->in + j->bad_at * j->in_stride, 4);
+        fprintf(stderr, "vecconv: vector %llu has dim=%u, expected %u\n",
+                (unsigned long long)j->bad_at, d, j->dim);
+        rc = -1;
+    }
+    if (j->out && munmap(j->out, padded))
+        rc = -1;
+    if (close(fd))
+        rc = -1;
+    if (!rc)
+        rc = write_meta(path, j->o, j->nvecs, j->dim, bytes, j->max_abs);
+    if (!rc && j->pq)
+        rc = write_codebook(path, j->pq);
+    if (!rc)
+        printf("  %s: %llu vectors, %.2f MB, max |value| %g\n", path,
+               (unsigned long long)j->nvecs, bytes / (1024.0 * 1024.0), j->max_abs);
+    return rc;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: vecconv [options] IN.{fvecs,bvecs,ivecs} OUT.bin\n"
+            "  -t q16|int8|fp16  output element type (default q16)\n"
+            "  -s SCALE|auto     q16/int8 scale (default 65536 / 0.5; auto: int8 only)\n"
+            "  -c CLIP_ABS       clip components to [-CLIP_ABS, CLIP_ABS] first\n"
+            "  -n LIMIT          convert only the first LIMIT vectors\n"
+            "  -d DIM            expected dimension (default: from the file)\n"
+            "  -j THREADS        worker threads (default: online CPUs)\n"
+            "  -S SHARD_MB       split into shards of at most SHARD_MB MiB\n"
+            "  -p M              product-quantize into M one-byte codes per vector\n"
+            "  -T N              PQ: k-means sample size (default 65536)\n"
+            "  -I ITERS          PQ: k-means iterations (default 20)\n");
+    exit(2);
+}
+
+static enum in_fmt in_format(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+
+    if (dot && !strcmp(dot, ".bvecs"))
+        return IN_BVECS;
+    if (dot && !strcmp(dot, ".ivecs"))
+        return IN_IVECS;
+    if (dot && !strcmp(dot, ".fvecs"))
+        return IN_FVECS;
+    fprintf(stderr, "vecconv: %s: expected .fvecs, .bvecs or .ivecs\n", path);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct opts o = { .elem = OUT_Q16, .scale = 0.0, .pq_train = 65536, .pq_iters = 20 };
+    struct job j = { .o = &o };
+    struct pq pq = { 0 };
+    const char *in_path, *out_path;
+    uint64_t total, per_shard, first;
+    struct stat st;
+    unsigned shard;
+    int fd, c, i;
+
+    while ((c = getopt(argc, argv, "t:s:c:n:d:j:S:p:T:I:h")) != -1) {
+        switch (c) {
+        case 't':
+            for (i = 0; i < 3 && strcmp(optarg, elem_names[i]); i++)
+                ;
+            if (i == 3)
+                usage();
+            o.elem = i;
+            break;
+        case 's':
+            o.auto_scale = !strcmp(optarg, "auto");
+            o.scale      = o.auto_scale ? 0.0 : strtod(optarg, NULL);
+            break;
+        case 'c': o.clip_abs   = strtod(optarg, NULL); break;
+        case 'n': o.limit      = strtoull(optarg, NULL, 0); break;
+        case 'd': o.expect_dim = strtoul(optarg, NULL, 0); break;
+        case 'j': o.threads    = atoi(optarg); break;
+        case 'S': o.shard_mb   = strtoull(optarg, NULL, 0); break;
+        case 'p': o.pq_m       = strtoul(optarg, NULL, 0); break;
+        case 'T': o.pq_train   = strtoull(optarg, NULL, 0); break;
+        case 'I': o.pq_iters   = atoi(optarg); break;
+        default:  usage();
+        }
+    }
+    if (argc - optind != 2)
+        usage();
+    in_path  = argv[optind];
+    out_path = argv[optind + 1];
+    if (o.auto_scale && o.elem != OUT_INT8)
+        usage();
+    if (o.scale == 0.0)
+        o.scale = o.elem == OUT_INT8 ? 0.5 : 65536.0;
+    if (o.threads <= 0)
+        o.threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    j.fmt      = in_format(in_path);
+    j.in_elem  = j.fmt == IN_BVECS ? 1 : 4;
+    j.out_elem = elem_sizes[o.elem];
+    pthread_mutex_init(&j.lock, NULL);
+
+    fd = open(in_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "vecconv: %s: %s\n", in_path, strerror(errno));
+        return 1;
+    }
+    if (st.st_size < 4) {
+        fprintf(stderr, "vecconv: %s: empty\n", in_path);
+        return 1;
+    }
+    j.in = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (j.in == MAP_FAILED) {
+        fprintf(stderr, "vecconv: mmap %s: %s\n", in_path, strerror(errno));
+        return 1;
+    }
+    madvise((void *)j.in, st.st_size, MADV_SEQUENTIAL);
+    close(fd);
+
+    memcpy(&j.dim, j.in, 4);
+    if (!j.dim || (o.expect_dim && j.dim != o.expect_dim)) {
+        fprintf(stderr, "vecconv: vector 0 has dim=%u, expected %u\n", j.dim, o.expect_dim);
+        return 1;
+    }
+    if (o.pq_m && j.dim % o.pq_m) {
+        fprintf(stderr, "vecconv: -p %u does not divide dim=%u\n", o.pq_m, j.dim);
+        return 2;
+    }
+    j.vec_bytes = o.pq_m ? o.pq_m : (size_t)j.dim * j.out_elem;
+    j.in_stride = 4 + (size_t)j.dim * j.in_elem;
+    if (st.st_size % j.in_stride)
+        fprintf(stderr, "vecconv: %s: trailing %llu bytes ignored (incomplete vector)\n",
+                in_path, (unsigned long long)(st.st_size % j.in_stride));
+    total = st.st_size / j.in_stride;
+    if (o.limit && o.limit < total)
+        total = o.limit;
+
+    per_shard = total;
+    if (o.shard_mb) {
+        per_shard = (o.shard_mb << 20) / j.vec_bytes;
+        if (!per_shard) {
+            fprintf(stderr, "vecconv: -S %llu is smaller than one vector\n",
+                    (unsigned long long)o.shard_mb);
+            return 2;
+        }
+    }
+
+    if (o.auto_scale) {
+        j.first = 0;
+        j.nvecs = total;
+        run_workers(&j, max_worker);
+        o.scale = j.max_abs > 0.0 ? 127.0 / j.max_abs : 1.0;
+        printf("int8 scale %.17g (max |x| %g); convert queries with -s %.17g\n",
+               o.scale, j.max_abs, o.scale);
+    }
+    if (o.pq_m) {
+        if (pq_train(&j, &pq, total))
+            return 1;
+        j.pq = &pq;
+    }
+
+    printf("Converting %s -> %s (%s%s, dim=%u, %llu vectors, %d threads)\n", in_path, out_path,
+           o.pq_m ? "pq8 codes, codebook " : "", elem_names[o.elem], j.dim,
+           (unsigned long long)total, o.threads);
+
+    for (first = 0, shard = 0; first < total || (!total && !shard); first += j.nvecs, shard++) {
+        char *path = (char *)out_path;
+        int rc;
+
+        j.first = first;
+        j.nvecs = total - first < per_shard ? total - first : per_shard;
+        if (per_shard < total) {
+            // out.bin -> out.000.bin
+            const char *dot = strrchr(out_path, '.');
+            const char *slash = strrchr(out_path, '/');
+            int stem = (dot && (!slash || dot > slash)) ? (int)(dot - out_path) : (int)strlen(out_path);
+
+            if (asprintf(&path, "%.*s.%03u%s", stem, out_path, shard,
+                         stem < (int)strlen(out_path) ? out_path + stem : ".bin") < 0)
+                return 1;
+        }
+        rc = convert_shard(&j, path);
+        if (path != out_path)
+            free(path);
+        if (rc)
+            return 1;
+        if (!total)
+            break;
+    }
+
+    free(pq.cent);
+    free(pq.book);
+    munmap((void *)j.in, st.st_size);
+    printf("Done: %llu vectors in %u file(s)\n", (unsigned long long)total, shard);
+    return 0;
+}